@@ -0,0 +1,222 @@
+// Load time of the BCC files : the former fread of every control point against the memory mapped
+// file, the streaming reader and the whole LoadBCCFile without its cache. Every file of the directory
+// is read, results are written as JSON.
+//
+// Usage : BCCBenchmark [--directory resources] [--repeat 10] [--output results.json]
+
+#include "Base/bccReader.h"
+#include "Base/Logging.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+
+using Clock = std::chrono::high_resolution_clock;
+
+struct BenchmarkSettings
+{
+    fs::path directory = "resources";
+    uint32_t repeatCount = 10;
+    std::string output = "bcc_benchmark.json";
+};
+
+
+inline double Seconds(const Clock::time_point& start)
+{
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+// The reader before the memory mapping, one fread per control point into one vector per curve
+bool ReadBCCWithFread(const fs::path& filePath,
+                      std::vector<std::vector<glm::vec3>>& closedFibersCP,
+                      std::vector<std::vector<glm::vec3>>& openFibersCP)
+{
+    closedFibersCP.clear();
+    openFibersCP.clear();
+
+    FILE* file = fopen(filePath.c_str(), "rb");
+    ASSERT_OR_RETURN(file, false, "Impossible to open the file %s !", filePath.c_str());
+
+    BCCHeader header;
+    bool success = fread(&header, sizeof(header), 1, file) == 1;
+    for (uint64_t id = 0 ; success && id < header.curveCount ; id++)
+    {
+        int32_t nbCP;
+        success = fread(&nbCP, sizeof(int32_t), 1, file) == 1;
+
+        std::vector<glm::vec3> curveData(std::abs(nbCP));
+        for (size_t cpid = 0 ; success && cpid < curveData.size() ; cpid++)
+            success = fread(&curveData[cpid], sizeof(float), 3, file) == 3;
+
+        (nbCP < 0 ? closedFibersCP : openFibersCP).emplace_back(std::move(curveData));
+    }
+
+    fclose(file);
+    return success;
+}
+
+// Control points of the curves in file order, to check that both readers agree
+std::vector<glm::vec3> FlattenInFileOrder(const fs::path& filePath,
+                                          const std::vector<std::vector<glm::vec3>>& closedFibersCP,
+                                          const std::vector<std::vector<glm::vec3>>& openFibersCP)
+{
+    std::vector<glm::vec3> points;
+    size_t closed = 0, open = 0;
+    StreamBCCFile(filePath, [&](const BCCChunk& chunk) {
+        for (const auto& curve : chunk.curves)
+        {
+            const auto& fiber = curve.isClosed ? closedFibersCP[closed++] : openFibersCP[open++];
+            points.insert(points.end(), fiber.begin(), fiber.end());
+        }
+        return true;
+    });
+    return points;
+}
+
+
+bool ParseArguments(int argc, char* argv[], BenchmarkSettings& settings)
+{
+    for (int i = 1 ; i < argc ; i++)
+    {
+        const std::string option = argv[i];
+        if (i + 1 >= argc)
+        {
+            LOG_ERROR("Missing value for %s", option.c_str());
+            return false;
+        }
+        const std::string value = argv[++i];
+
+        if (option == "--directory")
+            settings.directory = value;
+        else if (option == "--repeat")
+            settings.repeatCount = std::max(1, std::stoi(value));
+        else if (option == "--output")
+            settings.output = value;
+        else
+        {
+            LOG_ERROR("Unknown option %s", option.c_str());
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+int main(int argc, char* argv[])
+{
+    BenchmarkSettings settings;
+    if (!ParseArguments(argc, argv, settings))
+        return 1;
+
+    if (!fs::is_directory(settings.directory))
+    {
+        LOG_ERROR("%s is not a directory", settings.directory.c_str());
+        return 1;
+    }
+
+    std::vector<fs::path> files = ListBCCFiles(settings.directory);
+    std::sort(files.begin(), files.end());
+
+    FILE* output = fopen(settings.output.c_str(), "w");
+    if (!output)
+    {
+        LOG_ERROR("Could not write %s", settings.output.c_str());
+        return 1;
+    }
+
+    fprintf(output, "{\n");
+    fprintf(output, "  \"repeat\": %u,\n", settings.repeatCount);
+    fprintf(output, "  \"files\": [");
+
+    bool first = true;
+    bool allMatch = true;
+    for (const auto& filePath : files)
+    {
+        std::vector<std::vector<glm::vec3>> closedFibersCP, openFibersCP;
+        auto start = Clock::now();
+        bool readable = true;
+        for (uint32_t i = 0 ; i < settings.repeatCount ; i++)
+            readable &= ReadBCCWithFread(filePath, closedFibersCP, openFibersCP);
+        const double freadTime = Seconds(start) / settings.repeatCount;
+        if (!readable)
+        {
+            LOG_WARNING("Skipping %s, it could not be read", filePath.c_str());
+            continue;
+        }
+
+        // Mapping plus one memcpy per curve into a flat buffer
+        std::vector<glm::vec3> mappedPoints;
+        start = Clock::now();
+        for (uint32_t i = 0 ; i < settings.repeatCount ; i++)
+        {
+            BCCFile file(filePath);
+            mappedPoints.resize(file.GetControlPointCount());
+            file.CopyControlPoints(mappedPoints.data());
+        }
+        const double mmapTime = Seconds(start) / settings.repeatCount;
+
+        // Same per curve vectors as the fread path, built on the mapping
+        start = Clock::now();
+        for (uint32_t i = 0 ; i < settings.repeatCount ; i++)
+            readBCC(filePath.string(), closedFibersCP, openFibersCP);
+        const double readBCCTime = Seconds(start) / settings.repeatCount;
+
+        std::vector<glm::vec3> streamedPoints;
+        start = Clock::now();
+        for (uint32_t i = 0 ; i < settings.repeatCount ; i++)
+        {
+            streamedPoints.clear();
+            StreamBCCFile(filePath, [&](const BCCChunk& chunk) {
+                for (const auto& curve : chunk.curves)
+                    streamedPoints.insert(streamedPoints.end(), curve.points, curve.points + curve.pointCount);
+                return true;
+            });
+        }
+        const double streamTime = Seconds(start) / settings.repeatCount;
+
+        // Whole loading of the fibers, the cache is neither read nor written
+        FibersData fibers;
+        start = Clock::now();
+        for (uint32_t i = 0 ; i < settings.repeatCount ; i++)
+            LoadBCCFile(filePath.string(), fibers, false);
+        const double loadTime = Seconds(start) / settings.repeatCount;
+
+        ReadBCCWithFread(filePath, closedFibersCP, openFibersCP);
+        const std::vector<glm::vec3> freadPoints = FlattenInFileOrder(filePath, closedFibersCP, openFibersCP);
+        auto samePoints = [&](const std::vector<glm::vec3>& points) {
+            return points.size() == freadPoints.size() &&
+                   std::memcmp(points.data(), freadPoints.data(), points.size() * sizeof(glm::vec3)) == 0;
+        };
+        const bool match = samePoints(mappedPoints) && samePoints(streamedPoints) && samePoints(fibers.controlPoints);
+        allMatch &= match;
+
+        const uint64_t fileSize = fs::file_size(filePath);
+        fprintf(output, "%s\n    {\"file\": \"%s\", \"bytes\": %llu, \"control_points\": %zu, "
+                        "\"fread_ms\": %.4f, \"mmap_ms\": %.4f, \"readbcc_ms\": %.4f, \"stream_ms\": %.4f, \"load_ms\": %.4f, "
+                        "\"speedup\": %.2f, \"match\": %s}",
+                first ? "" : ",", filePath.filename().c_str(), (unsigned long long)fileSize, freadPoints.size(),
+                freadTime * 1e3, mmapTime * 1e3, readBCCTime * 1e3, streamTime * 1e3, loadTime * 1e3,
+                freadTime / mmapTime, match ? "true" : "false");
+        first = false;
+
+        LOG_INFO("%s, %zu control points : fread %.3fms, mmap %.3fms (x%.1f), readBCC %.3fms, stream %.3fms, LoadBCCFile %.3fms",
+                 filePath.filename().c_str(), freadPoints.size(), freadTime * 1e3, mmapTime * 1e3, freadTime / mmapTime,
+                 readBCCTime * 1e3, streamTime * 1e3, loadTime * 1e3);
+        if (!match)
+            LOG_WARNING("The control points of %s differ between the readers", filePath.filename().c_str());
+    }
+    fprintf(output, "\n  ]\n}\n");
+
+    if (fclose(output) != 0)
+    {
+        LOG_ERROR("Could not write %s", settings.output.c_str());
+        return 1;
+    }
+
+    return allMatch ? 0 : 1;
+}
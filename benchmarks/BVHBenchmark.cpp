@@ -0,0 +1,225 @@
+// Microbenchmark of the triangle BVH on the cloth plane : build, refit to a deformed cloth and query
+// throughput of the closest points, ray casts and box overlaps, compared to the brute force search.
+// Results are written as JSON, the program fails if the closest points differ from the brute force ones.
+//
+// Usage : BVHBenchmark [--resolutions 60x40,240x160] [--queries 100000] [--threads 8] [--output results.json]
+
+#include "BenchmarkArguments.h"
+
+#include "Base/BVH.h"
+#include "Base/Logging.h"
+#include "Base/Mesh.h"
+
+#include <omp.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+
+
+using Clock = std::chrono::high_resolution_clock;
+
+struct BenchmarkSettings
+{
+    std::vector<glm::uvec2> resolutions = {{60, 40}, {240, 160}, {960, 640}};
+    uint32_t queries = 100000;
+    uint32_t maxThreads = omp_get_max_threads();
+    std::string output = "bvh_benchmark.json";
+};
+
+// Same cloth as the simulation benchmark
+static const float clothWidth = 22.0f;
+static const float clothHeight = 15.0f;
+// The brute force search is only timed on a few points, it would take minutes on the large meshes
+static const uint32_t bruteForceQueries = 1000;
+// The build and refit are repeated to get stable timings on the small meshes
+static const uint32_t repeatCount = 10;
+
+
+inline double Seconds(const Clock::time_point& start)
+{
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+// Folds of the cloth, the topology is the one of the plane so that the tree can be refitted
+void FoldPlane(std::vector<Vertex>& vertices)
+{
+    for (auto& vertex : vertices)
+        vertex.position.z += 2.0f * std::sin(0.7f * vertex.position.x) * std::cos(0.4f * vertex.position.y);
+}
+
+std::vector<glm::vec3> RandomPoints(const uint32_t& count, std::mt19937& generator)
+{
+    std::uniform_real_distribution<float> x(-0.6f * clothWidth, 0.6f * clothWidth);
+    std::uniform_real_distribution<float> y(-0.6f * clothHeight, 0.6f * clothHeight);
+    std::uniform_real_distribution<float> z(-3.0f, 3.0f);
+
+    std::vector<glm::vec3> points(count);
+    for (auto& point : points)
+        point = glm::vec3(x(generator), y(generator), z(generator));
+    return points;
+}
+
+
+bool ParseArguments(int argc, char* argv[], BenchmarkSettings& settings)
+{
+    for (int i = 1 ; i < argc ; i++)
+    {
+        const std::string option = argv[i];
+        if (i + 1 >= argc)
+        {
+            LOG_ERROR("Missing value for %s", option.c_str());
+            return false;
+        }
+        const std::string value = argv[++i];
+
+        if (option == "--resolutions")
+        {
+            if (!ParseResolutions(value, settings.resolutions))
+                return false;
+        }
+        else if (option == "--queries")
+            settings.queries = std::max(1, std::stoi(value));
+        else if (option == "--threads")
+            settings.maxThreads = std::max(1, std::stoi(value));
+        else if (option == "--output")
+            settings.output = value;
+        else
+        {
+            LOG_ERROR("Unknown option %s", option.c_str());
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+int main(int argc, char* argv[])
+{
+    BenchmarkSettings settings;
+    if (!ParseArguments(argc, argv, settings))
+        return 1;
+
+    FILE* output = fopen(settings.output.c_str(), "w");
+    if (!output)
+    {
+        LOG_ERROR("Could not write %s", settings.output.c_str());
+        return 1;
+    }
+
+    omp_set_num_threads(settings.maxThreads);
+    fprintf(output, "{\n");
+    fprintf(output, "  \"threads\": %u,\n", settings.maxThreads);
+    fprintf(output, "  \"queries\": %u,\n", settings.queries);
+    fprintf(output, "  \"meshes\": [");
+
+    std::mt19937 generator(42);
+    bool first = true;
+    bool allMatch = true;
+    for (const auto& resolution : settings.resolutions)
+    {
+        std::vector<Vertex> vertices;
+        std::vector<uint32_t> indices;
+        Mesh::BuildPlane(clothWidth, clothHeight, resolution.x, resolution.y, vertices, indices);
+        const uint32_t triangleCount = indices.size() / 3;
+
+        Mesh::BVH bvh;
+        auto start = Clock::now();
+        for (uint32_t i = 0 ; i < repeatCount ; i++)
+            bvh.Build(vertices, indices);
+        const double buildTime = Seconds(start) / repeatCount;
+
+        FoldPlane(vertices);
+        start = Clock::now();
+        for (uint32_t i = 0 ; i < repeatCount ; i++)
+            bvh.Refit(vertices, indices);
+        const double refitTime = Seconds(start) / repeatCount;
+
+        // Closest points in one batched call, then one brute force search per point as the binding used
+        // to do, both parallelized over the points so that their rates compare
+        const std::vector<glm::vec3> points = RandomPoints(settings.queries, generator);
+        std::vector<Mesh::BVH::ClosestHit> hits;
+        start = Clock::now();
+        bvh.ClosestPoints(points, hits);
+        const double closestTime = Seconds(start);
+
+        const uint32_t bruteForceCount = std::min(bruteForceQueries, settings.queries);
+        uint32_t mismatchCount = 0;
+        start = Clock::now();
+        #pragma omp parallel for schedule(dynamic, 256) reduction(+:mismatchCount) num_threads(omp_get_max_threads())
+        for (uint32_t i = 0 ; i < bruteForceCount ; i++)
+        {
+            uint32_t triangle;
+            float distance;
+            Mesh::ClosestPointOnMesh(points[i], vertices, indices, triangle, distance);
+            if (!hits[i].found || std::abs(hits[i].distance - distance) > 1e-4f * std::max(1.0f, distance))
+                mismatchCount++;
+        }
+        const double bruteForceTime = Seconds(start);
+
+        // Rays shot at the cloth from above and below
+        std::vector<glm::vec3> directions(points.size());
+        std::uniform_real_distribution<float> tilt(-0.3f, 0.3f);
+        for (size_t i = 0 ; i < points.size() ; i++)
+            directions[i] = glm::vec3(tilt(generator), tilt(generator), points[i].z > 0.0f ? -1.0f : 1.0f);
+
+        uint32_t rayHitCount = 0;
+        start = Clock::now();
+        #pragma omp parallel for reduction(+:rayHitCount) num_threads(omp_get_max_threads())
+        for (uint32_t i = 0 ; i < points.size() ; i++)
+        {
+            uint32_t triangle;
+            float distance;
+            rayHitCount += bvh.RayCast(points[i], directions[i], triangle, distance);
+        }
+        const double rayTime = Seconds(start);
+
+        // Boxes of about one cloth cell
+        const glm::vec3 halfExtent(0.5f * clothWidth / resolution.x, 0.5f * clothHeight / resolution.y, 0.5f);
+        uint64_t overlapCount = 0;
+        start = Clock::now();
+        #pragma omp parallel for reduction(+:overlapCount) num_threads(omp_get_max_threads())
+        for (uint32_t i = 0 ; i < points.size() ; i++)
+        {
+            std::vector<uint32_t> triangles;
+            bvh.Overlap({points[i] - halfExtent, points[i] + halfExtent}, triangles);
+            overlapCount += triangles.size();
+        }
+        const double overlapTime = Seconds(start);
+
+        const double closestRate = points.size() / closestTime;
+        const double bruteForceRate = bruteForceCount / bruteForceTime;
+        fprintf(output, "%s\n    {\"resolution\": [%u, %u], \"triangles\": %u, \"nodes\": %zu, "
+                        "\"build_ms\": %.4f, \"refit_ms\": %.4f, "
+                        "\"closest_points_per_second\": %.1f, \"bruteforce_points_per_second\": %.1f, \"closest_mismatches\": %u, "
+                        "\"rays_per_second\": %.1f, \"ray_hits\": %u, "
+                        "\"overlaps_per_second\": %.1f, \"overlapped_triangles\": %llu}",
+                first ? "" : ",", resolution.x, resolution.y, triangleCount, bvh.GetNodes().size(),
+                buildTime * 1e3, refitTime * 1e3,
+                closestRate, bruteForceRate, mismatchCount,
+                points.size() / rayTime, rayHitCount,
+                points.size() / overlapTime, (unsigned long long)overlapCount);
+        first = false;
+
+        LOG_INFO("%ux%u, %u triangles : build %.3fms, refit %.3fms, %.0f closest points/s (brute force %.0f/s), %.0f rays/s, %.0f overlaps/s",
+                 resolution.x, resolution.y, triangleCount, buildTime * 1e3, refitTime * 1e3,
+                 closestRate, bruteForceRate, points.size() / rayTime, points.size() / overlapTime);
+        allMatch &= mismatchCount == 0;
+        if (mismatchCount > 0)
+            LOG_WARNING("%u closest points differ from the brute force search", mismatchCount);
+    }
+    fprintf(output, "\n  ]\n}\n");
+
+    if (fclose(output) != 0)
+    {
+        LOG_ERROR("Could not write %s", settings.output.c_str());
+        return 1;
+    }
+
+    return allMatch ? 0 : 1;
+}
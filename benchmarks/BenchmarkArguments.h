@@ -0,0 +1,44 @@
+#ifndef BENCHMARKARGUMENTS_H
+#define BENCHMARKARGUMENTS_H
+
+#include "Base/Logging.h"
+
+#include <glm/glm.hpp>
+
+#include <cstdio>
+#include <sstream>
+#include <string>
+#include <vector>
+
+
+// Items of a comma separated option value
+inline std::vector<std::string> SplitArgument(const std::string& value)
+{
+    std::vector<std::string> items;
+    std::stringstream stream(value);
+    for (std::string item ; std::getline(stream, item, ',') ; )
+        items.push_back(item);
+    return items;
+}
+
+
+// Cloth resolutions given as WxH separated by commas, with at least 2 divisions on each side
+inline bool ParseResolutions(const std::string& value, std::vector<glm::uvec2>& resolutions)
+{
+    resolutions.clear();
+    for (const auto& item : SplitArgument(value))
+    {
+        glm::uvec2 resolution;
+        if (sscanf(item.c_str(), "%ux%u", &resolution.x, &resolution.y) != 2 || resolution.x < 2 || resolution.y < 2)
+        {
+            LOG_ERROR("Invalid resolution %s, expected WxH with at least 2 divisions", item.c_str());
+            return false;
+        }
+        resolutions.push_back(resolution);
+    }
+
+    return true;
+}
+
+
+#endif  // BENCHMARKARGUMENTS_H
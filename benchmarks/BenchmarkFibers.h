@@ -0,0 +1,46 @@
+#ifndef BENCHMARKFIBERS_H
+#define BENCHMARKFIBERS_H
+
+#include "WrapDeformer.h"
+
+#include "Base/Mesh.h"
+
+#include <random>
+#include <vector>
+
+
+// Points scattered around the cloth triangles, standing for the fibers control points. The points
+// of each triangle make an open curve for the smoothing.
+inline std::vector<glm::vec3> ScatterFibers(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices, const uint32_t& perTriangle,
+                                            std::vector<FiberCurve>& curves)
+{
+    std::mt19937 generator(42);
+    std::uniform_real_distribution<float> distribution(0.0f, 1.0f);
+
+    std::vector<glm::vec3> points;
+    points.reserve(indices.size() / 3 * perTriangle);
+    curves.clear();
+    for (size_t i = 0 ; i < indices.size() ; i += 3)
+    {
+        curves.push_back({uint32_t(points.size()), perTriangle, 0});
+
+        const glm::vec3& a = vertices[indices[i]].position;
+        const glm::vec3& b = vertices[indices[i + 1]].position;
+        const glm::vec3& c = vertices[indices[i + 2]].position;
+        const glm::vec3 normal = glm::normalize(glm::cross(b - a, c - a));
+        for (uint32_t j = 0 ; j < perTriangle ; j++)
+        {
+            float u = distribution(generator), v = distribution(generator);
+            if (u + v > 1.0f)
+            {
+                u = 1.0f - u;
+                v = 1.0f - v;
+            }
+            points.push_back(a + u * (b - a) + v * (c - a) + (distribution(generator) - 0.5f) * 0.1f * normal);
+        }
+    }
+    return points;
+}
+
+
+#endif  // BENCHMARKFIBERS_H
@@ -0,0 +1,260 @@
+// Headless check of the GPU wrap deformation against the CPU deformer. A surfaceless EGL context is
+// created so that it runs without any window, on Mesa's software rasterizer when there is no GPU.
+// Fibers are scattered around the cloth and bound to it, then both deformers deform them against
+// a waved cloth. Distances and times are written as JSON, the program fails if the maximum distance
+// between both deformations goes above the tolerance.
+//
+// Usage : GpuWrapBenchmark [--resolutions 60x40,120x80] [--fibers 4] [--iterations 0,3] [--tolerance 1e-3]
+//                          [--output results.json]
+//
+//         LIBGL_ALWAYS_SOFTWARE=1 GpuWrapBenchmark to force llvmpipe
+
+#include "BenchmarkArguments.h"
+#include "BenchmarkFibers.h"
+#include "GpuWrapDeformer.h"
+#include "WrapDeformer.h"
+
+#include "Base/Logging.h"
+#include "Base/Mesh.h"
+#include "Base/Resolver.h"
+
+#include <glad/glad.h>
+
+#define EGL_NO_X11
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+
+struct BenchmarkSettings
+{
+    std::vector<glm::uvec2> resolutions = {{60, 40}, {120, 80}};
+    uint32_t fibersPerTriangle = 4;
+    std::vector<uint32_t> smoothIterations = {0, 3};
+    float tolerance = 1e-3f;
+    std::string output = "gpu_wrap_benchmark.json";
+};
+
+// Cloth of the application
+static const float clothWidth = 22.0f;
+static const float clothHeight = 15.0f;
+
+
+// OpenGL 4.1 core context on a surfaceless display, made current on the calling thread. The passes
+// discard the rasterization but drawing still needs a complete framebuffer, a 1x1 pbuffer provides it.
+class HeadlessContext
+{
+public:
+    HeadlessContext()
+    {
+        m_display = eglGetPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+        if (m_display == EGL_NO_DISPLAY || !eglInitialize(m_display, nullptr, nullptr))
+        {
+            LOG_ERROR("Could not initialize a surfaceless EGL display");
+            return;
+        }
+
+        const EGLint configAttributes[] = {EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_SURFACE_TYPE, EGL_PBUFFER_BIT, EGL_NONE};
+        EGLConfig config;
+        EGLint configCount = 0;
+        if (!eglBindAPI(EGL_OPENGL_API) || !eglChooseConfig(m_display, configAttributes, &config, 1, &configCount) || configCount == 0)
+        {
+            LOG_ERROR("No EGL config supports OpenGL");
+            return;
+        }
+
+        const EGLint contextAttributes[] = {EGL_CONTEXT_MAJOR_VERSION, 4,
+                                            EGL_CONTEXT_MINOR_VERSION, 1,
+                                            EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+                                            EGL_NONE};
+        const EGLint surfaceAttributes[] = {EGL_WIDTH, 1, EGL_HEIGHT, 1, EGL_NONE};
+        m_surface = eglCreatePbufferSurface(m_display, config, surfaceAttributes);
+        m_context = eglCreateContext(m_display, config, EGL_NO_CONTEXT, contextAttributes);
+        if (m_surface == EGL_NO_SURFACE || m_context == EGL_NO_CONTEXT || !eglMakeCurrent(m_display, m_surface, m_surface, m_context))
+        {
+            LOG_ERROR("Could not create an OpenGL 4.1 core context");
+            return;
+        }
+
+        if (!gladLoadGLLoader((GLADloadproc)eglGetProcAddress))
+        {
+            LOG_ERROR("Could not load the OpenGL functions");
+            return;
+        }
+
+        m_valid = true;
+    }
+
+    ~HeadlessContext()
+    {
+        if (m_display == EGL_NO_DISPLAY)
+            return;
+
+        eglMakeCurrent(m_display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+        if (m_context != EGL_NO_CONTEXT)
+            eglDestroyContext(m_display, m_context);
+        if (m_surface != EGL_NO_SURFACE)
+            eglDestroySurface(m_display, m_surface);
+        eglTerminate(m_display);
+    }
+
+    HeadlessContext(const HeadlessContext&) = delete;
+    HeadlessContext& operator=(const HeadlessContext&) = delete;
+
+    inline bool IsValid() const { return m_valid; }
+
+private:
+    EGLDisplay m_display = EGL_NO_DISPLAY;
+    EGLSurface m_surface = EGL_NO_SURFACE;
+    EGLContext m_context = EGL_NO_CONTEXT;
+    bool m_valid = false;
+};
+
+
+// Wave across the cloth so that its triangles move, tilt and stretch away from the rest plane
+void WaveCloth(std::vector<Vertex>& vertices)
+{
+    for (auto& vertex : vertices)
+    {
+        glm::vec3& position = vertex.position;
+        position = {position.x * 0.9f,
+                    position.y + 1.5f * std::sin(0.4f * position.x) * std::cos(0.3f * position.z),
+                    position.z + 0.5f * std::sin(0.2f * position.x)};
+    }
+}
+
+
+bool ParseArguments(int argc, char* argv[], BenchmarkSettings& settings)
+{
+    for (int i = 1 ; i < argc ; i++)
+    {
+        const std::string option = argv[i];
+        if (i + 1 >= argc)
+        {
+            LOG_ERROR("Missing value for %s", option.c_str());
+            return false;
+        }
+        const std::string value = argv[++i];
+
+        if (option == "--resolutions")
+        {
+            if (!ParseResolutions(value, settings.resolutions))
+                return false;
+        }
+        else if (option == "--fibers")
+            settings.fibersPerTriangle = std::max(1, std::stoi(value));
+        else if (option == "--iterations")
+        {
+            settings.smoothIterations.clear();
+            for (const auto& item : SplitArgument(value))
+                settings.smoothIterations.push_back(std::max(0, std::stoi(item)));
+        }
+        else if (option == "--tolerance")
+            settings.tolerance = std::stof(value);
+        else if (option == "--output")
+            settings.output = value;
+        else
+        {
+            LOG_ERROR("Unknown option %s", option.c_str());
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+int main(int argc, char* argv[])
+{
+    BenchmarkSettings settings;
+    if (!ParseArguments(argc, argv, settings))
+        return 1;
+
+    // The shaders are resolved from the root of the repository, as in the application
+    Resolver::Init(fs::weakly_canonical(argv[0]).parent_path().parent_path());
+
+    HeadlessContext context;
+    if (!context.IsValid())
+        return 1;
+    LOG_INFO("Running on %s, OpenGL %s", glGetString(GL_RENDERER), glGetString(GL_VERSION));
+
+    FILE* output = fopen(settings.output.c_str(), "w");
+    if (!output)
+    {
+        LOG_ERROR("Could not write %s", settings.output.c_str());
+        return 1;
+    }
+
+    fprintf(output, "{\n");
+    fprintf(output, "  \"renderer\": \"%s\",\n", glGetString(GL_RENDERER));
+    fprintf(output, "  \"tolerance\": %g,\n", settings.tolerance);
+    fprintf(output, "  \"comparisons\": [");
+
+    bool first = true;
+    bool allMatch = true;
+    for (const auto& resolution : settings.resolutions)
+    {
+        std::vector<Vertex> vertices;
+        std::vector<uint32_t> indices;
+        Mesh::BuildPlane(clothWidth, clothHeight, resolution.x, resolution.y, vertices, indices);
+        std::vector<FiberCurve> curves;
+        const std::vector<glm::vec3> fibers = ScatterFibers(vertices, indices, settings.fibersPerTriangle, curves);
+
+        WrapDeformer wrap;
+        wrap.Initialize(fibers, vertices, indices);
+        wrap.SetCurves(curves);
+        WaveCloth(vertices);
+
+        // The fibers are drawn as lines in the application, the indices only need to exist here
+        std::vector<uint32_t> fibersIndices(fibers.size());
+        for (uint32_t i = 0 ; i < fibersIndices.size() ; i++)
+            fibersIndices[i] = i;
+        IndexBufferPtr fibersIndexBuffer = IndexBuffer::Create(fibersIndices.data(), fibersIndices.size());
+
+        GpuWrapDeformer gpuWrap;
+        if (!gpuWrap.Upload(wrap, indices, fibersIndexBuffer))
+        {
+            LOG_ERROR("Could not upload the bindings to the GPU");
+            fclose(output);
+            return 1;
+        }
+
+        for (const auto& iterations : settings.smoothIterations)
+        {
+            wrap.SetSmoothIterations(iterations);
+            // The first deformation allocates the cloth positions buffer, only the second one is timed
+            CompareWrapDeformers(gpuWrap, wrap, fibers, vertices, indices);
+            const WrapComparison comparison = CompareWrapDeformers(gpuWrap, wrap, fibers, vertices, indices);
+
+            const bool match = std::isfinite(comparison.maxError) && comparison.maxError <= settings.tolerance;
+            allMatch &= match;
+
+            fprintf(output, "%s\n    {\"resolution\": [%u, %u], \"fiber_points\": %zu, \"smooth_iterations\": %u, "
+                            "\"max_error\": %g, \"mean_error\": %g, \"cpu_ms\": %.4f, \"gpu_ms\": %.4f, \"match\": %s}",
+                    first ? "" : ",", resolution.x, resolution.y, fibers.size(), iterations,
+                    comparison.maxError, comparison.meanError, comparison.cpuTime * 1e3, comparison.gpuTime * 1e3,
+                    match ? "true" : "false");
+            first = false;
+
+            LOG_INFO("%ux%u, %zu points, %u smoothing iterations : max error %g, mean error %g, CPU %.3fms, GPU %.3fms",
+                     resolution.x, resolution.y, fibers.size(), iterations, comparison.maxError, comparison.meanError,
+                     comparison.cpuTime * 1e3, comparison.gpuTime * 1e3);
+            if (!match)
+                LOG_WARNING("The GPU deformation differs from the CPU one by more than %g", settings.tolerance);
+        }
+    }
+    fprintf(output, "\n  ]\n}\n");
+
+    if (fclose(output) != 0)
+    {
+        LOG_ERROR("Could not write %s", settings.output.c_str());
+        return 1;
+    }
+
+    return allMatch ? 0 : 1;
+}
@@ -0,0 +1,387 @@
+// Headless benchmark of the cloth simulation and of the fibers deformation, without any window or
+// OpenGL context so that it runs on CPU-only machines. Results are written as JSON.
+//
+// Usage : SimulationBenchmark [--resolutions 30x20,60x40] [--steps 200] [--threads 8]
+//                             [--solvers xpbd,implicit] [--fibers 4] [--obstacle mesh.obj] [--output results.json]
+//
+// With --check-determinism, every solver instead runs the same cloth on one thread and on all the
+// threads, and the program fails if the positions are not bitwise identical.
+//
+// With --replay file.replay, the recorded steps are run instead (or --steps of them when given) and the
+// steps per second are written, the program fails if a full replay diverges from its recording.
+
+#include "BenchmarkArguments.h"
+#include "BenchmarkFibers.h"
+#include "SimulationEngine.h"
+#include "SimulationReplay.h"
+#include "WrapDeformer.h"
+
+#include "Base/Logging.h"
+#include "Base/Mesh.h"
+#include "Base/objReader.h"
+
+#include <omp.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <string>
+#include <vector>
+
+
+using Clock = std::chrono::high_resolution_clock;
+
+struct BenchmarkSolver
+{
+    const char* name;
+    SolverFn solver;
+};
+
+// Same order as the solver combo of the application
+static const BenchmarkSolver benchmarkSolvers[] = {{"mass-spring", massSpringSolver},
+                                                   {"mass-spring-gravity", massSpringGravitySolver},
+                                                   {"mass-spring-gravity-wind", massSpringGravityWindSolver},
+                                                   {"xpbd", xpbdSolver},
+                                                   {"implicit", massSpringImplicitSolver}};
+
+struct BenchmarkSettings
+{
+    std::vector<glm::uvec2> resolutions = {{30, 20}, {60, 40}, {120, 80}};
+    uint32_t steps = 200;
+    uint32_t maxThreads = omp_get_max_threads();
+    std::vector<BenchmarkSolver> solvers = {std::begin(benchmarkSolvers), std::end(benchmarkSolvers)};
+    uint32_t fibersPerTriangle = 4;
+    std::string output = "simulation_benchmark.json";
+    bool checkDeterminism = false;
+
+    fs::path obstacle;  // OBJ mesh the cloth collides with, none when empty
+    std::shared_ptr<const SignedDistanceField> obstacleField;
+
+    fs::path replay;
+    uint32_t replaySteps = 0;  // 0 for the recorded count
+};
+
+// Cloth of the application : 22x15 plane simulated at 100 steps per second
+static const float clothWidth = 22.0f;
+static const float clothHeight = 15.0f;
+static const float fe = 100.0f;
+// Same obstacle placement as the application
+static const glm::vec3 obstaclePosition = {0.0f, -3.0f, 3.5f};
+static const float obstacleSpacing = 0.1f;
+static const float obstacleOffset = 0.1f;
+
+
+inline double Seconds(const Clock::time_point& start)
+{
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+// 1, 2, 4... up to the max thread count, which is always included
+std::vector<uint32_t> ThreadCounts(const uint32_t& maxThreads)
+{
+    std::vector<uint32_t> counts;
+    for (uint32_t count = 1 ; count < maxThreads ; count *= 2)
+        counts.push_back(count);
+    counts.push_back(maxThreads);
+    return counts;
+}
+
+void InitCloth(SimulationEngine& engine, const std::vector<Vertex>& vertices, const glm::uvec2& resolution, const BenchmarkSettings& settings)
+{
+    InitClothFromMesh(engine, vertices, resolution.x, resolution.y, fe);
+    if (settings.obstacleField)
+        engine.obstacles.push_back(MeshObstacle(settings.obstacleField, obstaclePosition, glm::mat3(1.0f), obstacleOffset, ObstacleStiffness(fe)));
+}
+
+
+bool ParseArguments(int argc, char* argv[], BenchmarkSettings& settings)
+{
+    for (int i = 1 ; i < argc ; i++)
+    {
+        const std::string option = argv[i];
+        if (option == "--check-determinism")
+        {
+            settings.checkDeterminism = true;
+            continue;
+        }
+
+        if (i + 1 >= argc)
+        {
+            LOG_ERROR("Missing value for %s", option.c_str());
+            return false;
+        }
+        const std::string value = argv[++i];
+
+        if (option == "--resolutions")
+        {
+            if (!ParseResolutions(value, settings.resolutions))
+                return false;
+        }
+        else if (option == "--steps")
+            settings.steps = settings.replaySteps = std::max(1, std::stoi(value));
+        else if (option == "--threads")
+            settings.maxThreads = std::max(1, std::stoi(value));
+        else if (option == "--fibers")
+            settings.fibersPerTriangle = std::max(0, std::stoi(value));
+        else if (option == "--output")
+            settings.output = value;
+        else if (option == "--obstacle")
+            settings.obstacle = value;
+        else if (option == "--replay")
+            settings.replay = value;
+        else if (option == "--solvers")
+        {
+            settings.solvers.clear();
+            for (const auto& item : SplitArgument(value))
+            {
+                auto found = std::find_if(std::begin(benchmarkSolvers), std::end(benchmarkSolvers),
+                                          [&](const BenchmarkSolver& solver) { return item == solver.name; });
+                if (found == std::end(benchmarkSolvers))
+                {
+                    LOG_ERROR("Unknown solver %s", item.c_str());
+                    return false;
+                }
+                settings.solvers.push_back(*found);
+            }
+        }
+        else
+        {
+            LOG_ERROR("Unknown option %s", option.c_str());
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+// Run the same cloth on one thread and on the max thread count, the color groups of the links must
+// give the same positions to the bit whatever the number of threads
+bool CheckDeterminism(const BenchmarkSettings& settings)
+{
+    // The time budget of the implicit solver would stop its iterations at a different point on every run
+    getImplicitSettings().timeBudget = std::numeric_limits<float>::max();
+
+    bool deterministic = true;
+    for (const auto& resolution : settings.resolutions)
+    for (const auto& solver : settings.solvers)
+    {
+        std::vector<Vertex> vertices;
+        std::vector<uint32_t> indices;
+        Mesh::BuildPlane(clothWidth, clothHeight, resolution.x, resolution.y, vertices, indices);
+
+        std::vector<glm::vec3> positions[2];
+        const uint32_t threadCounts[2] = {1, settings.maxThreads};
+        for (int run = 0 ; run < 2 ; run++)
+        {
+            omp_set_num_threads(threadCounts[run]);
+
+            SimulationEngine engine;
+            InitCloth(engine, vertices, resolution, settings);
+            for (uint32_t step = 0 ; step < settings.steps ; step++)
+                solver.solver(engine, 1.0 / fe);
+            positions[run] = engine.positions;
+        }
+
+        const bool match = positions[0].size() == positions[1].size() &&
+                           std::memcmp(positions[0].data(), positions[1].data(), positions[0].size() * sizeof(glm::vec3)) == 0;
+        if (match)
+            LOG_INFO("%ux%u %s : 1 and %u threads give the same positions after %u steps",
+                     resolution.x, resolution.y, solver.name, settings.maxThreads, settings.steps);
+        else
+        {
+            uint32_t differences = 0;
+            for (size_t i = 0 ; i < std::min(positions[0].size(), positions[1].size()) ; i++)
+                differences += std::memcmp(&positions[0][i], &positions[1][i], sizeof(glm::vec3)) != 0;
+            LOG_ERROR("%ux%u %s : %u particles differ between 1 and %u threads after %u steps",
+                      resolution.x, resolution.y, solver.name, differences, settings.maxThreads, settings.steps);
+        }
+        deterministic &= match;
+    }
+
+    return deterministic;
+}
+
+
+// Steps of a recorded replay on its own engine, the obstacles and settings are the recorded ones
+bool BenchmarkReplay(const BenchmarkSettings& settings)
+{
+    omp_set_num_threads(settings.maxThreads);
+
+    SimulationEngine engine;
+    ReplayResult result;
+    if (!RunReplay(settings.replay, engine, settings.replaySteps, result))
+        return false;
+
+    FILE* output = fopen(settings.output.c_str(), "w");
+    if (!output)
+    {
+        LOG_ERROR("Could not write %s", settings.output.c_str());
+        return false;
+    }
+
+    fprintf(output, "{\n");
+    fprintf(output, "  \"replay\": \"%s\",\n", settings.replay.filename().c_str());
+    fprintf(output, "  \"kernels\": \"%s\",\n", GetSimulationKernels().name);
+    fprintf(output, "  \"threads\": %u,\n", settings.maxThreads);
+    fprintf(output, "  \"particles\": %u,\n", engine.GetParticleCount());
+    fprintf(output, "  \"steps\": %llu,\n", (unsigned long long)result.stepCount);
+    fprintf(output, "  \"seconds\": %.6f,\n", result.duration);
+    fprintf(output, "  \"steps_per_second\": %.3f,\n", result.stepsPerSecond);
+    fprintf(output, "  \"checked\": %s,\n", result.checked ? "true" : "false");
+    fprintf(output, "  \"matches_recording\": %s\n", result.matchesRecording ? "true" : "false");
+    fprintf(output, "}\n");
+
+    if (fclose(output) != 0)
+    {
+        LOG_ERROR("Could not write %s", settings.output.c_str());
+        return false;
+    }
+
+    return !result.checked || result.matchesRecording;
+}
+
+
+int main(int argc, char* argv[])
+{
+    BenchmarkSettings settings;
+    if (!ParseArguments(argc, argv, settings))
+        return 1;
+
+    if (!settings.obstacle.empty())
+    {
+        auto field = std::make_shared<SignedDistanceField>();
+        if (!LoadOBJSignedDistanceField(settings.obstacle, obstacleSpacing, *field))
+            return 1;
+        settings.obstacleField = field;
+    }
+
+    if (settings.checkDeterminism)
+        return CheckDeterminism(settings) ? 0 : 1;
+
+    if (!settings.replay.empty())
+        return BenchmarkReplay(settings) ? 0 : 1;
+
+    FILE* output = fopen(settings.output.c_str(), "w");
+    if (!output)
+    {
+        LOG_ERROR("Could not write %s", settings.output.c_str());
+        return 1;
+    }
+
+    fprintf(output, "{\n");
+    fprintf(output, "  \"kernels\": \"%s\",\n", GetSimulationKernels().name);
+    fprintf(output, "  \"max_threads\": %u,\n", settings.maxThreads);
+    fprintf(output, "  \"steps\": %u,\n", settings.steps);
+    fprintf(output, "  \"obstacle\": \"%s\",\n", settings.obstacle.filename().c_str());
+
+    // Simulation steps of each solver
+    const std::vector<uint32_t> threadCounts = ThreadCounts(settings.maxThreads);
+    fprintf(output, "  \"solvers\": [");
+    bool first = true;
+    for (const auto& resolution : settings.resolutions)
+    for (const auto& solver : settings.solvers)
+    for (const auto& threads : threadCounts)
+    {
+        omp_set_num_threads(threads);
+
+        std::vector<Vertex> vertices;
+        std::vector<uint32_t> indices;
+        Mesh::BuildPlane(clothWidth, clothHeight, resolution.x, resolution.y, vertices, indices);
+
+        SimulationEngine engine;
+        InitCloth(engine, vertices, resolution, settings);
+
+        auto start = Clock::now();
+        for (uint32_t step = 0 ; step < settings.steps ; step++)
+            solver.solver(engine, 1.0 / fe);
+        const double duration = Seconds(start);
+
+        const double nsPerParticleStep = duration * 1e9 / (double(settings.steps) * engine.GetParticleCount());
+        fprintf(output, "%s\n    {\"resolution\": [%u, %u], \"particles\": %u, \"links\": %u, \"solver\": \"%s\", "
+                        "\"threads\": %u, \"seconds\": %.6f, \"steps_per_second\": %.3f, \"ns_per_particle_step\": %.3f}",
+                first ? "" : ",", resolution.x, resolution.y, engine.GetParticleCount(), engine.GetLinkCount(),
+                solver.name, threads, duration, settings.steps / duration, nsPerParticleStep);
+        first = false;
+
+        LOG_INFO("%ux%u %s, %u threads : %.1f ns/particle/step", resolution.x, resolution.y, solver.name, threads, nsPerParticleStep);
+    }
+    fprintf(output, "\n  ],\n");
+
+    // Wrap deformation of the fibers and normals generation of the cloth, once per frame in the application
+    fprintf(output, "  \"deformation\": [");
+    first = true;
+    for (const auto& resolution : settings.resolutions)
+    {
+        std::vector<Vertex> vertices;
+        std::vector<uint32_t> indices;
+        Mesh::BuildPlane(clothWidth, clothHeight, resolution.x, resolution.y, vertices, indices);
+        std::vector<FiberCurve> curves;
+        std::vector<glm::vec3> fibers = ScatterFibers(vertices, indices, settings.fibersPerTriangle, curves);
+
+        omp_set_num_threads(settings.maxThreads);
+        WrapDeformer wrap;
+        wrap.SetUseBVH(false);
+        auto start = Clock::now();
+        wrap.Initialize(fibers, vertices, indices);
+        const double bruteForceBindTime = Seconds(start);
+
+        wrap.SetUseBVH(true);
+        start = Clock::now();
+        wrap.Initialize(fibers, vertices, indices);
+        const double bindTime = Seconds(start);
+
+        // Warm start from the bindings cache, written by a first cold run
+        const fs::path cachePath = fs::temp_directory_path() / ("simulation_benchmark" WRAP_CACHE_EXTENSION);
+        std::error_code error;
+        fs::remove(cachePath, error);
+        wrap.InitializeCached(cachePath, 0, fibers, vertices, indices);
+        start = Clock::now();
+        wrap.InitializeCached(cachePath, 0, fibers, vertices, indices);
+        const double cachedBindTime = Seconds(start);
+        fs::remove(cachePath, error);
+        wrap.SetCurves(curves);
+
+        // Deform against a settled cloth so that the smoothing has non null deltas to work on
+        SimulationEngine engine;
+        InitCloth(engine, vertices, resolution, settings);
+        for (uint32_t step = 0 ; step < settings.steps ; step++)
+            xpbdSolver(engine, 1.0 / fe);
+        for (uint32_t i = 0 ; i < engine.GetParticleCount() ; i++)
+            vertices[i].position = engine.positions[i];
+
+        for (const auto& threads : threadCounts)
+        {
+            omp_set_num_threads(threads);
+
+            start = Clock::now();
+            for (uint32_t step = 0 ; step < settings.steps ; step++)
+                wrap.Deform(fibers, vertices, indices);
+            const double deformTime = Seconds(start) / settings.steps;
+
+            start = Clock::now();
+            for (uint32_t step = 0 ; step < settings.steps ; step++)
+                Mesh::GenerateNormals(vertices, indices);
+            const double normalsTime = Seconds(start) / settings.steps;
+
+            fprintf(output, "%s\n    {\"resolution\": [%u, %u], \"fiber_points\": %zu, \"threads\": %u, "
+                            "\"bind_ms\": %.3f, \"bind_bruteforce_ms\": %.3f, \"bind_cached_ms\": %.3f, \"deform_ms\": %.4f, \"normals_ms\": %.4f}",
+                    first ? "" : ",", resolution.x, resolution.y, fibers.size(), threads,
+                    bindTime * 1e3, bruteForceBindTime * 1e3, cachedBindTime * 1e3, deformTime * 1e3, normalsTime * 1e3);
+            first = false;
+
+            LOG_INFO("%ux%u, %u threads : deform %.3fms, normals %.3fms", resolution.x, resolution.y, threads, deformTime * 1e3, normalsTime * 1e3);
+        }
+    }
+    fprintf(output, "\n  ]\n}\n");
+
+    if (fclose(output) != 0)
+    {
+        LOG_ERROR("Could not write %s", settings.output.c_str());
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,420 @@
+#include "BVH.h"
+
+#include <omp.h>
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+
+namespace Mesh {
+
+
+static const uint32_t bvhBinCount = 16;
+static const uint32_t bvhMaxLeafSize = 8;
+// Deeper nodes are left as leaves so that the traversal stacks have a fixed size
+static const uint32_t bvhMaxDepth = 60;
+
+
+inline float SurfaceArea(const BoundingBox& bounds)
+{
+    if (bounds.IsEmpty())
+        return 0.0f;
+
+    glm::vec3 extent = bounds.max - bounds.min;
+    return 2.0f * (extent.x * extent.y + extent.y * extent.z + extent.z * extent.x);
+}
+
+inline float SquaredDistance(const BoundingBox& bounds, const glm::vec3& point)
+{
+    glm::vec3 offset = glm::max(glm::max(bounds.min - point, point - bounds.max), glm::vec3(0.0f));
+    return glm::dot(offset, offset);
+}
+
+inline bool Overlaps(const BoundingBox& a, const BoundingBox& b)
+{
+    return glm::all(glm::lessThanEqual(a.min, b.max)) && glm::all(glm::lessThanEqual(b.min, a.max));
+}
+
+// Entry distance of the ray in the box or infinity if it misses it, slab test with the inverse direction
+inline float RayEntry(const BoundingBox& bounds, const glm::vec3& origin, const glm::vec3& inverseDirection, const float& maxDistance)
+{
+    const glm::vec3 t1 = (bounds.min - origin) * inverseDirection;
+    const glm::vec3 t2 = (bounds.max - origin) * inverseDirection;
+    const glm::vec3 tMin = glm::min(t1, t2), tMax = glm::max(t1, t2);
+    const float entry = std::max(std::max(tMin.x, tMin.y), std::max(tMin.z, 0.0f));
+    const float exit = std::min(std::min(tMax.x, tMax.y), std::min(tMax.z, maxDistance));
+    return entry <= exit ? entry : std::numeric_limits<float>::infinity();
+}
+
+// Möller-Trumbore intersection, returns the distance along the ray or infinity
+inline float RayTriangle(const glm::vec3& origin, const glm::vec3& direction, const glm::vec3& a, const glm::vec3& b, const glm::vec3& c)
+{
+    const glm::vec3 edge1 = b - a, edge2 = c - a;
+    const glm::vec3 p = glm::cross(direction, edge2);
+    const float determinant = glm::dot(edge1, p);
+    if (std::abs(determinant) < 1e-12f)
+        return std::numeric_limits<float>::infinity();
+
+    const float inverseDeterminant = 1.0f / determinant;
+    const glm::vec3 s = origin - a;
+    const float u = glm::dot(s, p) * inverseDeterminant;
+    if (u < 0.0f || u > 1.0f)
+        return std::numeric_limits<float>::infinity();
+
+    const glm::vec3 q = glm::cross(s, edge1);
+    const float v = glm::dot(direction, q) * inverseDeterminant;
+    if (v < 0.0f || u + v > 1.0f)
+        return std::numeric_limits<float>::infinity();
+
+    const float t = glm::dot(edge2, q) * inverseDeterminant;
+    return t >= 0.0f ? t : std::numeric_limits<float>::infinity();
+}
+
+
+void BVH::Build(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices)
+{
+    const uint32_t triangleCount = indices.size() / 3;
+    m_nodes.clear();
+    m_triangles.resize(triangleCount);
+    m_corners.resize(3 * size_t(triangleCount));
+    if (triangleCount == 0)
+        return;
+
+    std::vector<glm::vec3> centroids(triangleCount);
+    std::vector<BoundingBox> bounds(triangleCount);
+
+    #pragma omp parallel for num_threads(omp_get_max_threads())
+    for (uint32_t i = 0 ; i < triangleCount ; i++) {
+        for (uint32_t j = 0 ; j < 3 ; j++)
+            bounds[i].Expand(vertices[indices[3 * i + j]].position);
+        centroids[i] = 0.5f * (bounds[i].min + bounds[i].max);
+        m_triangles[i] = i;
+    }
+
+    BoundingBox rootBounds;
+    for (const auto& triangleBounds : bounds)
+        rootBounds.Expand(triangleBounds);
+
+    m_nodes.reserve(2 * triangleCount);
+    m_nodes.push_back({rootBounds, 0, triangleCount});
+
+    std::vector<glm::uvec2> stack = {{0, 0}};  // Node and depth
+    while (!stack.empty())
+    {
+        const glm::uvec2 entry = stack.back();
+        stack.pop_back();
+        if (entry.y >= bvhMaxDepth)
+            continue;
+
+        const uint32_t left = Split(entry.x, centroids, bounds);
+        if (left == 0)
+            continue;
+
+        stack.push_back({left, entry.y + 1});
+        stack.push_back({left + 1, entry.y + 1});
+    }
+
+    #pragma omp parallel for num_threads(omp_get_max_threads())
+    for (uint32_t i = 0 ; i < triangleCount ; i++) {
+        for (uint32_t j = 0 ; j < 3 ; j++)
+            m_corners[3 * i + j] = vertices[indices[3 * m_triangles[i] + j]].position;
+    }
+}
+
+
+bool BVH::Refit(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices)
+{
+    if (indices.size() / 3 != m_triangles.size())
+        return false;
+
+    const uint32_t triangleCount = m_triangles.size();
+    #pragma omp parallel for num_threads(omp_get_max_threads())
+    for (uint32_t i = 0 ; i < triangleCount ; i++) {
+        for (uint32_t j = 0 ; j < 3 ; j++)
+            m_corners[3 * i + j] = vertices[indices[3 * m_triangles[i] + j]].position;
+    }
+
+    // The children are always stored after their parent, so a reverse sweep updates them first
+    for (size_t i = m_nodes.size() ; i-- > 0 ; )
+    {
+        Node& node = m_nodes[i];
+        node.bounds = BoundingBox();
+        if (node.count > 0)
+        {
+            for (uint32_t j = 3 * node.first ; j < 3 * (node.first + node.count) ; j++)
+                node.bounds.Expand(m_corners[j]);
+        }
+        else
+        {
+            node.bounds.Expand(m_nodes[node.first].bounds);
+            node.bounds.Expand(m_nodes[node.first + 1].bounds);
+        }
+    }
+
+    return true;
+}
+
+
+// Split a leaf along the best bin boundary of the three axes, returns the index of its left child
+// or 0 if the node stays a leaf
+uint32_t BVH::Split(const uint32_t& nodeIndex, const std::vector<glm::vec3>& centroids, const std::vector<BoundingBox>& bounds)
+{
+    const Node node = m_nodes[nodeIndex];
+    if (node.count <= 2)
+        return 0;
+
+    BoundingBox centroidBounds;
+    for (uint32_t i = node.first ; i < node.first + node.count ; i++)
+        centroidBounds.Expand(centroids[m_triangles[i]]);
+
+    float bestCost = std::numeric_limits<float>::max();
+    uint32_t bestAxis = 0, bestSplit = 0;
+    for (uint32_t axis = 0 ; axis < 3 ; axis++)
+    {
+        const float extent = centroidBounds.max[axis] - centroidBounds.min[axis];
+        if (extent <= 0.0f)
+            continue;
+
+        uint32_t binCounts[bvhBinCount] = {};
+        BoundingBox binBounds[bvhBinCount];
+        const float scale = bvhBinCount / extent;
+        for (uint32_t i = node.first ; i < node.first + node.count ; i++)
+        {
+            const uint32_t triangle = m_triangles[i];
+            uint32_t bin = std::min(bvhBinCount - 1, uint32_t((centroids[triangle][axis] - centroidBounds.min[axis]) * scale));
+            binCounts[bin]++;
+            binBounds[bin].Expand(bounds[triangle]);
+        }
+
+        // Areas of the bins left of each boundary, then swept from the right to evaluate the cost
+        float leftAreas[bvhBinCount - 1];
+        uint32_t leftCounts[bvhBinCount - 1];
+        BoundingBox sweep;
+        uint32_t count = 0;
+        for (uint32_t i = 0 ; i < bvhBinCount - 1 ; i++)
+        {
+            sweep.Expand(binBounds[i]);
+            count += binCounts[i];
+            leftAreas[i] = SurfaceArea(sweep);
+            leftCounts[i] = count;
+        }
+
+        sweep = BoundingBox();
+        count = 0;
+        for (uint32_t i = bvhBinCount - 1 ; i > 0 ; i--)
+        {
+            sweep.Expand(binBounds[i]);
+            count += binCounts[i];
+            if (leftCounts[i - 1] == 0 || count == 0)
+                continue;
+
+            const float cost = leftCounts[i - 1] * leftAreas[i - 1] + count * SurfaceArea(sweep);
+            if (cost < bestCost)
+            {
+                bestCost = cost;
+                bestAxis = axis;
+                bestSplit = i;
+            }
+        }
+    }
+
+    // Small nodes only split when it is cheaper than testing all their triangles
+    if (bestCost == std::numeric_limits<float>::max() ||
+        (node.count <= bvhMaxLeafSize && bestCost >= node.count * SurfaceArea(node.bounds)))
+        return 0;
+
+    const float scale = bvhBinCount / (centroidBounds.max[bestAxis] - centroidBounds.min[bestAxis]);
+    auto middle = std::partition(m_triangles.begin() + node.first, m_triangles.begin() + node.first + node.count,
+                                 [&](const uint32_t& triangle) {
+        return std::min(bvhBinCount - 1, uint32_t((centroids[triangle][bestAxis] - centroidBounds.min[bestAxis]) * scale)) < bestSplit;
+    });
+    const uint32_t leftCount = middle - (m_triangles.begin() + node.first);
+    if (leftCount == 0 || leftCount == node.count)
+        return 0;
+
+    Node leftNode{BoundingBox(), node.first, leftCount};
+    Node rightNode{BoundingBox(), node.first + leftCount, node.count - leftCount};
+    for (uint32_t i = leftNode.first ; i < leftNode.first + leftNode.count ; i++)
+        leftNode.bounds.Expand(bounds[m_triangles[i]]);
+    for (uint32_t i = rightNode.first ; i < rightNode.first + rightNode.count ; i++)
+        rightNode.bounds.Expand(bounds[m_triangles[i]]);
+
+    const uint32_t left = m_nodes.size();
+    m_nodes.push_back(leftNode);
+    m_nodes.push_back(rightNode);
+    m_nodes[nodeIndex].first = left;
+    m_nodes[nodeIndex].count = 0;
+    return left;
+}
+
+
+bool BVH::ClosestPoint(const glm::vec3& point,
+                       glm::vec3& closestPoint,
+                       uint32_t& triangleIndex,
+                       float& distance,
+                       const float& maxDistance) const
+{
+    if (m_nodes.empty())
+        return false;
+
+    float bestDistance2 = maxDistance < std::sqrt(std::numeric_limits<float>::max()) ? maxDistance * maxDistance
+                                                                                        : std::numeric_limits<float>::max();
+    bool found = false;
+
+    // Nodes are pruned as soon as their box is further than the best triangle found so far,
+    // the nearest child being visited first to shrink that distance quickly
+    uint32_t stack[bvhMaxDepth + 4];
+    uint32_t stackSize = 0;
+    stack[stackSize++] = 0;
+    while (stackSize > 0)
+    {
+        const Node& node = m_nodes[stack[--stackSize]];
+        if (SquaredDistance(node.bounds, point) > bestDistance2)
+            continue;
+
+        if (node.count > 0)
+        {
+            for (uint32_t i = node.first ; i < node.first + node.count ; i++)
+            {
+                const glm::vec3 candidate = ClosestPointOnTriangle(point, m_corners[3 * i], m_corners[3 * i + 1], m_corners[3 * i + 2]);
+                const glm::vec3 offset = candidate - point;
+                const float distance2 = glm::dot(offset, offset);
+                if (distance2 < bestDistance2 || (!found && distance2 <= bestDistance2))
+                {
+                    bestDistance2 = distance2;
+                    closestPoint = candidate;
+                    triangleIndex = m_triangles[i];
+                    found = true;
+                }
+            }
+            continue;
+        }
+
+        uint32_t near = node.first, far = node.first + 1;
+        float nearDistance2 = SquaredDistance(m_nodes[near].bounds, point);
+        float farDistance2 = SquaredDistance(m_nodes[far].bounds, point);
+        if (farDistance2 < nearDistance2)
+        {
+            std::swap(near, far);
+            std::swap(nearDistance2, farDistance2);
+        }
+
+        if (farDistance2 <= bestDistance2)
+            stack[stackSize++] = far;
+        if (nearDistance2 <= bestDistance2)
+            stack[stackSize++] = near;
+    }
+
+    if (found)
+        distance = std::sqrt(bestDistance2);
+    return found;
+}
+
+void BVH::ClosestPoints(const std::vector<glm::vec3>& points,
+                        std::vector<ClosestHit>& hits,
+                        const float& maxDistance) const
+{
+    hits.resize(points.size());
+
+    // The query costs vary with the distance to the mesh, the points are handed out in small chunks
+    #pragma omp parallel for schedule(dynamic, 256) num_threads(omp_get_max_threads())
+    for (uint32_t i = 0 ; i < points.size() ; i++)
+    {
+        ClosestHit& hit = hits[i];
+        hit.found = ClosestPoint(points[i], hit.point, hit.triangle, hit.distance, maxDistance);
+    }
+}
+
+
+bool BVH::RayCast(const glm::vec3& origin,
+                  const glm::vec3& direction,
+                  uint32_t& triangleIndex,
+                  float& distance,
+                  const float& maxDistance) const
+{
+    if (m_nodes.empty())
+        return false;
+
+    // Null components give infinite slabs, which the min and max of the slab test handle
+    const glm::vec3 inverseDirection = 1.0f / direction;
+    float bestDistance = maxDistance;
+    bool found = false;
+
+    uint32_t stack[bvhMaxDepth + 4];
+    uint32_t stackSize = 0;
+    if (RayEntry(m_nodes[0].bounds, origin, inverseDirection, bestDistance) <= bestDistance)
+        stack[stackSize++] = 0;
+    while (stackSize > 0)
+    {
+        const Node& node = m_nodes[stack[--stackSize]];
+        if (node.count > 0)
+        {
+            for (uint32_t i = node.first ; i < node.first + node.count ; i++)
+            {
+                const float t = RayTriangle(origin, direction, m_corners[3 * i], m_corners[3 * i + 1], m_corners[3 * i + 2]);
+                if (t <= bestDistance)
+                {
+                    bestDistance = t;
+                    triangleIndex = m_triangles[i];
+                    found = true;
+                }
+            }
+            continue;
+        }
+
+        uint32_t near = node.first, far = node.first + 1;
+        float nearEntry = RayEntry(m_nodes[near].bounds, origin, inverseDirection, bestDistance);
+        float farEntry = RayEntry(m_nodes[far].bounds, origin, inverseDirection, bestDistance);
+        if (farEntry < nearEntry)
+        {
+            std::swap(near, far);
+            std::swap(nearEntry, farEntry);
+        }
+
+        if (farEntry <= bestDistance)
+            stack[stackSize++] = far;
+        if (nearEntry <= bestDistance)
+            stack[stackSize++] = near;
+    }
+
+    if (found)
+        distance = bestDistance;
+    return found;
+}
+
+
+void BVH::Overlap(const BoundingBox& bounds, std::vector<uint32_t>& triangles) const
+{
+    if (m_nodes.empty())
+        return;
+
+    uint32_t stack[bvhMaxDepth + 4];
+    uint32_t stackSize = 0;
+    stack[stackSize++] = 0;
+    while (stackSize > 0)
+    {
+        const Node& node = m_nodes[stack[--stackSize]];
+        if (!Overlaps(node.bounds, bounds))
+            continue;
+
+        if (node.count > 0)
+        {
+            for (uint32_t i = node.first ; i < node.first + node.count ; i++)
+            {
+                BoundingBox triangleBounds;
+                for (uint32_t j = 0 ; j < 3 ; j++)
+                    triangleBounds.Expand(m_corners[3 * i + j]);
+                if (Overlaps(triangleBounds, bounds))
+                    triangles.push_back(m_triangles[i]);
+            }
+            continue;
+        }
+
+        stack[stackSize++] = node.first;
+        stack[stackSize++] = node.first + 1;
+    }
+}
+
+
+}  // namespace Mesh
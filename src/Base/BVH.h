@@ -0,0 +1,79 @@
+#ifndef BVH_H
+#define BVH_H
+
+#include "Math.h"
+#include "Mesh.h"
+
+#include <glm/glm.hpp>
+
+#include <limits>
+#include <vector>
+
+
+namespace Mesh {
+
+
+// Bounding volume hierarchy over the triangles of a mesh, split with a binned surface area heuristic.
+// The triangle corners are copied in leaf order so that the queries never go back to the mesh.
+// The queries are read only and can be run from several threads at once.
+class BVH
+{
+public:
+    struct Node
+    {
+        BoundingBox bounds;
+        uint32_t first;   // First triangle of a leaf, or left child of an inner node (the right one follows it)
+        uint32_t count;   // Triangles of a leaf, 0 for inner nodes
+    };
+
+    struct ClosestHit
+    {
+        glm::vec3 point;
+        uint32_t triangle;
+        float distance;
+        bool found;
+    };
+
+    void Build(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices);
+    // Update the bounds to moved vertices without changing the tree, the triangles must be the ones of
+    // the build. Returns false if the triangle count differs, the tree should then be built again.
+    bool Refit(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices);
+
+    inline bool IsEmpty() const { return m_nodes.empty(); }
+    inline uint32_t GetTriangleCount() const { return m_triangles.size(); }
+    inline const std::vector<Node>& GetNodes() const { return m_nodes; }
+
+    // Closest point of the mesh closer than maxDistance, returns false if there is none
+    bool ClosestPoint(const glm::vec3& point,
+                      glm::vec3& closestPoint,
+                      uint32_t& triangleIndex,
+                      float& distance,
+                      const float& maxDistance=std::numeric_limits<float>::max()) const;
+    // Closest points of many points in a single parallel call, the hits are resized to the points
+    void ClosestPoints(const std::vector<glm::vec3>& points,
+                       std::vector<ClosestHit>& hits,
+                       const float& maxDistance=std::numeric_limits<float>::max()) const;
+
+    // First triangle hit by the ray before maxDistance, the direction does not need to be normalized
+    // and the distance is given in multiples of it
+    bool RayCast(const glm::vec3& origin,
+                 const glm::vec3& direction,
+                 uint32_t& triangleIndex,
+                 float& distance,
+                 const float& maxDistance=std::numeric_limits<float>::max()) const;
+
+    // Triangles whose bounds overlap the box, appended to the given list
+    void Overlap(const BoundingBox& bounds, std::vector<uint32_t>& triangles) const;
+
+private:
+    uint32_t Split(const uint32_t& node, const std::vector<glm::vec3>& centroids, const std::vector<BoundingBox>& bounds);
+
+    std::vector<Node> m_nodes;
+    std::vector<uint32_t> m_triangles;    // Mesh triangle of each leaf triangle
+    std::vector<glm::vec3> m_corners;     // 3 corners per leaf triangle
+};
+
+
+}  // namespace Mesh
+
+#endif  // BVH_H
@@ -0,0 +1,66 @@
+#ifndef BINARYFILE_H
+#define BINARYFILE_H
+
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <functional>
+#include <vector>
+
+
+namespace fs = std::filesystem;
+
+
+// Arrays of trivially copyable elements stored as raw bytes in the caches, snapshots and replays
+
+template <typename T>
+inline bool ReadArray(FILE* file, std::vector<T>& array, const uint64_t& count)
+{
+    array.resize(count);
+    return fread(array.data(), sizeof(T), count, file) == count;
+}
+
+template <typename T>
+inline bool WriteArray(FILE* file, const std::vector<T>& array)
+{
+    return fwrite(array.data(), sizeof(T), array.size(), file) == array.size();
+}
+
+
+// Files are written to a temporary file next to them first, then renamed over the final file once
+// complete so that a concurrent or interrupted run never sees a partial file
+inline fs::path GetTemporaryPath(const fs::path& filePath)
+{
+    return fs::path(filePath).concat(".tmp");
+}
+
+// Rename the closed temporary file over the final file when it was fully written, remove it otherwise
+inline bool CommitTemporaryFile(const fs::path& filePath, const bool& written)
+{
+    const fs::path tmpPath = GetTemporaryPath(filePath);
+    std::error_code error;
+    if (written)
+        fs::rename(tmpPath, filePath, error);
+    if (!written || error)
+    {
+        fs::remove(tmpPath, error);
+        return false;
+    }
+
+    return true;
+}
+
+// Whole file written by writeFn, which returns false on failure
+inline bool WriteFileAtomically(const fs::path& filePath, const std::function<bool(FILE*)>& writeFn)
+{
+    FILE* file = fopen(GetTemporaryPath(filePath).c_str(), "wb");
+    if (!file)
+        return false;
+
+    bool written = writeFn(file);
+    written = (fclose(file) == 0) && written;
+    return CommitTemporaryFile(filePath, written);
+}
+
+
+#endif  // BINARYFILE_H
@@ -0,0 +1,16 @@
+#ifndef FIBERCURVE_H
+#define FIBERCURVE_H
+
+#include <cstdint>
+
+
+// Range of a curve inside the merged control points of a FibersData
+struct FiberCurve
+{
+    uint32_t offset;
+    uint32_t pointCount;
+    uint32_t isClosed;
+};
+
+
+#endif  // FIBERCURVE_H
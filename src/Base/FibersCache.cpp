@@ -0,0 +1,73 @@
+#include "FibersCache.h"
+
+#include "BinaryFile.h"
+#include "Logging.h"
+
+#include <cstdio>
+
+
+fs::path GetFibersCachePath(const fs::path& bccPath)
+{
+    return fs::path(bccPath).replace_extension(FIBERS_CACHE_EXTENSION);
+}
+
+
+bool LoadFibersCache(const fs::path& cachePath, const uint64_t& sourceHash, FibersData& fibers)
+{
+    FILE* file = fopen(cachePath.c_str(), "rb");
+    if (!file)
+        return false;
+
+    FibersCacheHeader header;
+    bool valid = fread(&header, sizeof(header), 1, file) == 1 &&
+                 std::string(header.sign, 4) == "BCCX" &&
+                 header.version == FIBERS_CACHE_VERSION &&
+                 header.sourceHash == sourceHash;
+
+    // Guard against truncated files before allocating anything
+    std::error_code error;
+    valid = valid && fs::file_size(cachePath, error) == sizeof(header) +
+                                                        header.controlPointCount * sizeof(glm::vec3) +
+                                                        header.curveCount * (sizeof(FiberCurve) + sizeof(BoundingBox)) +
+                                                        header.indexCount * sizeof(uint32_t);
+
+    valid = valid && ReadArray(file, fibers.controlPoints, header.controlPointCount)
+                  && ReadArray(file, fibers.curves, header.curveCount)
+                  && ReadArray(file, fibers.curveBounds, header.curveCount)
+                  && ReadArray(file, fibers.indices, header.indexCount);
+    fclose(file);
+
+    if (!valid)
+    {
+        fibers.controlPoints.clear();
+        fibers.curves.clear();
+        fibers.curveBounds.clear();
+        fibers.indices.clear();
+        return false;
+    }
+
+    fibers.sourceHash = sourceHash;
+    return true;
+}
+
+
+bool SaveFibersCache(const fs::path& cachePath, const FibersData& fibers)
+{
+    FibersCacheHeader header{{'B', 'C', 'C', 'X'},
+                             FIBERS_CACHE_VERSION,
+                             fibers.sourceHash,
+                             fibers.controlPoints.size(),
+                             fibers.indices.size(),
+                             fibers.curves.size()};
+    bool success = WriteFileAtomically(cachePath, [&](FILE* file) {
+        return fwrite(&header, sizeof(header), 1, file) == 1 &&
+               WriteArray(file, fibers.controlPoints) &&
+               WriteArray(file, fibers.curves) &&
+               WriteArray(file, fibers.curveBounds) &&
+               WriteArray(file, fibers.indices);
+    });
+
+    if (!success)
+        LOG_WARNING("Could not write the fibers cache %s", cachePath.c_str());
+    return success;
+}
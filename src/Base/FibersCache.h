@@ -0,0 +1,35 @@
+#ifndef FIBERSCACHE_H
+#define FIBERSCACHE_H
+
+#include "bccReader.h"
+
+#include <filesystem>
+
+
+namespace fs = std::filesystem;
+
+
+// Preprocessed fibers stored next to their BCC file, holding the buffers exactly as they
+// are sent to OpenGL so that loading them is a plain read of each array
+#define FIBERS_CACHE_EXTENSION ".bccx"
+#define FIBERS_CACHE_VERSION 1
+
+struct FibersCacheHeader
+{
+    char sign[4];
+    uint32_t version;
+    uint64_t sourceHash;
+    uint64_t controlPointCount,
+             indexCount,
+             curveCount;
+};
+
+
+fs::path GetFibersCachePath(const fs::path& bccPath);
+
+// Returns false if the cache is missing, from another version or out of date with the source hash
+bool LoadFibersCache(const fs::path& cachePath, const uint64_t& sourceHash, FibersData& fibers);
+bool SaveFibersCache(const fs::path& cachePath, const FibersData& fibers);
+
+
+#endif  // FIBERSCACHE_H
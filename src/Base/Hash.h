@@ -0,0 +1,91 @@
+#ifndef HASH_H
+#define HASH_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <vector>
+
+
+// 64 bits FNV-1a hash processing the data 8 bytes at a time, used to detect
+// whether a cached file is still up to date with its source data
+inline uint64_t HashData(const void* data, const size_t& size, uint64_t hash=0xcbf29ce484222325ull)
+{
+    const uint64_t prime = 0x100000001b3ull;
+    const char* bytes = static_cast<const char*>(data);
+
+    size_t i = 0;
+    for ( ; i + sizeof(uint64_t) <= size ; i += sizeof(uint64_t))
+    {
+        uint64_t word;
+        std::memcpy(&word, bytes + i, sizeof(uint64_t));
+        hash = (hash ^ word) * prime;
+        hash ^= hash >> 29;  // Fold the high bits back so that every bit of the word reaches the whole hash
+    }
+    for ( ; i < size ; i++)
+        hash = (hash ^ (unsigned char)bytes[i]) * prime;
+
+    return hash;
+}
+
+
+// Same as HashData over data handed in blocks of any size, the bytes that do not fill
+// a whole word are kept until the next block
+class StreamHash
+{
+public:
+    explicit StreamHash(uint64_t hash=0xcbf29ce484222325ull) : m_hash(hash) {}
+
+    void Update(const void* data, size_t size)
+    {
+        const char* bytes = static_cast<const char*>(data);
+        if (m_tailSize > 0)
+        {
+            size_t count = std::min(size, sizeof(uint64_t) - m_tailSize);
+            std::memcpy(m_tail + m_tailSize, bytes, count);
+            m_tailSize += count;
+            bytes += count;
+            size -= count;
+            if (m_tailSize < sizeof(uint64_t))
+                return;
+
+            m_hash = HashData(m_tail, sizeof(uint64_t), m_hash);
+            m_tailSize = 0;
+        }
+
+        size_t wholeSize = size - size % sizeof(uint64_t);
+        m_hash = HashData(bytes, wholeSize, m_hash);
+        m_tailSize = size - wholeSize;
+        std::memcpy(m_tail, bytes + wholeSize, m_tailSize);
+    }
+
+    inline uint64_t Get() const { return HashData(m_tail, m_tailSize, m_hash); }
+
+private:
+    uint64_t m_hash;
+    char m_tail[sizeof(uint64_t)];
+    size_t m_tailSize = 0;
+};
+
+
+// Same as HashData over the whole file content, read through a fixed size buffer
+inline uint64_t HashFile(const std::filesystem::path& filePath, uint64_t hash=0xcbf29ce484222325ull)
+{
+    FILE* file = fopen(filePath.c_str(), "rb");
+    if (!file)
+        return 0;
+
+    // The block size is a multiple of 8 so that chaining the blocks gives the hash of the whole data
+    std::vector<char> buffer(1 << 20);
+    size_t readSize;
+    while ((readSize = fread(buffer.data(), 1, buffer.size(), file)) > 0)
+        hash = HashData(buffer.data(), readSize, hash);
+
+    fclose(file);
+    return hash;
+}
+
+
+#endif  // HASH_H
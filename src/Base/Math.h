@@ -4,6 +4,20 @@
 
 #include <glm/glm.hpp>
 
+#include <limits>
+
+
+// Axis aligned bounding box, empty until a point is added to it
+struct BoundingBox
+{
+    glm::vec3 min = glm::vec3(std::numeric_limits<float>::max());
+    glm::vec3 max = glm::vec3(std::numeric_limits<float>::lowest());
+
+    inline bool IsEmpty() const { return min.x > max.x; }
+    inline void Expand(const glm::vec3& point) { min = glm::min(min, point); max = glm::max(max, point); }
+    inline void Expand(const BoundingBox& other) { min = glm::min(min, other.min); max = glm::max(max, other.max); }
+};
+
 
 // Barycentric coordinates
 glm::vec3 CartesianToBarycentric(const glm::vec3& p, 
@@ -3,6 +3,8 @@
 
 #include <omp.h>
 
+#include <cmath>
+
 
 namespace Mesh {
 
@@ -78,54 +80,90 @@ void GenerateNormals(std::vector<Vertex>& vertices,
 }
 
 
+void BuildVertexTriangles(const uint32_t& vertexCount,
+                          const std::vector<uint32_t>& indices,
+                          std::vector<uint32_t>& offsets,
+                          std::vector<uint32_t>& triangles)
+{
+    offsets.assign(vertexCount + 1, 0);
+    for (const auto& index : indices)
+        offsets[index + 1]++;
+    for (uint32_t i = 0 ; i < vertexCount ; i++)
+        offsets[i + 1] += offsets[i];
+
+    std::vector<uint32_t> next(offsets.begin(), offsets.end() - 1);
+    triangles.resize(indices.size());
+    for (uint32_t i = 0 ; i < indices.size() ; i++)
+        triangles[next[indices[i]]++] = i / 3;
+}
+
+
+void UpdateNormals(std::vector<Vertex>& vertices,
+                   const std::vector<uint32_t>& indices,
+                   const std::vector<uint32_t>& vertexTriangleOffsets,
+                   const std::vector<uint32_t>& vertexTriangles,
+                   const std::vector<uint8_t>& movedVertices)
+{
+    // Each vertex sums the normals of its own triangles so that the vertices are updated in parallel
+    #pragma omp parallel for num_threads(omp_get_max_threads())
+    for (uint32_t i = 0 ; i < vertices.size() ; i++) {
+        const uint32_t begin = vertexTriangleOffsets[i];
+        const uint32_t end = vertexTriangleOffsets[i + 1];
+
+        bool moved = false;
+        for (uint32_t j = begin ; j < end && !moved ; j++)
+        {
+            const uint32_t* triangle = &indices[vertexTriangles[j] * 3];
+            moved = movedVertices[triangle[0]] || movedVertices[triangle[1]] || movedVertices[triangle[2]];
+        }
+        if (!moved)
+            continue;
+
+        glm::vec3 normal(0.0f);
+        for (uint32_t j = begin ; j < end ; j++)
+        {
+            const uint32_t* triangle = &indices[vertexTriangles[j] * 3];
+            const glm::vec3& p1 = vertices[triangle[0]].position;
+            const glm::vec3& p2 = vertices[triangle[1]].position;
+            const glm::vec3& p3 = vertices[triangle[2]].position;
+            normal += glm::normalize(glm::cross(p1 - p2, p2 - p3));
+        }
+        vertices[i].normal = glm::normalize(normal);
+    }
+}
+
+
 glm::vec3 ClosestPointOnMesh(const glm::vec3& p,
                              const std::vector<Vertex>& vertices,
                              const std::vector<uint32_t>& indices,
                              uint32_t& triangleIndex,
                              float &distance)
 {
-    int threadCount = omp_get_max_threads();
+    // Serial on purpose, the callers query many points and parallelize over them
+    glm::vec3 closestPoint = p;
+    float closestDistance2 = std::numeric_limits<float>::max();
+    triangleIndex = 0;
 
-    glm::vec3 closestPoints[threadCount];
-    uint32_t closestIndices[threadCount];
-    float closestDistances[threadCount];
-    for (int i = 0 ; i < threadCount ; i++)
-        closestDistances[i] = std::numeric_limits<float>::max();
-
-    uint32_t triangleCount = indices.size() / 3;
-    #pragma omp parallel for num_threads(threadCount)
-    for (auto idx = 0 ; idx < triangleCount ; idx++ )
+    const uint32_t triangleCount = indices.size() / 3;
+    for (uint32_t idx = 0 ; idx < triangleCount ; idx++)
     {
-        int threadnum = omp_get_thread_num();
         glm::vec3 currPoint = ClosestPointOnTriangle(p, 
                                                      vertices[indices[idx * 3]].position, 
                                                      vertices[indices[idx * 3 + 1]].position,
                                                      vertices[indices[idx * 3 + 2]].position);
-        float currDistance = glm::distance(p, currPoint);
-        if (currDistance < closestDistances[threadnum])
+        const glm::vec3 offset = currPoint - p;
+        const float currDistance2 = glm::dot(offset, offset);
+        if (currDistance2 < closestDistance2)
         {
-            closestDistances[threadnum] = currDistance;
-            closestPoints[threadnum] = currPoint;
-            closestIndices[threadnum] = idx;
+            closestDistance2 = currDistance2;
+            closestPoint = currPoint;
+            triangleIndex = idx;
         }
     }
 
-    float closestDistance = std::numeric_limits<float>::max();
-    uint32_t index;
-    for (int i = 0 ; i < threadCount ; i++)
-    {
-        if (closestDistances[i] < closestDistance)
-        {
-            closestDistance = closestDistances[i];
-            index = i;
-        }
-
-    }
-
-    distance = closestDistances[index];
-    triangleIndex = closestIndices[index];
-    return closestPoints[index];
-}   
+    distance = std::sqrt(closestDistance2);
+    return closestPoint;
+}
 
 
 }  // namespace Mesh
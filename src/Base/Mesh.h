@@ -27,6 +27,19 @@ void BuildPlane(const float& width,
 void GenerateNormals(std::vector<Vertex>& vertices,
                      const std::vector<uint32_t>& indices);
 
+// Triangles around each vertex in CSR order, the ones of vertex i being [offsets[i], offsets[i + 1])
+void BuildVertexTriangles(const uint32_t& vertexCount,
+                          const std::vector<uint32_t>& indices,
+                          std::vector<uint32_t>& offsets,
+                          std::vector<uint32_t>& triangles);
+
+// Same as GenerateNormals restricted to the vertices having a moved vertex in one of their triangles
+void UpdateNormals(std::vector<Vertex>& vertices,
+                   const std::vector<uint32_t>& indices,
+                   const std::vector<uint32_t>& vertexTriangleOffsets,
+                   const std::vector<uint32_t>& vertexTriangles,
+                   const std::vector<uint8_t>& movedVertices);
+
 glm::vec3 ClosestPointOnMesh(const glm::vec3& p,
                             const std::vector<Vertex>& vertices,
                             const std::vector<uint32_t>& indices,
@@ -9,13 +9,19 @@ Profiler* Profiler::s_instance = nullptr;
 ProfilingScope::ProfilingScope(const std::string& name)
 {
     auto& profiler = Profiler::Get();
-    m_data = profiler.AddData(name, profiler.GetTime());
+    m_index = profiler.AddData(name, profiler.GetTime());
 }
 
 ProfilingScope::~ProfilingScope()
 {
     auto& profiler = Profiler::Get();
-    m_data->duration = profiler.GetTime() - m_data->start; 
+    auto& data = GetData();
+    data.duration = profiler.GetTime() - data.start; 
+}
+
+ProfilingScopeData& ProfilingScope::GetData() const
+{
+    return Profiler::Get().m_scopes[m_index];
 }
 
 // == Profiler ==
@@ -32,7 +38,8 @@ Profiler& Profiler::Init(const Window& window)
     return *s_instance;
 }
 
-ProfilingScopeData* Profiler::AddData(const std::string& name, const double& start)
+size_t Profiler::AddData(const std::string& name, const double& start)
 {
-    return &m_scopes.emplace_back(name, m_window.GetTime());
+    m_scopes.emplace_back(name, m_window.GetTime());
+    return m_scopes.size() - 1;
 }
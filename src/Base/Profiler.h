@@ -29,12 +29,14 @@ public:
     ProfilingScope(const std::string& name);
     ~ProfilingScope();
 
-    inline std::string GetName() const { return m_data->name; }
-    inline double GetStart() const { return m_data->start; }
-    inline double GetDuration() const { return m_data->duration; }
+    inline std::string GetName() const { return GetData().name; }
+    inline double GetStart() const { return GetData().start; }
+    inline double GetDuration() const { return GetData().duration; }
 
 private:
-    ProfilingScopeData* m_data;
+    // Scopes can be nested, an index stays valid when the profiler storage grows
+    ProfilingScopeData& GetData() const;
+    size_t m_index;
 };
 
 
@@ -54,7 +56,7 @@ private:
 
     // Private functions only used by ProfilingScope that allow them to create new entries in the Profiler
     inline double GetTime() const { return m_window.GetTime(); }
-    ProfilingScopeData* AddData(const std::string& name, const double& start);
+    size_t AddData(const std::string& name, const double& start);
 
     friend ProfilingScope;
     std::vector<ProfilingScopeData> m_scopes;
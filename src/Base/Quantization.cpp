@@ -0,0 +1,132 @@
+#include "Quantization.h"
+
+#include "Math.h"
+
+#include <glm/gtc/packing.hpp>
+
+#include <omp.h>
+
+#include <algorithm>
+#include <cmath>
+
+
+VertexBufferLayout GetPositionLayout(const PositionStorage& storage)
+{
+    switch (storage)
+    {
+        case PositionStorage::Half16:  return {{"Position", 3, GL_HALF_FLOAT, false}};
+        case PositionStorage::Fixed16: return {{"Position", 3, GL_UNSIGNED_SHORT, true}};
+        default:                       return {{"Position", 3, GL_FLOAT, false}};
+    }
+}
+
+
+static BoundingBox ComputeBounds(const std::vector<glm::vec3>& positions)
+{
+    int threadCount = omp_get_max_threads();
+    std::vector<BoundingBox> threadBounds(threadCount);
+
+    #pragma omp parallel num_threads(threadCount)
+    {
+        BoundingBox& bounds = threadBounds[omp_get_thread_num()];
+        #pragma omp for
+        for (int64_t i = 0 ; i < (int64_t)positions.size() ; i++)
+            bounds.Expand(positions[i]);
+    }
+
+    BoundingBox bounds;
+    for (const auto& other : threadBounds)
+        bounds.Expand(other);
+
+    return bounds;
+}
+
+
+void QuantizePositions(const std::vector<glm::vec3>& positions, const PositionStorage& storage, QuantizedPositions& result)
+{
+    result.storage = storage;
+    result.offset = glm::vec3(0.0f);
+    result.scale = glm::vec3(1.0f);
+    if (storage == PositionStorage::Float32)
+    {
+        result.data.clear();
+        return;
+    }
+
+    result.data.resize(positions.size() * 3);
+    uint16_t* data = result.data.data();
+
+    if (storage == PositionStorage::Half16)
+    {
+        #pragma omp parallel for num_threads(omp_get_max_threads())
+        for (int64_t i = 0 ; i < (int64_t)positions.size() ; i++)
+        {
+            data[i * 3]     = glm::packHalf1x16(positions[i].x);
+            data[i * 3 + 1] = glm::packHalf1x16(positions[i].y);
+            data[i * 3 + 2] = glm::packHalf1x16(positions[i].z);
+        }
+        return;
+    }
+
+    // Fixed16 : the normalized attribute lands in [0, 1] and is remapped onto the bounding box.
+    // The bounding box is recomputed on every call since the deformed positions move.
+    BoundingBox bounds = ComputeBounds(positions);
+    if (bounds.IsEmpty())
+        return;
+
+    glm::vec3 extent = glm::max(bounds.max - bounds.min, glm::vec3(1e-6f));
+    glm::vec3 toFixed = 65535.0f / extent;
+    result.offset = bounds.min;
+    result.scale = extent;
+
+    #pragma omp parallel for num_threads(omp_get_max_threads())
+    for (int64_t i = 0 ; i < (int64_t)positions.size() ; i++)
+    {
+        glm::vec3 fixed = (positions[i] - bounds.min) * toFixed + 0.5f;
+        data[i * 3]     = (uint16_t)std::min(fixed.x, 65535.0f);
+        data[i * 3 + 1] = (uint16_t)std::min(fixed.y, 65535.0f);
+        data[i * 3 + 2] = (uint16_t)std::min(fixed.z, 65535.0f);
+    }
+}
+
+
+glm::vec3 DequantizePosition(const QuantizedPositions& positions, const size_t& index)
+{
+    const uint16_t* data = positions.data.data() + index * 3;
+    if (positions.storage == PositionStorage::Half16)
+        return {glm::unpackHalf1x16(data[0]), glm::unpackHalf1x16(data[1]), glm::unpackHalf1x16(data[2])};
+
+    return glm::vec3(data[0], data[1], data[2]) / 65535.0f * positions.scale + positions.offset;
+}
+
+
+QuantizationError MeasureQuantizationError(const std::vector<glm::vec3>& positions, const QuantizedPositions& quantized)
+{
+    QuantizationError error;
+    if (quantized.storage == PositionStorage::Float32 || positions.empty())
+        return error;
+
+    double sum = 0.0;
+    float maxError = 0.0f;
+    #pragma omp parallel for reduction(+:sum) reduction(max:maxError) num_threads(omp_get_max_threads())
+    for (int64_t i = 0 ; i < (int64_t)positions.size() ; i++)
+    {
+        float distance = glm::distance(positions[i], DequantizePosition(quantized, i));
+        sum += distance;
+        maxError = std::max(maxError, distance);
+    }
+
+    error.maxError = maxError;
+    error.meanError = sum / positions.size();
+    return error;
+}
+
+
+void UploadPositions(const VertexBufferPtr& buffer, const std::vector<glm::vec3>& positions, QuantizedPositions& quantized)
+{
+    QuantizePositions(positions, quantized.storage, quantized);
+    if (quantized.storage == PositionStorage::Float32)
+        buffer->SetData(positions.data(), positions.size() * sizeof(glm::vec3));
+    else
+        buffer->SetData(quantized.data.data(), quantized.data.size() * sizeof(uint16_t));
+}
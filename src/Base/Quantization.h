@@ -0,0 +1,52 @@
+#ifndef QUANTIZATION_H
+#define QUANTIZATION_H
+
+#include "VertexBuffer.h"
+
+#include <glm/glm.hpp>
+
+#include <vector>
+
+
+// How positions are stored in a vertex buffer, they are decoded in the vertex shader
+// as position = aPos * uPositionScale + uPositionOffset
+enum class PositionStorage
+{
+    Float32 = 0,  // 12 bytes per position, exact
+    Half16,       // 6 bytes per position, relative precision of 2^-11
+    Fixed16       // 6 bytes per position, 16 bits per axis spread over the bounding box of the positions
+};
+
+
+struct QuantizedPositions
+{
+    PositionStorage storage = PositionStorage::Float32;
+    std::vector<uint16_t> data;  // 3 components per position, unused for Float32
+
+    glm::vec3 offset = glm::vec3(0.0f);
+    glm::vec3 scale = glm::vec3(1.0f);
+};
+
+
+struct QuantizationError
+{
+    float maxError = 0.0f;
+    float meanError = 0.0f;
+};
+
+
+VertexBufferLayout GetPositionLayout(const PositionStorage& storage);
+
+// Encode the positions, the data of the result is reused to avoid reallocating it every frame
+void QuantizePositions(const std::vector<glm::vec3>& positions, const PositionStorage& storage, QuantizedPositions& result);
+glm::vec3 DequantizePosition(const QuantizedPositions& positions, const size_t& index);
+
+// Distance between the positions and their encoded version
+QuantizationError MeasureQuantizationError(const std::vector<glm::vec3>& positions, const QuantizedPositions& quantized);
+
+// Upload the positions to the bound buffer in the given storage, the quantized positions
+// hold the decoding parameters to send to the shader afterward
+void UploadPositions(const VertexBufferPtr& buffer, const std::vector<glm::vec3>& positions, QuantizedPositions& quantized);
+
+
+#endif  // QUANTIZATION_H
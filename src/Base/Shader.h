@@ -8,6 +8,7 @@
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <vector>
 
 class Shader;
 using ShaderPtr = std::shared_ptr<Shader>;
@@ -17,11 +18,13 @@ class Shader
 {
 public:
     unsigned int ID;
-    // constructor generates the shader on the fly
+    // constructor generates the shader on the fly. Without fragment shader, the outputs listed in
+    // feedbackVaryings are captured by transform feedback
     // ------------------------------------------------------------------------
     Shader() : ID(0) {}
     Shader(const char* vertexPath, const char* fragmentPath, const char* geometryPath = nullptr,
-           const char* tessControlPath = nullptr, const char* tessEvalPath = nullptr)
+           const char* tessControlPath = nullptr, const char* tessEvalPath = nullptr,
+           const std::vector<std::string>& feedbackVaryings = {})
     {
         // 1. retrieve the vertex/fragment source code from filePath
         std::string vertexCode;
@@ -44,17 +47,22 @@ public:
         {
             // open files
             vShaderFile.open(vertexPath);
-            fShaderFile.open(fragmentPath);
-            std::stringstream vShaderStream, fShaderStream;
+            std::stringstream vShaderStream;
             // read file's buffer contents into streams
             vShaderStream << vShaderFile.rdbuf();
-            fShaderStream << fShaderFile.rdbuf();
             // close file handlers
             vShaderFile.close();
-            fShaderFile.close();
             // convert stream into string
             vertexCode = vShaderStream.str();
-            fragmentCode = fShaderStream.str();
+            // if fragment shader path is present, also load a fragment shader
+            if(fragmentPath != nullptr)
+            {
+                fShaderFile.open(fragmentPath);
+                std::stringstream fShaderStream;
+                fShaderStream << fShaderFile.rdbuf();
+                fShaderFile.close();
+                fragmentCode = fShaderStream.str();
+            }
             // if geometry shader path is present, also load a geometry shader
             if(geometryPath != nullptr)
             {
@@ -87,7 +95,7 @@ public:
         const char * fShaderCode = fragmentCode.c_str();
 
         // 2. compile shaders
-        unsigned int vertex, fragment;
+        unsigned int vertex, fragment = 0;
 
         // vertex shader
         vertex = glCreateShader(GL_VERTEX_SHADER);
@@ -97,10 +105,13 @@ public:
         success &= checkCompileErrors(vertex, "VERTEX");
 
         // fragment Shader
-        fragment = glCreateShader(GL_FRAGMENT_SHADER);
-        glShaderSource(fragment, 1, &fShaderCode, NULL);
-        glCompileShader(fragment);
-        checkCompileErrors(fragment, "FRAGMENT");
+        if(fragmentPath != nullptr)
+        {
+            fragment = glCreateShader(GL_FRAGMENT_SHADER);
+            glShaderSource(fragment, 1, &fShaderCode, NULL);
+            glCompileShader(fragment);
+            checkCompileErrors(fragment, "FRAGMENT");
+        }
 
         // if geometry shader is given, compile geometry shader
         unsigned int geometry;
@@ -137,19 +148,29 @@ public:
         // shader Program
         ID = glCreateProgram();
         glAttachShader(ID, vertex);
-        glAttachShader(ID, fragment);
+        if(fragmentPath != nullptr)
+            glAttachShader(ID, fragment);
         if(geometryPath != nullptr)
             glAttachShader(ID, geometry);
         if(tessControlPath != nullptr)
             glAttachShader(ID, tessControl);
         if(tessEvalPath != nullptr)
             glAttachShader(ID, tessEval);
+        // the captured varyings have to be known before linking
+        if(!feedbackVaryings.empty())
+        {
+            std::vector<const char*> varyings;
+            for (const auto& varying : feedbackVaryings)
+                varyings.push_back(varying.c_str());
+            glTransformFeedbackVaryings(ID, varyings.size(), varyings.data(), GL_INTERLEAVED_ATTRIBS);
+        }
         glLinkProgram(ID);
         success &= checkCompileErrors(ID, "PROGRAM");
 
         // delete the shaders as they're linked into our program now and no longer necessary
         glDeleteShader(vertex);
-        glDeleteShader(fragment);
+        if(fragmentPath != nullptr)
+            glDeleteShader(fragment);
         if(geometryPath != nullptr)
             glDeleteShader(geometry);
 
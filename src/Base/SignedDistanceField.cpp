@@ -0,0 +1,307 @@
+#include "SignedDistanceField.h"
+
+#include "BinaryFile.h"
+#include "Logging.h"
+#include "SpatialHash.h"
+
+#include <omp.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <limits>
+
+
+// Twice the signed area of the 2D triangle (0, p1, p2). Null areas are given a sign from the
+// coordinates so that a point lying on an edge shared by two triangles falls in exactly one of them.
+inline int Orientation(const double& x1, const double& y1, const double& x2, const double& y2, double& area)
+{
+    area = y1 * x2 - x1 * y2;
+    if (area != 0.0)
+        return area > 0.0 ? 1 : -1;
+    if (y1 != y2)
+        return y2 > y1 ? 1 : -1;
+    if (x1 != x2)
+        return x1 > x2 ? 1 : -1;
+    return 0;
+}
+
+// Barycentric coordinates of a point inside a 2D triangle, false when the point is outside
+inline bool PointInTriangle2D(const double& x, const double& y,
+                              double x1, double y1,
+                              double x2, double y2,
+                              double x3, double y3,
+                              glm::dvec3& barycentric)
+{
+    x1 -= x; x2 -= x; x3 -= x;
+    y1 -= y; y2 -= y; y3 -= y;
+
+    int sign = Orientation(x2, y2, x3, y3, barycentric.x);
+    if (sign == 0 ||
+        Orientation(x3, y3, x1, y1, barycentric.y) != sign ||
+        Orientation(x1, y1, x2, y2, barycentric.z) != sign)
+        return false;
+
+    double sum = barycentric.x + barycentric.y + barycentric.z;
+    if (sum == 0.0)
+        return false;
+
+    barycentric /= sum;
+    return true;
+}
+
+
+void SignedDistanceField::Build(const std::vector<glm::vec3>& positions,
+                                const std::vector<uint32_t>& indices,
+                                const float& spacing,
+                                const uint32_t& margin)
+{
+    const uint32_t triangleCount = indices.size() / 3;
+
+    BoundingBox meshBounds;
+    for (const auto& position : positions)
+        meshBounds.Expand(position);
+
+    m_spacing = spacing;
+    m_origin = meshBounds.min - glm::vec3(margin * spacing);
+    glm::vec3 extent = (meshBounds.max - meshBounds.min) / spacing + glm::vec3(2.0f * margin);
+    m_size = glm::uvec3(std::max(2u, uint32_t(std::ceil(extent.x)) + 1),
+                        std::max(2u, uint32_t(std::ceil(extent.y)) + 1),
+                        std::max(2u, uint32_t(std::ceil(extent.z)) + 1));
+    m_distances.assign(size_t(m_size.x) * m_size.y * m_size.z, std::numeric_limits<float>::max());
+
+    auto getTriangle = [&](const uint32_t& triangle, glm::vec3& a, glm::vec3& b, glm::vec3& c) {
+        a = positions[indices[3 * triangle]];
+        b = positions[indices[3 * triangle + 1]];
+        c = positions[indices[3 * triangle + 2]];
+    };
+
+    // Exact distances in a band around the triangles : each triangle is hashed by its bounds enlarged
+    // by the band, so that the bucket of a sample holds every triangle closer than the band
+    const float band = 2.0f * spacing;
+    std::vector<BoundingBox> triangleBounds(triangleCount);
+    for (uint32_t i = 0 ; i < triangleCount ; i++)
+    {
+        glm::vec3 a, b, c;
+        getTriangle(i, a, b, c);
+        if (glm::length(glm::cross(b - a, c - a)) == 0.0f)
+            continue;  // Degenerate triangles keep an empty box
+
+        triangleBounds[i].Expand(a);
+        triangleBounds[i].Expand(b);
+        triangleBounds[i].Expand(c);
+        triangleBounds[i].min -= glm::vec3(band);
+        triangleBounds[i].max += glm::vec3(band);
+    }
+
+    SpatialHash triangleGrid;
+    triangleGrid.Build(triangleBounds, band);
+
+    #pragma omp parallel for num_threads(omp_get_max_threads())
+    for (uint32_t z = 0 ; z < m_size.z ; z++) {
+        for (uint32_t y = 0 ; y < m_size.y ; y++)
+        for (uint32_t x = 0 ; x < m_size.x ; x++)
+        {
+            const glm::vec3 sample = m_origin + spacing * glm::vec3(x, y, z);
+            float& distance = m_distances[GetIndex(x, y, z)];
+            triangleGrid.ForEachInCell(sample, [&](const uint32_t& triangle) {
+                // Skip the triangles of the other cells sharing the bucket
+                const BoundingBox& bounds = triangleBounds[triangle];
+                if (sample.x < bounds.min.x || sample.y < bounds.min.y || sample.z < bounds.min.z ||
+                    sample.x > bounds.max.x || sample.y > bounds.max.y || sample.z > bounds.max.z)
+                    return;
+
+                glm::vec3 a, b, c;
+                getTriangle(triangle, a, b, c);
+                distance = std::min(distance, glm::distance(sample, ClosestPointOnTriangle(sample, a, b, c)));
+            });
+        }
+    }
+
+    // Two chamfer passes propagate the band to the rest of the grid, each sample looking at the
+    // 13 neighbours already visited in the direction of the pass
+    std::vector<glm::ivec3> offsets;
+    std::vector<float> lengths;
+    for (int dz = -1 ; dz <= 0 ; dz++)
+    for (int dy = -1 ; dy <= 1 ; dy++)
+    for (int dx = -1 ; dx <= 1 ; dx++)
+    {
+        if (dz == 0 && (dy > 0 || (dy == 0 && dx >= 0)))
+            continue;
+        offsets.push_back(glm::ivec3(dx, dy, dz));
+        lengths.push_back(spacing * std::sqrt(float(dx * dx + dy * dy + dz * dz)));
+    }
+
+    auto relax = [&](const int& x, const int& y, const int& z, const int& direction) {
+        float& distance = m_distances[GetIndex(x, y, z)];
+        for (uint32_t i = 0 ; i < offsets.size() ; i++)
+        {
+            glm::ivec3 neighbor = glm::ivec3(x, y, z) + direction * offsets[i];
+            if (neighbor.x < 0 || neighbor.y < 0 || neighbor.z < 0 ||
+                neighbor.x >= int(m_size.x) || neighbor.y >= int(m_size.y) || neighbor.z >= int(m_size.z))
+                continue;
+            distance = std::min(distance, m_distances[GetIndex(neighbor.x, neighbor.y, neighbor.z)] + lengths[i]);
+        }
+    };
+
+    for (int z = 0 ; z < int(m_size.z) ; z++)
+    for (int y = 0 ; y < int(m_size.y) ; y++)
+    for (int x = 0 ; x < int(m_size.x) ; x++)
+        relax(x, y, z, 1);
+
+    for (int z = m_size.z - 1 ; z >= 0 ; z--)
+    for (int y = m_size.y - 1 ; y >= 0 ; y--)
+    for (int x = m_size.x - 1 ; x >= 0 ; x--)
+        relax(x, y, z, -1);
+
+    // Sign from the parity of the crossings of the rows along x : each triangle marks the first
+    // sample after the point where it crosses a row, a running count then tells the inside samples
+    std::vector<uint32_t> crossings(m_distances.size(), 0);
+
+    #pragma omp parallel for num_threads(omp_get_max_threads())
+    for (uint32_t i = 0 ; i < triangleCount ; i++) {
+        if (triangleBounds[i].IsEmpty())
+            continue;
+
+        glm::vec3 a, b, c;
+        getTriangle(i, a, b, c);
+        glm::dvec3 pa = (glm::dvec3(a) - glm::dvec3(m_origin)) / double(spacing);
+        glm::dvec3 pb = (glm::dvec3(b) - glm::dvec3(m_origin)) / double(spacing);
+        glm::dvec3 pc = (glm::dvec3(c) - glm::dvec3(m_origin)) / double(spacing);
+
+        int minY = std::max(0, int(std::ceil(std::min({pa.y, pb.y, pc.y}))));
+        int maxY = std::min(int(m_size.y) - 1, int(std::floor(std::max({pa.y, pb.y, pc.y}))));
+        int minZ = std::max(0, int(std::ceil(std::min({pa.z, pb.z, pc.z}))));
+        int maxZ = std::min(int(m_size.z) - 1, int(std::floor(std::max({pa.z, pb.z, pc.z}))));
+
+        for (int z = minZ ; z <= maxZ ; z++)
+        for (int y = minY ; y <= maxY ; y++)
+        {
+            glm::dvec3 barycentric;
+            if (!PointInTriangle2D(y, z, pa.y, pa.z, pb.y, pb.z, pc.y, pc.z, barycentric))
+                continue;
+
+            double crossing = barycentric.x * pa.x + barycentric.y * pb.x + barycentric.z * pc.x;
+            int x = std::clamp(int(std::ceil(crossing)), 0, int(m_size.x));
+            if (x < int(m_size.x))
+            {
+                #pragma omp atomic
+                crossings[GetIndex(x, y, z)]++;
+            }
+        }
+    }
+
+    #pragma omp parallel for num_threads(omp_get_max_threads())
+    for (uint32_t z = 0 ; z < m_size.z ; z++) {
+        for (uint32_t y = 0 ; y < m_size.y ; y++)
+        {
+            uint32_t count = 0;
+            for (uint32_t x = 0 ; x < m_size.x ; x++)
+            {
+                count += crossings[GetIndex(x, y, z)];
+                if (count % 2 == 1)
+                    m_distances[GetIndex(x, y, z)] *= -1.0f;
+            }
+        }
+    }
+
+    LOG_INFO("Signed distance field of %d triangles built on a %dx%dx%d grid", triangleCount, m_size.x, m_size.y, m_size.z);
+}
+
+
+fs::path GetSignedDistanceFieldCachePath(const fs::path& meshPath)
+{
+    return fs::path(meshPath).replace_extension(SDF_CACHE_EXTENSION);
+}
+
+
+bool LoadSignedDistanceFieldCache(const fs::path& cachePath, const uint64_t& sourceHash, SignedDistanceField& field)
+{
+    FILE* file = fopen(cachePath.c_str(), "rb");
+    if (!file)
+        return false;
+
+    SignedDistanceFieldCacheHeader header;
+    bool valid = fread(&header, sizeof(header), 1, file) == 1 &&
+                 std::string(header.sign, 4) == "SDFX" &&
+                 header.version == SDF_CACHE_VERSION &&
+                 header.sourceHash == sourceHash &&
+                 header.size[0] >= 2 && header.size[1] >= 2 && header.size[2] >= 2;
+
+    // Guard against truncated files before allocating anything
+    const size_t sampleCount = valid ? size_t(header.size[0]) * header.size[1] * header.size[2] : 0;
+    std::error_code error;
+    valid = valid && fs::file_size(cachePath, error) == sizeof(header) + sampleCount * sizeof(float);
+
+    if (valid)
+    {
+        field.m_distances.resize(sampleCount);
+        valid = fread(field.m_distances.data(), sizeof(float), sampleCount, file) == sampleCount;
+    }
+    fclose(file);
+
+    if (!valid)
+    {
+        field.m_distances.clear();
+        return false;
+    }
+
+    field.m_origin = glm::vec3(header.origin[0], header.origin[1], header.origin[2]);
+    field.m_spacing = header.spacing;
+    field.m_size = glm::uvec3(header.size[0], header.size[1], header.size[2]);
+    field.m_sourceHash = sourceHash;
+    return true;
+}
+
+
+bool SaveSignedDistanceFieldCache(const fs::path& cachePath, const SignedDistanceField& field)
+{
+    bool success = WriteFileAtomically(cachePath, [&](FILE* file) { return WriteSignedDistanceField(file, field); });
+
+    if (!success)
+        LOG_WARNING("Could not write the signed distance field cache %s", cachePath.c_str());
+    return success;
+}
+
+
+bool ReadSignedDistanceField(FILE* file, const size_t& remainingSize, SignedDistanceField& field)
+{
+    SignedDistanceFieldCacheHeader header;
+    bool valid = remainingSize >= sizeof(header) &&
+                 fread(&header, sizeof(header), 1, file) == 1 &&
+                 std::string(header.sign, 4) == "SDFX" &&
+                 header.version == SDF_CACHE_VERSION &&
+                 header.size[0] >= 2 && header.size[1] >= 2 && header.size[2] >= 2;
+
+    const size_t sampleCount = valid ? size_t(header.size[0]) * header.size[1] * header.size[2] : 0;
+    valid = valid && sampleCount <= (remainingSize - sizeof(header)) / sizeof(float);
+    if (valid)
+    {
+        field.m_distances.resize(sampleCount);
+        valid = fread(field.m_distances.data(), sizeof(float), sampleCount, file) == sampleCount;
+    }
+
+    if (!valid)
+    {
+        field.m_distances.clear();
+        return false;
+    }
+
+    field.m_origin = glm::vec3(header.origin[0], header.origin[1], header.origin[2]);
+    field.m_spacing = header.spacing;
+    field.m_size = glm::uvec3(header.size[0], header.size[1], header.size[2]);
+    field.m_sourceHash = header.sourceHash;
+    return true;
+}
+
+
+bool WriteSignedDistanceField(FILE* file, const SignedDistanceField& field)
+{
+    SignedDistanceFieldCacheHeader header{{'S', 'D', 'F', 'X'},
+                                          SDF_CACHE_VERSION,
+                                          field.m_sourceHash,
+                                          {field.m_origin.x, field.m_origin.y, field.m_origin.z},
+                                          field.m_spacing,
+                                          {field.m_size.x, field.m_size.y, field.m_size.z}};
+    return fwrite(&header, sizeof(header), 1, file) == 1 &&
+           fwrite(field.m_distances.data(), sizeof(float), field.m_distances.size(), file) == field.m_distances.size();
+}
@@ -0,0 +1,128 @@
+#ifndef SIGNEDDISTANCEFIELD_H
+#define SIGNEDDISTANCEFIELD_H
+
+#include "Math.h"
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cstdio>
+#include <filesystem>
+#include <vector>
+
+
+namespace fs = std::filesystem;
+
+
+// Signed distances of a closed triangle mesh sampled on a regular grid, negative inside the mesh.
+// The distances are exact close to the surface and propagated with a chamfer sweep further away.
+class SignedDistanceField
+{
+public:
+    // The grid covers the bounds of the mesh enlarged by a margin of a few samples
+    void Build(const std::vector<glm::vec3>& positions,
+               const std::vector<uint32_t>& indices,
+               const float& spacing,
+               const uint32_t& margin=4);
+
+    inline bool IsEmpty() const { return m_distances.empty(); }
+    inline float GetSpacing() const { return m_spacing; }
+    inline glm::uvec3 GetSize() const { return m_size; }
+    inline uint64_t GetSourceHash() const { return m_sourceHash; }
+    inline void SetSourceHash(const uint64_t& sourceHash) { m_sourceHash = sourceHash; }
+
+    inline BoundingBox GetBounds() const
+    {
+        return {m_origin, m_origin + m_spacing * glm::vec3(m_size.x - 1, m_size.y - 1, m_size.z - 1)};
+    }
+
+    // Trilinear interpolation of the distance and its gradient. Outside of the grid, the distance
+    // to the grid is added to the distance at the closest point of the grid.
+    inline float Sample(const glm::vec3& point, glm::vec3& gradient) const
+    {
+        const BoundingBox bounds = GetBounds();
+        const glm::vec3 clamped = glm::clamp(point, bounds.min, bounds.max);
+        const glm::vec3 outside = point - clamped;
+
+        glm::vec3 coords = (clamped - m_origin) / m_spacing;
+        const uint32_t x = std::min(uint32_t(coords.x), m_size.x - 2);
+        const uint32_t y = std::min(uint32_t(coords.y), m_size.y - 2);
+        const uint32_t z = std::min(uint32_t(coords.z), m_size.z - 2);
+        const glm::vec3 f = coords - glm::vec3(x, y, z);
+
+        const size_t sliceSize = size_t(m_size.x) * m_size.y;
+        const float* c = &m_distances[GetIndex(x, y, z)];
+        const float c000 = c[0],                  c100 = c[1];
+        const float c010 = c[m_size.x],           c110 = c[m_size.x + 1];
+        const float c001 = c[sliceSize],          c101 = c[sliceSize + 1];
+        const float c011 = c[sliceSize + m_size.x], c111 = c[sliceSize + m_size.x + 1];
+
+        const float c00 = c000 + (c100 - c000) * f.x, c10 = c010 + (c110 - c010) * f.x;
+        const float c01 = c001 + (c101 - c001) * f.x, c11 = c011 + (c111 - c011) * f.x;
+        const float c0 = c00 + (c10 - c00) * f.y, c1 = c01 + (c11 - c01) * f.y;
+        float distance = c0 + (c1 - c0) * f.z;
+
+        gradient.x = ((c100 - c000) * (1.0f - f.y) + (c110 - c010) * f.y) * (1.0f - f.z) +
+                     ((c101 - c001) * (1.0f - f.y) + (c111 - c011) * f.y) * f.z;
+        gradient.y = (c10 - c00) * (1.0f - f.z) + (c11 - c01) * f.z;
+        gradient.z = c1 - c0;
+        gradient /= m_spacing;
+
+        const float outsideDistance = glm::length(outside);
+        if (outsideDistance > 0.0f)
+        {
+            distance += outsideDistance;
+            gradient = outside / outsideDistance;
+        }
+
+        return distance;
+    }
+
+private:
+    friend bool LoadSignedDistanceFieldCache(const fs::path&, const uint64_t&, SignedDistanceField&);
+    friend bool SaveSignedDistanceFieldCache(const fs::path&, const SignedDistanceField&);
+    friend bool ReadSignedDistanceField(FILE*, const size_t&, SignedDistanceField&);
+    friend bool WriteSignedDistanceField(FILE*, const SignedDistanceField&);
+
+    inline size_t GetIndex(const uint32_t& x, const uint32_t& y, const uint32_t& z) const
+    {
+        return (size_t(z) * m_size.y + y) * m_size.x + x;
+    }
+
+    glm::vec3 m_origin = glm::vec3(0.0f);
+    float m_spacing = 1.0f;
+    glm::uvec3 m_size = {0, 0, 0};
+    std::vector<float> m_distances;
+
+    uint64_t m_sourceHash = 0;
+};
+
+
+// Fields stored next to their mesh, checked against the hash of the mesh and of the build settings
+#define SDF_CACHE_EXTENSION ".sdf"
+#define SDF_CACHE_VERSION 1
+
+struct SignedDistanceFieldCacheHeader
+{
+    char sign[4];
+    uint32_t version;
+    uint64_t sourceHash;
+    float origin[3];
+    float spacing;
+    uint32_t size[3];
+};
+
+
+fs::path GetSignedDistanceFieldCachePath(const fs::path& meshPath);
+
+// Returns false if the cache is missing, from another version or out of date with the source hash
+bool LoadSignedDistanceFieldCache(const fs::path& cachePath, const uint64_t& sourceHash, SignedDistanceField& field);
+bool SaveSignedDistanceFieldCache(const fs::path& cachePath, const SignedDistanceField& field);
+
+// Header and samples of a field inside a larger file (simulation snapshots), reading fails if the
+// samples would not fit in the remaining bytes
+bool ReadSignedDistanceField(FILE* file, const size_t& remainingSize, SignedDistanceField& field);
+bool WriteSignedDistanceField(FILE* file, const SignedDistanceField& field);
+
+
+#endif  // SIGNEDDISTANCEFIELD_H
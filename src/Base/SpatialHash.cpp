@@ -0,0 +1,133 @@
+#include "SpatialHash.h"
+
+#include <omp.h>
+
+#include <algorithm>
+
+
+void SpatialHash::Allocate(const uint32_t& entryCount)
+{
+    m_bucketCount = 1;
+    while (m_bucketCount < 2 * entryCount)
+        m_bucketCount <<= 1;
+
+    m_entryBuckets.resize(entryCount);
+    m_entryItems.resize(entryCount);
+}
+
+void SpatialHash::Build(const std::vector<glm::vec3>& points, const float& cellSize)
+{
+    m_cellSize = cellSize;
+    Allocate(points.size());
+
+    #pragma omp parallel for num_threads(omp_get_max_threads())
+    for (uint32_t i = 0 ; i < points.size() ; i++) {
+        m_entryBuckets[i] = GetBucket(GetCell(points[i]));
+        m_entryItems[i] = i;
+    }
+
+    Sort();
+}
+
+void SpatialHash::Build(const std::vector<BoundingBox>& boxes, const float& cellSize)
+{
+    m_cellSize = cellSize;
+    const uint32_t boxCount = boxes.size();
+
+    // Cells overlapped by each box, empty boxes have none
+    std::vector<uint32_t> cellOffsets(boxCount + 1, 0);
+    for (uint32_t i = 0 ; i < boxCount ; i++)
+    {
+        uint32_t cellCount = 0;
+        if (!boxes[i].IsEmpty())
+        {
+            glm::ivec3 range = GetCell(boxes[i].max) - GetCell(boxes[i].min) + glm::ivec3(1, 1, 1);
+            cellCount = range.x * range.y * range.z;
+        }
+        cellOffsets[i + 1] = cellOffsets[i] + cellCount;
+    }
+
+    // The buckets are sized from the number of cells, then the cells of a same box falling
+    // in the same bucket are merged into a single entry
+    Allocate(cellOffsets.back());
+    std::vector<uint32_t> cellBuckets(cellOffsets.back());
+    std::vector<uint32_t> entryOffsets(boxCount + 1, 0);
+
+    #pragma omp parallel for num_threads(omp_get_max_threads())
+    for (uint32_t i = 0 ; i < boxCount ; i++) {
+        if (boxes[i].IsEmpty())
+            continue;
+
+        const glm::ivec3 minCell = GetCell(boxes[i].min);
+        const glm::ivec3 maxCell = GetCell(boxes[i].max);
+        uint32_t* buckets = &cellBuckets[cellOffsets[i]];
+        uint32_t count = 0;
+        for (int z = minCell.z ; z <= maxCell.z ; z++)
+        for (int y = minCell.y ; y <= maxCell.y ; y++)
+        for (int x = minCell.x ; x <= maxCell.x ; x++)
+            buckets[count++] = GetBucket(glm::ivec3(x, y, z));
+
+        std::sort(buckets, buckets + count);
+        entryOffsets[i + 1] = std::unique(buckets, buckets + count) - buckets;
+    }
+
+    for (uint32_t i = 0 ; i < boxCount ; i++)
+        entryOffsets[i + 1] += entryOffsets[i];
+    m_entryBuckets.resize(entryOffsets.back());
+    m_entryItems.resize(entryOffsets.back());
+
+    #pragma omp parallel for num_threads(omp_get_max_threads())
+    for (uint32_t i = 0 ; i < boxCount ; i++) {
+        for (uint32_t j = entryOffsets[i] ; j < entryOffsets[i + 1] ; j++)
+        {
+            m_entryBuckets[j] = cellBuckets[cellOffsets[i] + j - entryOffsets[i]];
+            m_entryItems[j] = i;
+        }
+    }
+
+    Sort();
+}
+
+void SpatialHash::Sort()
+{
+    const uint32_t entryCount = m_entryBuckets.size();
+
+    // Chunks of consecutive entries, each counting then scattering its own entries
+    const uint32_t chunkCount = std::max(1u, std::min<uint32_t>(omp_get_max_threads(), entryCount / 4096));
+    const uint32_t chunkSize = (entryCount + chunkCount - 1) / chunkCount;
+    m_chunkOffsets.assign(size_t(chunkCount) * m_bucketCount, 0);
+
+    #pragma omp parallel for num_threads(chunkCount)
+    for (uint32_t chunk = 0 ; chunk < chunkCount ; chunk++) {
+        uint32_t* counts = &m_chunkOffsets[size_t(chunk) * m_bucketCount];
+        const uint32_t end = std::min(entryCount, (chunk + 1) * chunkSize);
+        for (uint32_t i = chunk * chunkSize ; i < end ; i++)
+            counts[m_entryBuckets[i]]++;
+    }
+
+    // Exclusive prefix sum in bucket then chunk order, keeping the entries in their original order inside a bucket
+    m_bucketOffsets.resize(m_bucketCount + 1);
+    uint32_t offset = 0;
+    for (uint32_t bucket = 0 ; bucket < m_bucketCount ; bucket++)
+    {
+        m_bucketOffsets[bucket] = offset;
+        for (uint32_t chunk = 0 ; chunk < chunkCount ; chunk++)
+        {
+            uint32_t& count = m_chunkOffsets[size_t(chunk) * m_bucketCount + bucket];
+            const uint32_t chunkEntries = count;
+            count = offset;
+            offset += chunkEntries;
+        }
+    }
+    m_bucketOffsets[m_bucketCount] = offset;
+
+    m_items.resize(entryCount);
+
+    #pragma omp parallel for num_threads(chunkCount)
+    for (uint32_t chunk = 0 ; chunk < chunkCount ; chunk++) {
+        uint32_t* offsets = &m_chunkOffsets[size_t(chunk) * m_bucketCount];
+        const uint32_t end = std::min(entryCount, (chunk + 1) * chunkSize);
+        for (uint32_t i = chunk * chunkSize ; i < end ; i++)
+            m_items[offsets[m_entryBuckets[i]]++] = m_entryItems[i];
+    }
+}
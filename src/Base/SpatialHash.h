@@ -0,0 +1,97 @@
+#ifndef SPATIALHASH_H
+#define SPATIALHASH_H
+
+#include "Math.h"
+
+#include <glm/glm.hpp>
+
+#include <vector>
+
+
+// Uniform grid whose cells are hashed into a power of two number of buckets. The items are sorted by
+// bucket with a parallel counting sort, in increasing index order inside a bucket whatever the number
+// of threads. Different cells can share a bucket, so queries return candidates to be tested by the caller.
+class SpatialHash
+{
+public:
+    // Points are inserted in the cell containing them
+    void Build(const std::vector<glm::vec3>& points, const float& cellSize);
+    // Boxes are inserted in every bucket of the cells they overlap, once per bucket
+    void Build(const std::vector<BoundingBox>& boxes, const float& cellSize);
+
+    inline bool IsEmpty() const { return m_items.empty(); }
+    inline float GetCellSize() const { return m_cellSize; }
+
+    inline glm::ivec3 GetCell(const glm::vec3& point) const
+    {
+        return glm::ivec3(glm::floor(point / m_cellSize));
+    }
+
+    inline uint32_t GetBucket(const glm::ivec3& cell) const
+    {
+        uint32_t hash = (uint32_t(cell.x) * 92837111u) ^ (uint32_t(cell.y) * 689287499u) ^ (uint32_t(cell.z) * 283923481u);
+        return hash & (m_bucketCount - 1);
+    }
+
+    // Items of the bucket of the cell containing a point
+    template<typename Fn>
+    void ForEachInCell(const glm::vec3& point, Fn&& fn) const
+    {
+        if (m_items.empty())
+            return;
+
+        uint32_t bucket = GetBucket(GetCell(point));
+        for (uint32_t i = m_bucketOffsets[bucket] ; i < m_bucketOffsets[bucket + 1] ; i++)
+            fn(m_items[i]);
+    }
+
+    // Items of the buckets of the cells overlapping a sphere, each bucket being visited once
+    // as long as the radius does not exceed the cell size
+    template<typename Fn>
+    void ForEachInRadius(const glm::vec3& center, const float& radius, Fn&& fn) const
+    {
+        if (m_items.empty())
+            return;
+
+        const glm::ivec3 minCell = GetCell(center - glm::vec3(radius));
+        const glm::ivec3 maxCell = GetCell(center + glm::vec3(radius));
+
+        uint32_t visited[27];
+        uint32_t visitedCount = 0;
+        for (int z = minCell.z ; z <= maxCell.z ; z++)
+        for (int y = minCell.y ; y <= maxCell.y ; y++)
+        for (int x = minCell.x ; x <= maxCell.x ; x++)
+        {
+            uint32_t bucket = GetBucket(glm::ivec3(x, y, z));
+
+            bool seen = false;
+            for (uint32_t i = 0 ; i < visitedCount && !seen ; i++)
+                seen = visited[i] == bucket;
+            if (seen)
+                continue;
+            if (visitedCount < 27)
+                visited[visitedCount++] = bucket;
+
+            for (uint32_t i = m_bucketOffsets[bucket] ; i < m_bucketOffsets[bucket + 1] ; i++)
+                fn(m_items[i]);
+        }
+    }
+
+private:
+    void Allocate(const uint32_t& entryCount);
+    void Sort();
+
+    float m_cellSize = 1.0f;
+    uint32_t m_bucketCount = 1;
+
+    std::vector<uint32_t> m_bucketOffsets;
+    std::vector<uint32_t> m_items;
+
+    // Bucket and item of each entry before the sort, and per chunk bucket counts
+    std::vector<uint32_t> m_entryBuckets;
+    std::vector<uint32_t> m_entryItems;
+    std::vector<uint32_t> m_chunkOffsets;
+};
+
+
+#endif  // SPATIALHASH_H
@@ -92,6 +92,7 @@ public:
     void Bind() const;
     void Unbind() const;
     bool IsValid() const;
+    inline GLuint GetId() const { return m_id; }
 
     VertexBufferLayout GetLayout() const;
     void SetLayout(const VertexBufferLayout& layout);
@@ -0,0 +1,438 @@
+#include "bccReader.h"
+
+#include "FibersCache.h"
+#include "Hash.h"
+#include "Logging.h"
+
+#include <glad/glad.h>
+#include <omp.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <limits>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+
+static bool ValidateBCCHeader(const BCCHeader& header)
+{
+    ASSERT_OR_RETURN(header.sign[0] == 'B' &&
+                     header.sign[1] == 'C' &&
+                     header.sign[2] == 'C' &&
+                     header.byteCount == 0x44, false, "Invalid BCC format !");
+    ASSERT_OR_RETURN(header.curveType[0] == 'C', false, "Invalid Curve type !");
+    ASSERT_OR_RETURN(header.curveType[1] == '0', false, "Invalid Curve parametrisation!");
+    ASSERT_OR_RETURN(header.dimensions == 3, false, "Invalid number of dimensions !");
+
+    return true;
+}
+
+
+// == BCCFile ==
+
+BCCFile::BCCFile(const fs::path& filePath)
+{
+    Open(filePath);
+}
+
+BCCFile::~BCCFile()
+{
+    Close();
+}
+
+bool BCCFile::Open(const fs::path& filePath)
+{
+    Close();
+
+#ifdef _WIN32
+    std::ifstream file(filePath, std::ios::binary | std::ios::ate);
+    if (!file)
+    {
+        LOG_ERROR("Impossible to open the file %s !", filePath.string().c_str());
+        return false;
+    }
+
+    m_buffer.resize(file.tellg());
+    file.seekg(0);
+    file.read(m_buffer.data(), m_buffer.size());
+    m_data = m_buffer.data();
+    m_size = m_buffer.size();
+#else
+    int fd = open(filePath.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        LOG_ERROR("Impossible to open the file %s !", filePath.c_str());
+        return false;
+    }
+
+    struct stat fileStat;
+    if (fstat(fd, &fileStat) < 0 || fileStat.st_size == 0)
+    {
+        LOG_ERROR("Impossible to read the file %s !", filePath.c_str());
+        close(fd);
+        return false;
+    }
+
+    void* mapping = mmap(nullptr, fileStat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);  // The mapping keeps its own reference to the file
+    if (mapping == MAP_FAILED)
+    {
+        LOG_ERROR("Impossible to map the file %s !", filePath.c_str());
+        return false;
+    }
+
+    // The file is read front to back, let the kernel read ahead aggressively
+    madvise(mapping, fileStat.st_size, MADV_SEQUENTIAL);
+    m_data = static_cast<const char*>(mapping);
+    m_size = fileStat.st_size;
+#endif
+
+    if (!ReadCurveTable())
+    {
+        Close();
+        return false;
+    }
+
+    return true;
+}
+
+void BCCFile::Close()
+{
+#ifdef _WIN32
+    m_buffer.clear();
+    m_buffer.shrink_to_fit();
+#else
+    if (m_data)
+        munmap(const_cast<char*>(m_data), m_size);
+#endif
+
+    m_data = nullptr;
+    m_size = 0;
+    m_curves.clear();
+    m_controlPointCount = 0;
+}
+
+bool BCCFile::ReadCurveTable()
+{
+    ASSERT_OR_RETURN(m_size >= sizeof(BCCHeader), false, "Invalid BCC format : file too small !");
+
+    const BCCHeader& header = GetHeader();
+    if (!ValidateBCCHeader(header))
+        return false;
+
+    // Walk the per-curve headers once to locate every curve inside the mapping
+    m_curves.clear();
+    m_curves.reserve(header.curveCount);
+    size_t offset = sizeof(BCCHeader);
+    for (uint64_t id = 0 ; id < header.curveCount ; id++)
+    {
+        ASSERT_OR_RETURN(offset + sizeof(int32_t) <= m_size, false, "Invalid BCC format : truncated curve %lu !", id);
+
+        int32_t nbCP;
+        std::memcpy(&nbCP, m_data + offset, sizeof(int32_t));
+        offset += sizeof(int32_t);
+
+        uint32_t pointCount = std::abs(nbCP);
+        ASSERT_OR_RETURN(offset + pointCount * sizeof(glm::vec3) <= m_size, false, "Invalid BCC format : truncated curve %lu !", id);
+
+        m_curves.push_back({reinterpret_cast<const glm::vec3*>(m_data + offset), pointCount, nbCP < 0});
+        m_controlPointCount += pointCount;
+        offset += pointCount * sizeof(glm::vec3);
+    }
+
+    return true;
+}
+
+void BCCFile::CopyControlPoints(glm::vec3* destination) const
+{
+    for (const auto& curve : m_curves)
+    {
+        std::memcpy(destination, curve.points, curve.pointCount * sizeof(glm::vec3));
+        destination += curve.pointCount;
+    }
+}
+
+
+// == Streaming ==
+
+bool StreamBCCFile(const fs::path& filePath, const BCCChunkFn& consumer, const uint64_t& chunkPointCount, uint64_t* fileHash)
+{
+    FILE* file = fopen(filePath.c_str(), "rb");
+    ASSERT_OR_RETURN(file, false, "Impossible to open the file %s !", filePath.c_str());
+
+    BCCHeader header;
+    if (fread(&header, sizeof(header), 1, file) != 1 || !ValidateBCCHeader(header))
+    {
+        LOG_ERROR("Invalid BCC file %s !", filePath.c_str());
+        fclose(file);
+        return false;
+    }
+    StreamHash hash;
+    hash.Update(&header, sizeof(header));
+
+    // The buffer only grows past the chunk size to fit a single curve bigger than a chunk
+    const size_t bufferSize = std::max<uint64_t>(chunkPointCount, 1) * sizeof(glm::vec3) + sizeof(int32_t);
+    std::vector<char> buffer(bufferSize);
+    size_t begin = 0, end = 0;
+
+    BCCChunk chunk{&header, 0, 0, {}};
+    uint64_t curveId = 0;
+    bool success = true;
+    while (curveId < header.curveCount)
+    {
+        // Gather all the curves fully contained in the buffer
+        chunk.curves.clear();
+        uint64_t chunkPoints = 0;
+        size_t recordSize = sizeof(int32_t);
+        while (curveId < header.curveCount && end - begin >= sizeof(int32_t))
+        {
+            int32_t nbCP;
+            std::memcpy(&nbCP, buffer.data() + begin, sizeof(int32_t));
+            uint32_t pointCount = std::abs(nbCP);
+            recordSize = sizeof(int32_t) + pointCount * sizeof(glm::vec3);
+            if (end - begin < recordSize)
+                break;
+
+            chunk.curves.push_back({reinterpret_cast<const glm::vec3*>(buffer.data() + begin + sizeof(int32_t)), pointCount, nbCP < 0});
+            chunkPoints += pointCount;
+            begin += recordSize;
+            curveId++;
+        }
+
+        if (!chunk.curves.empty())
+        {
+            if (!consumer(chunk))
+            {
+                success = false;
+                break;
+            }
+
+            chunk.firstCurve += chunk.curves.size();
+            chunk.firstPoint += chunkPoints;
+
+            // Give back the memory taken by a curve bigger than a chunk once it has been consumed
+            if (buffer.size() > bufferSize && end - begin <= bufferSize)
+            {
+                std::memmove(buffer.data(), buffer.data() + begin, end - begin);
+                end -= begin;
+                begin = 0;
+                buffer.resize(bufferSize);
+                buffer.shrink_to_fit();
+            }
+            continue;
+        }
+
+        // Move the incomplete curve to the front of the buffer and read the next part of the file
+        std::memmove(buffer.data(), buffer.data() + begin, end - begin);
+        end -= begin;
+        begin = 0;
+        if (recordSize > buffer.size())
+            buffer.resize(recordSize);
+
+        size_t readSize = fread(buffer.data() + end, 1, buffer.size() - end, file);
+        if (readSize == 0)
+        {
+            LOG_ERROR("Invalid BCC format : %s is truncated at curve %lu !", filePath.c_str(), curveId);
+            success = false;
+            break;
+        }
+        hash.Update(buffer.data() + end, readSize);
+        end += readSize;
+    }
+
+    // Hash whatever follows the last curve so that the hash covers the whole file
+    if (success && fileHash)
+    {
+        size_t readSize;
+        while ((readSize = fread(buffer.data(), 1, buffer.size(), file)) > 0)
+            hash.Update(buffer.data(), readSize);
+        *fileHash = hash.Get();
+    }
+
+    fclose(file);
+    return success;
+}
+
+
+// == Loading functions ==
+
+void readBCC(const std::string& filename, std::vector<std::vector<glm::vec3>>& closedFibersCP, std::vector<std::vector<glm::vec3>>& openFibersCP)
+{
+    closedFibersCP.clear();
+    openFibersCP.clear();
+
+    BCCFile file(filename);
+    if (!file.IsValid())
+        return;
+
+    for (const auto& curve : file.GetCurves())
+    {
+        auto& fibers = curve.isClosed ? closedFibersCP : openFibersCP;
+        fibers.emplace_back(curve.points, curve.points + curve.pointCount);
+    }
+
+    LOG_INFO("Successfully loaded %d open curves and %d closed curves", openFibersCP.size(), closedFibersCP.size());
+}
+
+
+// Number of patches needed to draw every segment of a curve
+inline uint32_t CurvePatchCount(const BCCCurve& curve)
+{
+    if (curve.pointCount < 2)
+        return 0;
+
+    // Closed curves also need the segment going from the last point back to the first one
+    return (curve.isClosed && curve.pointCount > 2) ? curve.pointCount : curve.pointCount - 1;
+}
+
+
+bool LoadBCCFile(const std::string& filePath, FibersData& fibers, const bool& useCache)
+{
+    auto startTime = std::chrono::steady_clock::now();
+
+    fibers = FibersData();
+
+    // The file is only hashed up front to check an existing cache, otherwise the hash
+    // is computed while the file is streamed
+    fs::path cachePath = GetFibersCachePath(filePath);
+    if (useCache && fs::exists(cachePath) && LoadFibersCache(cachePath, HashFile(filePath), fibers))
+    {
+        double elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+        LOG_INFO("Loaded %lu curves (%lu control points) from %s in %.2fms",
+                 fibers.curves.size(), fibers.controlPoints.size(), cachePath.filename().c_str(), elapsed);
+        return true;
+    }
+
+    uint64_t closedCount = 0;
+    std::vector<uint64_t> patchOffsets;
+    auto appendChunk = [&](const BCCChunk& chunk) {
+        const auto& curves = chunk.curves;
+        const size_t firstCurve = fibers.curves.size();
+
+        if (chunk.firstCurve == 0)
+        {
+            // Every control point takes at least 12 bytes of the file, which bounds the reservation on corrupted headers
+            std::error_code error;
+            uint64_t maxPointCount = fs::file_size(filePath, error) / sizeof(glm::vec3);
+            uint64_t pointCount = std::min(chunk.header->totalControlPointCount, maxPointCount);
+            uint64_t curveCount = std::min(chunk.header->curveCount, maxPointCount);
+            fibers.controlPoints.reserve(pointCount);
+            fibers.indices.reserve(pointCount * 4);
+            fibers.curves.reserve(curveCount);
+            fibers.curveBounds.reserve(curveCount);
+        }
+
+        // Pass 1 : exclusive prefix sums of the curve sizes to know where each curve lands in the outputs
+        patchOffsets.resize(curves.size() + 1);
+        patchOffsets[0] = fibers.indices.size() / 4;
+        uint64_t pointOffset = fibers.controlPoints.size();
+        for (size_t i = 0 ; i < curves.size() ; i++)
+        {
+            fibers.curves.push_back({(uint32_t)pointOffset, curves[i].pointCount, curves[i].isClosed});
+            pointOffset += curves[i].pointCount;
+            patchOffsets[i + 1] = patchOffsets[i] + CurvePatchCount(curves[i]);
+            closedCount += curves[i].isClosed;
+        }
+
+        ASSERT_OR_RETURN(pointOffset <= std::numeric_limits<uint32_t>::max(), false,
+                         "Too many control points in %s to be indexed on 32 bits !", filePath.c_str());
+
+        fibers.controlPoints.resize(pointOffset);
+        fibers.indices.resize(patchOffsets.back() * 4);
+        fibers.curveBounds.resize(fibers.curves.size());
+
+        // Pass 2 : every curve writes its own range of the outputs, so they can all be filled in parallel
+        #pragma omp parallel for schedule(dynamic, 64) num_threads(omp_get_max_threads())
+        for (int64_t i = 0 ; i < (int64_t)curves.size() ; i++)
+        {
+            const auto& curve = curves[i];
+            const int64_t first = fibers.curves[firstCurve + i].offset;
+            const int64_t count = curve.pointCount;
+            std::memcpy(fibers.controlPoints.data() + first, curve.points, count * sizeof(glm::vec3));
+            for (int64_t p = 0 ; p < count ; p++)
+                fibers.curveBounds[firstCurve + i].Expand(curve.points[p]);
+
+            // One patch per segment, the windows never leave the curve : they wrap around on closed
+            // curves and repeat the end points on open ones
+            bool wrap = CurvePatchCount(curve) == curve.pointCount;
+            uint32_t* patch = fibers.indices.data() + patchOffsets[i] * 4;
+            for (int64_t segment = 0 ; segment < (int64_t)(patchOffsets[i + 1] - patchOffsets[i]) ; segment++)
+            {
+                for (int64_t k = 0 ; k < 4 ; k++)
+                {
+                    int64_t index = segment - 1 + k;
+                    index = wrap ? (index + count) % count : std::clamp<int64_t>(index, 0, count - 1);
+                    *patch++ = first + index;
+                }
+            }
+        }
+
+        return true;
+    };
+
+    if (!StreamBCCFile(filePath, appendChunk, 1 << 20, &fibers.sourceHash))
+    {
+        fibers = FibersData();
+        return false;
+    }
+
+    // Number of patches the former sliding window over the merged curves (closed curves
+    // having their first point repeated) would have generated
+    uint64_t curveCount = fibers.curves.size();
+    uint64_t mergedCount = fibers.controlPoints.size() + closedCount;
+    uint64_t slidingCount = mergedCount >= 4 ? mergedCount - 3 : 0;
+    uint64_t patchCount = fibers.indices.size() / 4;
+
+    double elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+    LOG_INFO("Loaded %lu curves (%lu control points) from %s in %.2fms",
+             curveCount, fibers.controlPoints.size(), fs::path(filePath).filename().c_str(), elapsed);
+    LOG_INFO("Generated %lu patches instead of %lu with a sliding window over the merged curves (%+ld patches)",
+             patchCount, slidingCount, (int64_t)patchCount - (int64_t)slidingCount);
+
+    if (useCache)
+        SaveFibersCache(cachePath, fibers);
+
+    return true;
+}
+
+
+VertexArrayPtr LoadBCCToOpenGL(const std::vector<glm::vec3>& controlPoints, const std::vector<uint32_t>& indices, QuantizedPositions& positions)
+{
+    // Send the fibers data to OpenGL
+    auto vertexBuffer = VertexBuffer::Create();
+    vertexBuffer->Bind();
+    UploadPositions(vertexBuffer, controlPoints, positions);
+    vertexBuffer->Unbind();
+    vertexBuffer->SetLayout(GetPositionLayout(positions.storage));
+    auto indexBuffer = IndexBuffer::Create(indices.data(),
+                                                 indices.size());
+    auto vertexArray = VertexArray::Create();
+    vertexArray->Bind();
+    vertexArray->AddVertexBuffer(vertexBuffer);
+    vertexArray->SetIndexBuffer(indexBuffer);
+    vertexArray->Unbind();
+
+    return vertexArray;
+}
+
+
+std::vector<fs::path> ListBCCFiles(const fs::path& directory)
+{
+    std::vector<fs::path> result;
+    for (const auto& entry : fs::directory_iterator(directory))
+    {
+        if (entry.path().extension() == ".bcc")
+        {
+            result.push_back(entry.path());
+        }
+    }
+
+    return result;
+}
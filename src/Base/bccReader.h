@@ -1,15 +1,16 @@
 #ifndef BCC_H
 #define BCC_H
 
-#include "Logging.h"
+#include "FiberCurve.h"
+#include "Math.h"
+#include "Quantization.h"
 #include "VertexArray.h"
-#include "VertexBuffer.h"
 
-#include <glad/glad.h>
 #include <glm/glm.hpp>
 
+#include <functional>
 #include <vector>
-#include <iostream>
+#include <string>
 #include <filesystem>
 
 
@@ -28,126 +29,101 @@ struct BCCHeader
     char fileInfo[40];
 };
 
-void readBCC(const std::string& filename, std::vector<std::vector<glm::vec3>>& closedFibersCP, std::vector<std::vector<glm::vec3>>& openFibersCP)
+
+// A curve of a BCC file, its control points point directly into the file mapping
+struct BCCCurve
 {
-    BCCHeader header;
-    closedFibersCP.clear();
-    openFibersCP.clear();
-    bool openIsEmpty = true, closedIsEmpty = true;
-    FILE *pFile = fopen(filename.c_str(),"rb");
-    if( pFile == NULL )
-    {
-        LOG_ERROR("Impossible to open the file %s !", filename.c_str());
-    }
-
-    fread(&header, sizeof(header), 1, pFile);
-    if (header.sign[0] != 'B' ||
-        header.sign[1] != 'C' ||
-        header.sign[2] != 'C' ||
-        header.byteCount != 0x44 )   { LOG_ERROR("Invalid BCC format !"); }
-    if (header.curveType[0] != 'C' ) { LOG_ERROR("Invalid Curve type !"); }
-    if (header.curveType[1] != '0' ) { LOG_ERROR("Invalid Curve parametrisation!"); }
-    if (header.dimensions != 3 )     { LOG_ERROR("Invalid number of dimensions !"); }
-
-    for (uint64_t id = 0 ; id < header.curveCount ; id++)
-    {
-        int nbCP;
-        fread(&nbCP,sizeof(int),1,pFile);
-        if (nbCP < 0)
-        {
-            nbCP = -nbCP;
-            std::vector<glm::vec3> curveData(nbCP);
-            for (uint64_t cpid = 0 ; cpid < nbCP ; cpid ++ )
-            {
-                glm::vec3 point;
-                fread(&point,sizeof(float),3,pFile);
-                curveData[cpid]=point;
-            }
-            closedFibersCP.emplace_back(curveData);
-        }
-        else
-        {
-            std::vector<glm::vec3> curveData(nbCP);
-            for (uint64_t cpid = 0 ; cpid < nbCP ; cpid ++ )
-            {
-                glm::vec3 point;
-                fread(&point,sizeof(float),3,pFile);
-                curveData[cpid]=point;
-            }
-            openFibersCP.emplace_back(curveData);
-        }
-    }
-    
-    LOG_INFO("Successfully loaded %d open curves and %d closed curves", openFibersCP.size(), closedFibersCP.size());
-}
-
-
-void LoadBCCFile(const std::string& filePath, std::vector<glm::vec3>& controlPoints, std::vector<uint32_t>& indices)
+    const glm::vec3* points;
+    uint32_t pointCount;
+    bool isClosed;
+};
+
+
+// Read-only memory mapping of a BCC file giving direct access to its curves
+class BCCFile
 {
-    std::vector<std::vector<glm::vec3>> closedFibersCP;
-    std::vector<std::vector<glm::vec3>> openFibersCP;
-    readBCC(filePath, closedFibersCP, openFibersCP);
-
-    controlPoints.clear();
-    indices.clear();
-
-    // Merge all the curves into a single vector to draw all of them in a single drawcall
-    // This need to be replaced by the proper loading of the fiber data
-    for (const auto& fiber : closedFibersCP)
-    {
-        for (const auto& cPoints : fiber)
-            controlPoints.push_back(cPoints);
-        controlPoints.push_back(fiber.front());
-    }
-    for (const auto& fiber : openFibersCP)
-        for (const auto& cPoints : fiber)
-            controlPoints.push_back(cPoints);
-
-    uint32_t vertexCount = controlPoints.size();
-
-    for (size_t i = 0 ; i < vertexCount - 3 ; i++)
-    {
-        indices.push_back(i);
-        indices.push_back(i+1);
-        indices.push_back(i+2);
-        indices.push_back(i+3);
-    }
-}
-
-
-VertexArrayPtr LoadBCCToOpenGL(const std::vector<glm::vec3>& controlPoints, const std::vector<uint32_t>& indices)
+public:
+    BCCFile() = default;
+    explicit BCCFile(const fs::path& filePath);
+    ~BCCFile();
+
+    BCCFile(const BCCFile&) = delete;
+    BCCFile& operator=(const BCCFile&) = delete;
+
+    bool Open(const fs::path& filePath);
+    void Close();
+    inline bool IsValid() const { return m_data != nullptr; }
+
+    inline const BCCHeader& GetHeader() const { return *reinterpret_cast<const BCCHeader*>(m_data); }
+    inline const std::vector<BCCCurve>& GetCurves() const { return m_curves; }
+    inline uint64_t GetControlPointCount() const { return m_controlPointCount; }
+    inline const char* GetData() const { return m_data; }
+    inline size_t GetSize() const { return m_size; }
+
+    // Copy the control points of all the curves (in file order) into a buffer
+    // that must be able to hold GetControlPointCount() points
+    void CopyControlPoints(glm::vec3* destination) const;
+
+private:
+    bool ReadCurveTable();
+
+    const char* m_data = nullptr;
+    size_t m_size = 0;
+#ifdef _WIN32
+    std::vector<char> m_buffer;
+#endif
+
+    std::vector<BCCCurve> m_curves;
+    uint64_t m_controlPointCount = 0;
+};
+
+
+// Consecutive whole curves of a BCC file, only valid during the consumer call
+struct BCCChunk
 {
-    // Send the fibers data to OpenGL
-    auto vertexBuffer = VertexBuffer::Create(controlPoints.data(), 
-                                             controlPoints.size() * sizeof(glm::vec3));
-    vertexBuffer->SetLayout({{"Position",  3, GL_FLOAT, false}});
-    auto indexBuffer = IndexBuffer::Create(indices.data(), 
-                                                 indices.size());
-    auto vertexArray = VertexArray::Create();
-    vertexArray->Bind();
-    vertexArray->AddVertexBuffer(vertexBuffer);
-    vertexArray->SetIndexBuffer(indexBuffer);
-    vertexArray->Unbind();
-
-    return vertexArray;
-}
-
-
-std::vector<fs::path> ListBCCFiles(const fs::path& directory)
+    const BCCHeader* header;
+    uint64_t firstCurve;
+    uint64_t firstPoint;
+    std::vector<BCCCurve> curves;
+};
+
+// Returns false to stop the streaming
+using BCCChunkFn = std::function<bool(const BCCChunk&)>;
+
+// Walk a BCC file front to back through a fixed size buffer, handing chunks of at most
+// chunkPointCount control points (or a single bigger curve) to the consumer.
+// The memory used stays bounded by the chunk size whatever the size of the file.
+// When fileHash is given it receives HashFile of the file, computed on the blocks as they are read.
+bool StreamBCCFile(const fs::path& filePath, const BCCChunkFn& consumer, const uint64_t& chunkPointCount=1 << 20,
+                   uint64_t* fileHash=nullptr);
+
+
+// Fibers ready to be drawn as GL_PATCHES of 4 control points
+struct FibersData
 {
-    std::vector<fs::path> result; 
-    for (const auto& entry : fs::directory_iterator(directory))
-    {
-        if (entry.path().extension() == ".bcc")
-        {
-            result.push_back(entry.path());
-        }
-    }
+    std::vector<glm::vec3> controlPoints;
+    std::vector<uint32_t> indices;
+    std::vector<FiberCurve> curves;
+    std::vector<BoundingBox> curveBounds;
+
+    uint64_t sourceHash = 0;  // Hash of the BCC file content
+};
+
+
+void readBCC(const std::string& filename,
+             std::vector<std::vector<glm::vec3>>& closedFibersCP,
+             std::vector<std::vector<glm::vec3>>& openFibersCP);
 
-    return result;
-}
+// Load the fibers from the .bccx cache next to the file when it is up to date, parse the BCC file
+// and (re)write the cache otherwise
+bool LoadBCCFile(const std::string& filePath, FibersData& fibers, const bool& useCache=true);
 
+// Positions are stored with the storage of the quantized positions, which receive the decoding parameters
+VertexArrayPtr LoadBCCToOpenGL(const std::vector<glm::vec3>& controlPoints,
+                               const std::vector<uint32_t>& indices,
+                               QuantizedPositions& positions);
 
+std::vector<fs::path> ListBCCFiles(const fs::path& directory);
 
 
-#endif  // BCC_H
\ No newline at end of file
+#endif  // BCC_H
@@ -0,0 +1,76 @@
+#include "objReader.h"
+
+#include "Hash.h"
+#include "Logging.h"
+
+#include <tiny_obj_loader.h>
+
+#include <chrono>
+
+
+bool LoadOBJFile(const fs::path& filePath, std::vector<glm::vec3>& positions, std::vector<uint32_t>& indices)
+{
+    std::vector<tinyobj::shape_t> shapes;
+    std::vector<tinyobj::material_t> materials;
+    std::string error = tinyobj::LoadObj(shapes, materials, filePath.c_str(), (filePath.parent_path().string() + "/").c_str());
+    if (!error.empty())
+    {
+        LOG_ERROR("Could not load %s : %s", filePath.c_str(), error.c_str());
+        return false;
+    }
+
+    positions.clear();
+    indices.clear();
+    for (const auto& shape : shapes)
+    {
+        const uint32_t offset = positions.size();
+        for (uint32_t i = 0 ; i + 2 < shape.mesh.positions.size() ; i += 3)
+            positions.push_back(glm::vec3(shape.mesh.positions[i], shape.mesh.positions[i + 1], shape.mesh.positions[i + 2]));
+        for (const auto& index : shape.mesh.indices)
+            indices.push_back(offset + index);
+    }
+
+    return !indices.empty();
+}
+
+
+bool LoadOBJSignedDistanceField(const fs::path& filePath, const float& spacing, SignedDistanceField& field)
+{
+    uint64_t sourceHash = HashData(&spacing, sizeof(spacing), HashFile(filePath));
+    fs::path cachePath = GetSignedDistanceFieldCachePath(filePath);
+    if (LoadSignedDistanceFieldCache(cachePath, sourceHash, field))
+    {
+        LOG_INFO("Loaded the signed distance field of %s from its cache", filePath.filename().c_str());
+        return true;
+    }
+
+    std::vector<glm::vec3> positions;
+    std::vector<uint32_t> indices;
+    if (!LoadOBJFile(filePath, positions, indices))
+        return false;
+
+    auto start = std::chrono::high_resolution_clock::now();
+    field.Build(positions, indices, spacing);
+    field.SetSourceHash(sourceHash);
+    LOG_INFO("Built the signed distance field of %s in %.2fs", 
+             filePath.filename().c_str(), 
+             std::chrono::duration<float>(std::chrono::high_resolution_clock::now() - start).count());
+
+    SaveSignedDistanceFieldCache(cachePath, field);
+    return true;
+}
+
+
+std::vector<fs::path> ListOBJFiles(const fs::path& directory)
+{
+    std::vector<fs::path> result;
+    for (const auto& entry : fs::directory_iterator(directory))
+    {
+        if (entry.path().extension() == ".obj")
+        {
+            result.push_back(entry.path());
+        }
+    }
+
+    return result;
+}
@@ -0,0 +1,25 @@
+#ifndef OBJREADER_H
+#define OBJREADER_H
+
+#include "SignedDistanceField.h"
+
+#include <glm/glm.hpp>
+
+#include <filesystem>
+#include <vector>
+
+
+namespace fs = std::filesystem;
+
+
+// Positions and triangle indices of every shape of an OBJ file, merged into a single mesh
+bool LoadOBJFile(const fs::path& filePath, std::vector<glm::vec3>& positions, std::vector<uint32_t>& indices);
+
+// Signed distance field of an OBJ mesh, read from its cache when it is up to date with the file
+// and the spacing, built and cached otherwise
+bool LoadOBJSignedDistanceField(const fs::path& filePath, const float& spacing, SignedDistanceField& field);
+
+std::vector<fs::path> ListOBJFiles(const fs::path& directory);
+
+
+#endif  // OBJREADER_H
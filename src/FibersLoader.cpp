@@ -0,0 +1,115 @@
+#include "FibersLoader.h"
+
+#include "Base/Logging.h"
+
+
+FibersLoader::FibersLoader()
+{
+    m_thread = std::thread(&FibersLoader::Run, this);
+}
+
+FibersLoader::~FibersLoader()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_condition.notify_one();
+    m_thread.join();
+}
+
+void FibersLoader::Load(const fs::path& filePath,
+                        const std::vector<Vertex>& driverVertices,
+                        const std::vector<uint32_t>& driverIndices,
+                        const bool& bindWrap)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_request = {filePath, bindWrap ? driverVertices : std::vector<Vertex>(),
+                     bindWrap ? driverIndices : std::vector<uint32_t>(), bindWrap};
+        m_hasRequest = true;
+        m_hasResult = false;  // A result of an older request must not be swapped in anymore
+        m_loadingPath = filePath;
+        m_loading = true;
+        m_progress = 0.0f;
+    }
+    m_condition.notify_one();
+}
+
+fs::path FibersLoader::GetLoadingPath() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_loadingPath;
+}
+
+bool FibersLoader::Fetch(fs::path& filePath, FibersData& fibers, WrapDeformer& wrap)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!m_hasResult)
+        return false;
+
+    uint32_t smoothIterations = wrap.GetSmoothIterations();
+    filePath = m_resultPath;
+    fibers = std::move(m_resultFibers);
+    wrap = std::move(m_resultWrap);
+    wrap.SetSmoothIterations(smoothIterations);
+
+    m_resultFibers = FibersData();
+    m_resultWrap = WrapDeformer();
+    m_hasResult = false;
+    return true;
+}
+
+void FibersLoader::Run()
+{
+    while (true)
+    {
+        Request request;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_condition.wait(lock, [this]() { return m_stop || m_hasRequest; });
+            if (m_stop)
+                return;
+
+            request = std::move(m_request);
+            m_hasRequest = false;
+        }
+
+        // Abandon the current load as soon as a newer request comes in
+        auto isOutdated = [this]() {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            return m_hasRequest || m_stop;
+        };
+
+        FibersData fibers;
+        WrapDeformer wrap;
+        if (!LoadBCCFile(request.filePath, fibers))
+        {
+            LOG_ERROR("Could not load %s", request.filePath.c_str());
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (!m_hasRequest)
+                m_loading = false;
+            continue;
+        }
+        m_progress = request.bindWrap ? 0.1f : 1.0f;
+
+        if (request.bindWrap && !isOutdated())
+        {
+            wrap.InitializeCached(GetWrapCachePath(request.filePath), fibers.sourceHash,
+                                  fibers.controlPoints, request.driverVertices, request.driverIndices,
+                                  [this](const float& progress) { m_progress = 0.1f + 0.9f * progress; });
+            wrap.SetCurves(fibers.curves);
+        }
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_hasRequest || m_stop)
+            continue;
+
+        m_resultPath = request.filePath;
+        m_resultFibers = std::move(fibers);
+        m_resultWrap = std::move(wrap);
+        m_hasResult = true;
+        m_loading = false;
+        m_progress = 1.0f;
+    }
+}
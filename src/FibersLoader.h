@@ -0,0 +1,75 @@
+#ifndef FIBERSLOADER_H
+#define FIBERSLOADER_H
+
+
+#include "WrapDeformer.h"
+
+#include "Base/bccReader.h"
+#include "Base/Mesh.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+
+// Loads BCC files and binds them to the cloth on a worker thread, so that the
+// current fibers keep being rendered until the new ones are ready to be swapped in
+class FibersLoader
+{
+public:
+    FibersLoader();
+    ~FibersLoader();
+
+    FibersLoader(const FibersLoader&) = delete;
+    FibersLoader& operator=(const FibersLoader&) = delete;
+
+    // Start loading a file, replacing any pending request. The fibers are bound to the
+    // driver mesh when bindWrap is set, which should be in its rest pose as the bindings are cached
+    // per fibers file. The driver data is copied so the caller can keep updating it.
+    void Load(const fs::path& filePath,
+              const std::vector<Vertex>& driverVertices,
+              const std::vector<uint32_t>& driverIndices,
+              const bool& bindWrap);
+
+    inline bool IsLoading() const { return m_loading; }
+    inline float GetProgress() const { return m_progress; }
+    fs::path GetLoadingPath() const;
+
+    // Move the result of a completed load into the given objects, to be called between two frames.
+    // The deformer is left uninitialized if the binding was not requested.
+    bool Fetch(fs::path& filePath, FibersData& fibers, WrapDeformer& wrap);
+
+private:
+    void Run();
+
+    struct Request
+    {
+        fs::path filePath;
+        std::vector<Vertex> driverVertices;
+        std::vector<uint32_t> driverIndices;
+        bool bindWrap;
+    };
+
+    std::thread m_thread;
+    mutable std::mutex m_mutex;
+    std::condition_variable m_condition;
+    bool m_stop = false;
+
+    // Latest request not yet picked up by the worker
+    bool m_hasRequest = false;
+    Request m_request;
+    fs::path m_loadingPath;
+
+    // Completed load waiting to be fetched
+    bool m_hasResult = false;
+    fs::path m_resultPath;
+    FibersData m_resultFibers;
+    WrapDeformer m_resultWrap;
+
+    std::atomic<bool> m_loading = false;
+    std::atomic<float> m_progress = 0.0f;
+};
+
+
+#endif  // FIBERSLOADER_H
@@ -0,0 +1,267 @@
+#include "GpuWrapDeformer.h"
+
+#include "Base/Logging.h"
+#include "Base/Quantization.h"
+#include "Base/Resolver.h"
+
+#include <algorithm>
+#include <chrono>
+#include <stdexcept>
+#include <string>
+
+
+static void SetTextureBuffer(const GLuint& texture, const GLuint& buffer, const GLenum& format,
+                             const void* data, const size_t& size, const GLenum& usage)
+{
+    glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+    glBufferData(GL_TEXTURE_BUFFER, size, data, usage);
+    glBindTexture(GL_TEXTURE_BUFFER, texture);
+    glTexBuffer(GL_TEXTURE_BUFFER, format, buffer);
+}
+
+static void AttachTextureBuffer(const GLuint& program, const char* name, const GLuint& texture, const GLint& unit)
+{
+    glActiveTexture(GL_TEXTURE0 + unit);
+    glBindTexture(GL_TEXTURE_BUFFER, texture);
+    glUniform1i(glGetUniformLocation(program, name), unit);
+}
+
+
+GpuWrapDeformer::~GpuWrapDeformer()
+{
+    Release();
+    if (m_deformShader.ID)
+        glDeleteProgram(m_deformShader.ID);
+    if (m_smoothShader.ID)
+        glDeleteProgram(m_smoothShader.ID);
+    if (m_emptyVertexArray)
+        glDeleteVertexArrays(1, &m_emptyVertexArray);
+}
+
+bool GpuWrapDeformer::BuildPrograms()
+{
+    if (m_deformShader.ID && m_smoothShader.ID)
+        return true;
+
+    // Vertex only programs whose position output is captured by the transform feedback
+    Resolver& resolver = Resolver::Get();
+    try
+    {
+        if (!m_deformShader.ID)
+            m_deformShader = Shader(resolver.Resolve("src/shaders/wrapDeform.vs.glsl").c_str(), nullptr,
+                                    nullptr, nullptr, nullptr, {"vPosition"});
+        if (!m_smoothShader.ID)
+            m_smoothShader = Shader(resolver.Resolve("src/shaders/wrapSmooth.vs.glsl").c_str(), nullptr,
+                                    nullptr, nullptr, nullptr, {"vPosition"});
+    }
+    catch (const std::runtime_error& error)
+    {
+        LOG_ERROR("Could not build the GPU wrap deformer shaders : %s", error.what());
+        return false;
+    }
+
+    if (!m_emptyVertexArray)
+        glGenVertexArrays(1, &m_emptyVertexArray);
+
+    return true;
+}
+
+void GpuWrapDeformer::Release()
+{
+    if (m_buffers[0])
+    {
+        glDeleteTextures(BufferCount, m_textures);
+        glDeleteBuffers(BufferCount, m_buffers);
+        for (uint32_t i = 0 ; i < BufferCount ; i++)
+            m_buffers[i] = m_textures[i] = 0;
+    }
+
+    m_vertexArray.reset();
+    m_positionBuffer.reset();
+    m_pointCount = 0;
+    m_clothVertexCount = 0;
+    m_hasDeformed = false;
+}
+
+
+bool GpuWrapDeformer::Upload(const WrapDeformer& wrap, const std::vector<uint32_t>& driverIndices, IndexBufferPtr& fibersIndexBuffer)
+{
+    Release();
+    if (!wrap.IsInitialized() || !BuildPrograms())
+        return false;
+
+    const uint32_t pointCount = wrap.GetBindings().size();
+
+    // Previous and next point of each point along its curve, -1 at the ends of the open curves. The points are a
+    // single open curve without curves, and the closed curves need 3 points to wrap around, as in WrapDeformer.
+    std::vector<glm::ivec2> neighbours(pointCount, glm::ivec2(-1));
+    std::vector<FiberCurve> curves = wrap.GetCurves();
+    if (curves.empty())
+        curves.push_back({0, pointCount, 0});
+    for (const auto& curve : curves)
+    {
+        if (size_t(curve.offset) + curve.pointCount > pointCount)
+            continue;
+
+        for (uint32_t i = 0 ; i < curve.pointCount ; i++)
+        {
+            glm::ivec2& neighbour = neighbours[curve.offset + i];
+            if (i > 0)
+                neighbour.x = curve.offset + i - 1;
+            if (i + 1 < curve.pointCount)
+                neighbour.y = curve.offset + i + 1;
+        }
+        if (curve.isClosed && curve.pointCount >= 3)
+        {
+            neighbours[curve.offset].x = curve.offset + curve.pointCount - 1;
+            neighbours[curve.offset + curve.pointCount - 1].y = curve.offset;
+        }
+    }
+
+    glGenBuffers(BufferCount, m_buffers);
+    glGenTextures(BufferCount, m_textures);
+    SetTextureBuffer(m_textures[Bindings], m_buffers[Bindings], GL_R32UI,
+                     wrap.GetBindings().data(), pointCount * sizeof(uint32_t), GL_STATIC_DRAW);
+    SetTextureBuffer(m_textures[Coordinates], m_buffers[Coordinates], GL_RGBA32F,
+                     wrap.GetCoordinates().data(), pointCount * sizeof(glm::vec4), GL_STATIC_DRAW);
+    SetTextureBuffer(m_textures[RestPoints], m_buffers[RestPoints], GL_RGB32F,
+                     wrap.GetRestPoints().data(), pointCount * sizeof(glm::vec3), GL_STATIC_DRAW);
+    SetTextureBuffer(m_textures[Neighbours], m_buffers[Neighbours], GL_RG32I,
+                     neighbours.data(), pointCount * sizeof(glm::ivec2), GL_STATIC_DRAW);
+    SetTextureBuffer(m_textures[ClothIndices], m_buffers[ClothIndices], GL_R32UI,
+                     driverIndices.data(), driverIndices.size() * sizeof(uint32_t), GL_STATIC_DRAW);
+    SetTextureBuffer(m_textures[ClothPositions], m_buffers[ClothPositions], GL_RGB32F, nullptr, 0, GL_DYNAMIC_DRAW);
+    SetTextureBuffer(m_textures[Offsets0], m_buffers[Offsets0], GL_RGB32F, nullptr, pointCount * sizeof(glm::vec3), GL_DYNAMIC_COPY);
+    SetTextureBuffer(m_textures[Offsets1], m_buffers[Offsets1], GL_RGB32F, nullptr, pointCount * sizeof(glm::vec3), GL_DYNAMIC_COPY);
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+    // The rest points are drawn until the first deformation
+    m_positionBuffer = VertexBuffer::Create(wrap.GetRestPoints().data(), pointCount * sizeof(glm::vec3));
+    m_positionBuffer->SetLayout(GetPositionLayout(PositionStorage::Float32));
+    m_vertexArray = VertexArray::Create();
+    m_vertexArray->Bind();
+    m_vertexArray->AddVertexBuffer(m_positionBuffer);
+    m_vertexArray->SetIndexBuffer(fibersIndexBuffer);
+    m_vertexArray->Unbind();
+
+    m_pointCount = pointCount;
+    return true;
+}
+
+
+void GpuWrapDeformer::Deform(const std::vector<Vertex>& driverVertices, const uint32_t& smoothIterations)
+{
+    if (m_pointCount == 0)
+        return;
+
+    // Only the cloth positions go to the GPU every frame, the buffer is only reallocated when their count changes
+    m_clothPositions.resize(driverVertices.size());
+    for (size_t i = 0 ; i < driverVertices.size() ; i++)
+        m_clothPositions[i] = driverVertices[i].position;
+
+    glBindBuffer(GL_TEXTURE_BUFFER, m_buffers[ClothPositions]);
+    if (m_clothVertexCount != driverVertices.size())
+    {
+        m_clothVertexCount = driverVertices.size();
+        glBufferData(GL_TEXTURE_BUFFER, m_clothPositions.size() * sizeof(glm::vec3), m_clothPositions.data(), GL_DYNAMIC_DRAW);
+    }
+    else
+    {
+        glBufferSubData(GL_TEXTURE_BUFFER, 0, m_clothPositions.size() * sizeof(glm::vec3), m_clothPositions.data());
+    }
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+    const GLuint positionBuffer = m_positionBuffer->GetId();
+    auto runPass = [&](const GLuint& target) {
+        glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, target);
+        glBeginTransformFeedback(GL_POINTS);
+        glDrawArrays(GL_POINTS, 0, m_pointCount);
+        glEndTransformFeedback();
+    };
+
+    glEnable(GL_RASTERIZER_DISCARD);
+    glBindVertexArray(m_emptyVertexArray);
+
+    // Offsets from the rest points when they are smoothed afterwards, positions otherwise
+    m_deformShader.use();
+    AttachTextureBuffer(m_deformShader.ID, "uBindings", m_textures[Bindings], 0);
+    AttachTextureBuffer(m_deformShader.ID, "uCoordinates", m_textures[Coordinates], 1);
+    AttachTextureBuffer(m_deformShader.ID, "uRestPoints", m_textures[RestPoints], 2);
+    AttachTextureBuffer(m_deformShader.ID, "uClothIndices", m_textures[ClothIndices], 3);
+    AttachTextureBuffer(m_deformShader.ID, "uClothPositions", m_textures[ClothPositions], 4);
+    m_deformShader.setBool("uOutputOffsets", smoothIterations > 0);
+    runPass(smoothIterations > 0 ? m_buffers[Offsets0] : positionBuffer);
+
+    m_smoothShader.use();
+    AttachTextureBuffer(m_smoothShader.ID, "uNeighbours", m_textures[Neighbours], 1);
+    AttachTextureBuffer(m_smoothShader.ID, "uRestPoints", m_textures[RestPoints], 2);
+    for (uint32_t n = 0 ; n < smoothIterations ; n++)
+    {
+        const bool isLast = n + 1 == smoothIterations;
+        const uint32_t source = n % 2 == 0 ? Offsets0 : Offsets1;
+        const uint32_t target = n % 2 == 0 ? Offsets1 : Offsets0;
+        AttachTextureBuffer(m_smoothShader.ID, "uOffsets", m_textures[source], 0);
+        m_smoothShader.setBool("uOutputPositions", isLast);
+        runPass(isLast ? positionBuffer : m_buffers[target]);
+    }
+
+    glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0);
+    glBindVertexArray(0);
+    glDisable(GL_RASTERIZER_DISCARD);
+    glActiveTexture(GL_TEXTURE0);
+    glUseProgram(0);
+
+    m_hasDeformed = true;
+}
+
+
+void GpuWrapDeformer::ReadPositions(std::vector<glm::vec3>& positions) const
+{
+    positions.resize(m_pointCount);
+    if (m_pointCount == 0)
+        return;
+
+    m_positionBuffer->Bind();
+    glGetBufferSubData(GL_ARRAY_BUFFER, 0, m_pointCount * sizeof(glm::vec3), positions.data());
+    m_positionBuffer->Unbind();
+}
+
+
+WrapComparison CompareWrapDeformers(GpuWrapDeformer& gpuWrap,
+                                    WrapDeformer& wrap,
+                                    std::vector<glm::vec3> points,
+                                    const std::vector<Vertex>& driverVertices,
+                                    const std::vector<uint32_t>& driverIndices)
+{
+    using Clock = std::chrono::high_resolution_clock;
+
+    WrapComparison result;
+    if (!gpuWrap.IsUploaded())
+        return result;
+
+    auto start = Clock::now();
+    wrap.Deform(points, driverVertices, driverIndices);
+    result.cpuTime = std::chrono::duration<double>(Clock::now() - start).count();
+
+    glFinish();
+    start = Clock::now();
+    gpuWrap.Deform(driverVertices, wrap.GetSmoothIterations());
+    glFinish();
+    result.gpuTime = std::chrono::duration<double>(Clock::now() - start).count();
+
+    std::vector<glm::vec3> gpuPoints;
+    gpuWrap.ReadPositions(gpuPoints);
+    if (gpuPoints.size() != points.size() || points.empty())
+        return result;
+
+    double errorSum = 0.0;
+    for (size_t i = 0 ; i < points.size() ; i++)
+    {
+        const float error = glm::distance(points[i], gpuPoints[i]);
+        result.maxError = std::max(result.maxError, error);
+        errorSum += error;
+    }
+    result.meanError = errorSum / points.size();
+    return result;
+}
@@ -0,0 +1,91 @@
+#ifndef GPUWRAPDEFORMER_H
+#define GPUWRAPDEFORMER_H
+
+
+#include "WrapDeformer.h"
+
+#include "Base/Shader.h"
+#include "Base/VertexArray.h"
+
+#include <glad/glad.h>
+
+#include <vector>
+
+
+/*
+      GPU wrap deformation
+
+The bindings of a WrapDeformer are uploaded once as texture buffers, then every frame only the positions of
+the cloth are uploaded and the fibers are deformed by transform feedback passes over the points :
+    - wrapDeform.vs.glsl evaluates the binding of each point on its cloth triangle
+    - wrapSmooth.vs.glsl runs one smoothing iteration over the offsets from the rest points, reading the
+      previous and next points of the curve
+The last pass writes the positions to a float vertex buffer drawn with the fibers indices, so the deformed
+fibers never go through the CPU.
+*/
+
+class GpuWrapDeformer
+{
+public:
+    GpuWrapDeformer() = default;
+    ~GpuWrapDeformer();
+
+    GpuWrapDeformer(const GpuWrapDeformer&) = delete;
+    GpuWrapDeformer& operator=(const GpuWrapDeformer&) = delete;
+
+    // Upload the bindings and the curves of the deformer and the cloth triangles, to be called again whenever
+    // one of them changes. The fibers indices are drawn with the deformed positions. Returns false if the
+    // shaders could not be built.
+    bool Upload(const WrapDeformer& wrap, const std::vector<uint32_t>& driverIndices, IndexBufferPtr& fibersIndexBuffer);
+    inline bool IsUploaded() const { return m_pointCount > 0; }
+
+    // Upload the cloth positions and run the passes, same smoothing as WrapDeformer::Deform
+    void Deform(const std::vector<Vertex>& driverVertices, const uint32_t& smoothIterations);
+    inline bool HasDeformed() const { return m_hasDeformed; }
+
+    // Float positions, drawn without any decoding
+    inline const VertexArrayPtr& GetVertexArray() const { return m_vertexArray; }
+
+    // Read back the deformed positions, to compare them with the CPU deformer
+    void ReadPositions(std::vector<glm::vec3>& positions) const;
+
+private:
+    bool BuildPrograms();
+    void Release();
+
+    Shader m_deformShader;
+    Shader m_smoothShader;
+    GLuint m_emptyVertexArray = 0;  // The passes only read gl_VertexID
+
+    // Static data of the bindings, and the cloth positions updated every frame
+    enum BufferIndex { Bindings = 0, Coordinates, RestPoints, Neighbours, ClothIndices, ClothPositions, Offsets0, Offsets1, BufferCount };
+    GLuint m_buffers[BufferCount] = {};
+    GLuint m_textures[BufferCount] = {};
+
+    VertexArrayPtr m_vertexArray;
+    VertexBufferPtr m_positionBuffer;
+
+    uint32_t m_pointCount = 0;
+    uint32_t m_clothVertexCount = 0;
+    std::vector<glm::vec3> m_clothPositions;  // Packed cloth positions, kept between the frames
+    bool m_hasDeformed = false;
+};
+
+
+struct WrapComparison
+{
+    float maxError = 0.0f;
+    float meanError = 0.0f;
+    double cpuTime = 0.0;
+    double gpuTime = 0.0;   // Waiting for the GPU to finish the passes
+};
+
+// Deform a copy of the points with both deformers from the same cloth state and measure their distance
+WrapComparison CompareWrapDeformers(GpuWrapDeformer& gpuWrap,
+                                    WrapDeformer& wrap,
+                                    std::vector<glm::vec3> points,
+                                    const std::vector<Vertex>& driverVertices,
+                                    const std::vector<uint32_t>& driverIndices);
+
+
+#endif  // GPUWRAPDEFORMER_H
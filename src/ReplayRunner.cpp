@@ -0,0 +1,56 @@
+#include "ReplayRunner.h"
+
+
+ReplayRunner::~ReplayRunner()
+{
+    Cancel();
+    if (m_thread.joinable())
+        m_thread.join();
+}
+
+bool ReplayRunner::Start(const fs::path& filePath, const uint64_t& stepCount)
+{
+    if (m_running)
+        return false;
+
+    // The previous replay completed, only its thread is left to join
+    if (m_thread.joinable())
+        m_thread.join();
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_hasResult = false;
+    }
+    m_cancel = false;
+    m_progress = 0.0f;
+    m_running = true;
+
+    m_thread = std::thread([this, filePath, stepCount]() {
+        SimulationEngine engine;
+        ReplayResult result;
+        const bool success = RunReplay(filePath, engine, stepCount, result, [this](const float& progress) {
+            m_progress = progress;
+            return !m_cancel;
+        });
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_hasResult = success;
+            m_result = result;
+        }
+        m_progress = 1.0f;
+        m_running = false;
+    });
+
+    return true;
+}
+
+bool ReplayRunner::GetResult(ReplayResult& result) const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!m_hasResult)
+        return false;
+
+    result = m_result;
+    return true;
+}
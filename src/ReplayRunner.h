@@ -0,0 +1,47 @@
+#ifndef REPLAYRUNNER_H
+#define REPLAYRUNNER_H
+
+
+#include "SimulationReplay.h"
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+
+
+// Runs a replay headless on a worker thread and on its own engine, so that the viewer keeps drawing
+// and can cancel it. The replay sets the global simulation settings while it runs, the simulation
+// thread has to stay paused and the settings untouched until it completes.
+class ReplayRunner
+{
+public:
+    ReplayRunner() = default;
+    ~ReplayRunner();
+
+    ReplayRunner(const ReplayRunner&) = delete;
+    ReplayRunner& operator=(const ReplayRunner&) = delete;
+
+    // Start running the steps of the replay (0 for the recorded count), returns false if one is already running
+    bool Start(const fs::path& filePath, const uint64_t& stepCount);
+    // Stop the running replay after its current step, it then completes as a cancelled one
+    inline void Cancel() { m_cancel = true; }
+
+    inline bool IsRunning() const { return m_running; }
+    inline float GetProgress() const { return m_progress; }
+
+    // Result of the last completed replay, returns false if none completed or if it could not be read
+    bool GetResult(ReplayResult& result) const;
+
+private:
+    std::thread m_thread;
+    std::atomic<bool> m_running = false;
+    std::atomic<bool> m_cancel = false;
+    std::atomic<float> m_progress = 0.0f;
+
+    mutable std::mutex m_mutex;
+    bool m_hasResult = false;
+    ReplayResult m_result;
+};
+
+
+#endif  // REPLAYRUNNER_H
@@ -18,6 +18,7 @@ public:
 
     inline Texture2DPtr GetTexture() const { return m_framebuffer->GetDepthAttachment(); };
     inline FramebufferPtr GetFramebuffer() const { return m_framebuffer; };
+    inline Shader& GetShader() { return m_shader; };
 
     void Begin(const glm::mat4& lightViewMatrix, const glm::mat4& lightProjMatrix, const float& shadowMapThickness=-1.0f);
     void Clear();
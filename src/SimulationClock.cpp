@@ -0,0 +1,37 @@
+#include "SimulationClock.h"
+
+#include <algorithm>
+#include <cmath>
+
+
+SimulationClock::SimulationClock(const double& stepDuration, const uint32_t& maxSubsteps) : 
+    m_stepDuration(stepDuration),
+    m_maxSubsteps(maxSubsteps)
+{}
+
+uint32_t SimulationClock::Advance(const double& frameDuration)
+{
+    m_accumulator += std::max(frameDuration, 0.0);
+
+    uint32_t steps = static_cast<uint32_t>(std::floor(m_accumulator / m_stepDuration));
+    m_substeps = std::min(steps, m_maxSubsteps);
+    m_accumulator -= m_substeps * m_stepDuration;
+
+    // Keep less than a step of late time so that the interpolation stays in [0, 1)
+    m_droppedTime = 0.0;
+    if (m_accumulator >= m_stepDuration)
+    {
+        double remainder = std::fmod(m_accumulator, m_stepDuration);
+        m_droppedTime = m_accumulator - remainder;
+        m_accumulator = remainder;
+    }
+
+    return m_substeps;
+}
+
+void SimulationClock::Reset()
+{
+    m_accumulator = 0.0;
+    m_substeps = 0;
+    m_droppedTime = 0.0;
+}
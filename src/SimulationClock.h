@@ -0,0 +1,40 @@
+#ifndef SIMULATIONCLOCK_H
+#define SIMULATIONCLOCK_H
+
+#include <cstdint>
+
+
+// Accumulates the frame times and turns them into a number of fixed simulation steps so that the
+// simulated time follows the wall time whatever the frame rate
+class SimulationClock
+{
+public:
+    SimulationClock(const double& stepDuration, const uint32_t& maxSubsteps=8);
+
+    // Add the duration of a frame and return the number of steps to run. The steps are limited by
+    // the substep budget, the time that could not be simulated is dropped to avoid a death spiral
+    uint32_t Advance(const double& frameDuration);
+    void Reset();
+
+    // Position of the rendered frame between the two last simulated states
+    inline float GetInterpolation() const { return static_cast<float>(m_accumulator / m_stepDuration); }
+
+    inline double GetStepDuration() const { return m_stepDuration; }
+    inline void SetStepDuration(const double& duration) { m_stepDuration = duration; }
+
+    inline uint32_t GetMaxSubsteps() const { return m_maxSubsteps; }
+    inline void SetMaxSubsteps(const uint32_t& count) { m_maxSubsteps = count; }
+
+    inline uint32_t GetSubsteps() const { return m_substeps; }
+    inline double GetDroppedTime() const { return m_droppedTime; }
+
+private:
+    double m_stepDuration;
+    uint32_t m_maxSubsteps;
+
+    double m_accumulator = 0.0;
+    uint32_t m_substeps = 0;
+    double m_droppedTime = 0.0;
+};
+
+#endif  // SIMULATIONCLOCK_H
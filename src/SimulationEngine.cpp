@@ -1,49 +1,164 @@
 #include "SimulationEngine.h"
 
+#include "Base/Logging.h"
+
 #include <omp.h>
 
+#include <algorithm>
+#include <chrono>
+#include <limits>
 #include <iostream>
 #include <random>
 
 
-void fixedPointFn(Particle* particle, const float& dt) 
+void SimulationEngine::Clear()
 {
-    particle->forces = glm::vec3(0.0f); 
-    particle->velocity = glm::vec3(0.0f);
+    positions.clear();
+    velocities.clear();
+    forces.clear();
+    inverseMasses.clear();
+
+    linkParticles.clear();
+    linkStiffness.clear();
+    linkRestLengths.clear();
+    linkDamping.clear();
+    linkGroupOffsets.clear();
+    particleRanges.clear();
+    customLinks.clear();
+
+    previousPositions.clear();
+    linkLambdas.clear();
+    implicit = ImplicitSolverData();
+    sleep = SleepData();
+
+    obstacleGrid = SpatialHash();
+    particleGrid = SpatialHash();
 }
 
-Particle FixedPoint(const glm::vec3& position)
+uint32_t AddParticle(SimulationEngine& engine, const glm::vec3& position, const float& mass)
 {
-    return Particle{position, glm::vec3(0.0f), glm::vec3(0.0f), 0.0f, fixedPointFn};
+    engine.positions.push_back(position);
+    engine.velocities.push_back(glm::vec3(0.0f));
+    engine.forces.push_back(glm::vec3(0.0f));
+    engine.inverseMasses.push_back(mass > 0.0f ? 1.0f / mass : 0.0f);
+    return engine.positions.size() - 1;
 }
 
-void sphereObstacleFn(Particle* particle, const float& dt)
+uint32_t AddFixedPoint(SimulationEngine& engine, const glm::vec3& position)
 {
-    particle->forces = glm::vec3(0.0f); 
-    particle->velocity = glm::vec3(0.0f);
+    return AddParticle(engine, position, 0.0f);
 }
 
-Link Spring(Particle* p1, 
-            Particle* p2,
-            const float& k,
-            const float& restLength) 
+uint32_t AddSpringDamper(SimulationEngine& engine,
+                         const uint32_t& p1, 
+                         const uint32_t& p2,
+                         const float& k,
+                         const float& restLength,
+                         const float& z)
 {
-    return Link{p1, p2, k, restLength, 0.0f, springFn};
+    engine.linkParticles.push_back({p1, p2});
+    engine.linkStiffness.push_back(k);
+    engine.linkRestLengths.push_back(restLength);
+    engine.linkDamping.push_back(z);
+    return engine.linkParticles.size() - 1;
 }
 
-Link Damper(Particle* p1, 
-            Particle* p2,
-            const float& z) 
+uint32_t AddSpring(SimulationEngine& engine,
+                   const uint32_t& p1, 
+                   const uint32_t& p2,
+                   const float& k,
+                   const float& restLength) 
 {
-    return Link{p1, p2, 0.0f, 0.0f, z, damperFn};
+    return AddSpringDamper(engine, p1, p2, k, restLength, 0.0f);
 }
 
-Link SpringDamper(Particle* p1, 
-                  Particle* p2,
-                  const float& k,
-                  const float& restLength,
-                  const float& z) {
-    return Link{p1, p2, k, restLength, z, springDamperFn};
+uint32_t AddDamper(SimulationEngine& engine,
+                   const uint32_t& p1, 
+                   const uint32_t& p2,
+                   const float& z) 
+{
+    return AddSpringDamper(engine, p1, p2, 0.0f, 0.0f, z);
+}
+
+uint32_t AddCustomLink(SimulationEngine& engine,
+                       const uint32_t& p1, 
+                       const uint32_t& p2,
+                       const CustomLinkFn& force)
+{
+    engine.customLinks.push_back({p1, p2, force});
+    return engine.customLinks.size() - 1;
+}
+
+void ColorLinks(SimulationEngine& engine)
+{
+    const uint32_t linkCount = engine.GetLinkCount();
+
+    // Colors already used by the links of each particle
+    std::vector<uint64_t> particleColors(engine.GetParticleCount(), 0);
+    std::vector<uint32_t> linkGroups(linkCount);
+    std::vector<uint32_t> groupSizes;
+    uint32_t colorCount = 0;
+
+    for (uint32_t i = 0 ; i < linkCount ; i++)
+    {
+        const glm::uvec2& particles = engine.linkParticles[i];
+        uint64_t usedColors = particleColors[particles.x] | particleColors[particles.y];
+        if (~usedColors == 0)
+        {
+            LOG_ERROR("Too many links on a particle to color them, links are accumulated serially");
+            engine.linkGroupOffsets.clear();
+            return;
+        }
+
+        uint32_t color = 0;
+        while (usedColors & (uint64_t(1) << color))
+            color++;
+
+        particleColors[particles.x] |= uint64_t(1) << color;
+        particleColors[particles.y] |= uint64_t(1) << color;
+        colorCount = std::max(colorCount, color + 1);
+
+        LinkKind kind = GetLinkKind(engine.linkStiffness[i], engine.linkDamping[i]);
+        linkGroups[i] = color * LinkKindCount + static_cast<uint32_t>(kind);
+        groupSizes.resize(colorCount * LinkKindCount, 0);
+        groupSizes[linkGroups[i]]++;
+    }
+
+    auto& offsets = engine.linkGroupOffsets;
+    offsets.assign(groupSizes.size() + 1, 0);
+    for (uint32_t g = 0 ; g < groupSizes.size() ; g++)
+        offsets[g + 1] = offsets[g] + groupSizes[g];
+
+    // Stable counting sort of the links by group
+    std::vector<uint32_t> order(linkCount);
+    std::vector<uint32_t> cursors(offsets.begin(), offsets.end() - 1);
+    for (uint32_t i = 0 ; i < linkCount ; i++)
+        order[cursors[linkGroups[i]]++] = i;
+
+    auto reorder = [&](auto& values) {
+        auto sorted = values;
+        for (uint32_t i = 0 ; i < linkCount ; i++)
+            sorted[i] = values[order[i]];
+        values.swap(sorted);
+    };
+    reorder(engine.linkParticles);
+    reorder(engine.linkStiffness);
+    reorder(engine.linkRestLengths);
+    reorder(engine.linkDamping);
+
+    LOG_INFO("%d links split into %d colors", linkCount, colorCount);
+}
+
+void GroupParticles(SimulationEngine& engine)
+{
+    engine.particleRanges.clear();
+    for (uint32_t i = 0 ; i < engine.GetParticleCount() ; i++)
+    {
+        ParticleKind kind = engine.inverseMasses[i] == 0.0f ? ParticleKind::Fixed : ParticleKind::Free;
+        if (engine.particleRanges.empty() || engine.particleRanges.back().kind != kind)
+            engine.particleRanges.push_back({i, i, kind});
+        engine.particleRanges.back().end = i + 1;
+    }
 }
 
 float K(const float& k, const float& fe, const float& m)
@@ -61,85 +176,840 @@ float ObstacleStiffness(const float& fe)
     return fe * fe;
 }
 
-void springFn(const Link* link) 
+// Number of links or particles handed at once to a kernel by a thread
+static const uint32_t kernelBlockSize = 1024;
+
+// Links are skipped by chunks whose particles all sleep, small enough to follow the regions
+static const uint32_t sleepLinkChunkSize = 64;
+
+// Call fn(begin, end, awake) on the runs of the particles [begin, end) sharing a same sleeping state
+template<typename Fn>
+inline void forEachParticleRun(const SimulationEngine& engine, const uint32_t& begin, const uint32_t& end, Fn&& fn)
+{
+    const SleepData& sleep = engine.sleep;
+    if (sleep.sleepingCount == 0)
+    {
+        fn(begin, end, true);
+        return;
+    }
+
+    uint32_t runBegin = begin;
+    bool runAwake = sleep.IsRegionAwake(begin / sleep.regionSize);
+    for (uint32_t i = (begin / sleep.regionSize + 1) * sleep.regionSize ; i < end ; i += sleep.regionSize)
+    {
+        const bool awake = sleep.IsRegionAwake(i / sleep.regionSize);
+        if (awake == runAwake)
+            continue;
+
+        fn(runBegin, i, runAwake);
+        runBegin = i;
+        runAwake = awake;
+    }
+    fn(runBegin, end, runAwake);
+}
+
+// Call fn(begin, end) on the runs of the links [begin, end) whose chunks reach an awake region
+template<typename Fn>
+inline void forEachAwakeLinkRun(const SimulationEngine& engine, const uint32_t& begin, const uint32_t& end, Fn&& fn)
 {
-    glm::vec3 diff = link->p1->position - link->p2->position;
-    float deltaLength = glm::length(diff) - link->restLength;
-    glm::vec3 f = -link->k * deltaLength * glm::normalize(diff);
-    link->p1->forces += f;
-    link->p2->forces -= f;
+    const SleepData& sleep = engine.sleep;
+    if (sleep.sleepingCount == 0)
+    {
+        fn(begin, end);
+        return;
+    }
+
+    uint32_t runBegin = begin;
+    bool inRun = false;
+    for (uint32_t chunkBegin = begin ; chunkBegin < end ; )
+    {
+        const uint32_t chunk = chunkBegin / sleepLinkChunkSize;
+        const uint32_t chunkEnd = std::min(end, (chunk + 1) * sleepLinkChunkSize);
+        const bool awake = sleep.IsLinkChunkAwake(chunk);
+        if (awake && !inRun)
+            runBegin = chunkBegin;
+        else if (!awake && inRun)
+            fn(runBegin, chunkBegin);
+
+        inRun = awake;
+        chunkBegin = chunkEnd;
+    }
+    if (inRun)
+        fn(runBegin, end);
 }
 
-void damperFn(const Link* link) 
+// Run a block of links of a color through the kernels of the kinds it overlaps
+inline void accumulateLinkBlock(SimulationEngine& engine,
+                                const SimulationKernels& kernels,
+                                const uint32_t* kindOffsets,
+                                const uint32_t& begin,
+                                const uint32_t& end)
 {
-    glm::vec3 f = -link->z * (link->p1->velocity - link->p2->velocity);
-    link->p1->forces += f;
-    link->p2->forces -= f;
+    if (!engine.useTypedKernels)
+    {
+        forEachAwakeLinkRun(engine, begin, end, [&](const uint32_t& runBegin, const uint32_t& runEnd) {
+            kernels.linkForces[static_cast<uint32_t>(LinkKind::SpringDamper)](engine, runBegin, runEnd);
+        });
+        return;
+    }
+
+    for (uint32_t kind = 0 ; kind < LinkKindCount ; kind++)
+    {
+        uint32_t kindBegin = std::max(begin, kindOffsets[kind]);
+        uint32_t kindEnd = std::min(end, kindOffsets[kind + 1]);
+        if (kindBegin < kindEnd)
+            forEachAwakeLinkRun(engine, kindBegin, kindEnd, [&](const uint32_t& runBegin, const uint32_t& runEnd) {
+                kernels.linkForces[kind](engine, runBegin, runEnd);
+            });
+    }
+}
+
+// Links of a color update disjoint particles, colors are accumulated one after the other so that
+// the forces are summed in the same order whatever the number of threads
+void AccumulateLinkForces(SimulationEngine& engine, const SimulationKernels& kernels, const bool& parallel)
+{
+    const auto& offsets = engine.linkGroupOffsets;
+    const uint32_t colorCount = offsets.empty() ? 0 : (offsets.size() - 1) / LinkKindCount;
+
+    for (uint32_t color = 0 ; color < colorCount ; color++)
+    {
+        const uint32_t* kindOffsets = &offsets[color * LinkKindCount];
+        const uint32_t colorEnd = kindOffsets[LinkKindCount];
+
+        #pragma omp parallel for if(parallel) num_threads(omp_get_max_threads())
+        for (uint32_t i = kindOffsets[0] ; i < colorEnd ; i += kernelBlockSize) {
+            accumulateLinkBlock(engine, kernels, kindOffsets, i, std::min(i + kernelBlockSize, colorEnd));
+        }
+    }
+
+    const LinkForcesKernel genericKernel = kernels.linkForces[static_cast<uint32_t>(LinkKind::SpringDamper)];
+    genericKernel(engine, offsets.empty() ? 0 : offsets.back(), engine.GetLinkCount());
+
+    for (const auto& link : engine.customLinks)
+    {
+        glm::vec3 f = link.force(engine, link.p1, link.p2);
+        engine.forces[link.p1] += f;
+        engine.forces[link.p2] -= f;
+    }
+}
+
+// Free particles are integrated, fixed and sleeping ones only get their forces reset
+inline void integrateAllParticles(SimulationEngine& engine, const glm::vec3& externalForce, const float& dt)
+{
+    const uint32_t particleCount = engine.GetParticleCount();
+    const bool typed = engine.useTypedKernels;
+
+    auto integrate = [&](const uint32_t& begin, const uint32_t& end) {
+        forEachParticleRun(engine, begin, end, [&](const uint32_t& runBegin, const uint32_t& runEnd, const bool& awake) {
+            if (awake)
+                engine.kernels->integrate(engine, externalForce, dt, runBegin, runEnd);
+            else
+                std::fill(engine.forces.begin() + runBegin, engine.forces.begin() + runEnd, glm::vec3(0.0f));
+        });
+    };
+
+    #pragma omp parallel for num_threads(omp_get_max_threads())
+    for (uint32_t i = 0 ; i < particleCount ; i += kernelBlockSize) {
+        const uint32_t blockEnd = std::min(i + kernelBlockSize, particleCount);
+        if (!typed)
+        {
+            integrate(i, blockEnd);
+            continue;
+        }
+
+        uint32_t next = i;
+        for (const auto& range : engine.particleRanges)
+        {
+            uint32_t begin = std::max(i, range.begin);
+            uint32_t end = std::min(blockEnd, range.end);
+            if (begin >= end)
+                continue;
+
+            if (range.kind == ParticleKind::Free)
+                integrate(begin, end);
+            else
+                std::fill(engine.forces.begin() + begin, engine.forces.begin() + end, glm::vec3(0.0f));
+            next = end;
+        }
+
+        // Particles added after the grouping
+        if (next < blockEnd)
+            integrate(std::max(next, i), blockEnd);
+    }
 }
 
+bool Obstacle::ComputePenetration(const glm::vec3& point, float& depth, glm::vec3& normal) const
+{
+    if (field)
+    {
+        glm::vec3 gradient;
+        depth = size - field->Sample(glm::transpose(rotation) * (point - position), gradient);
+        if (depth <= 0.0f)
+            return false;
+
+        float gradientLength = glm::length(gradient);
+        normal = gradientLength > 0.0f ? rotation * (gradient / gradientLength) : glm::vec3(0.0f);
+        return true;
+    }
+
+    depth = size - distanceFn(position, point);
+    if (depth <= 0.0f)
+        return false;
 
-void springDamperFn(const Link* link) {
-    springFn(link);
-    damperFn(link);
+    normal = normalFn(position, point);
+    return true;
 }
 
-void leapFrog(Particle* particle, const float& dt)
+glm::vec3 Obstacle::ComputeForce(const glm::vec3& point) const
 {
-    particle->velocity += particle->forces / particle->mass * dt;
-    particle->position += particle->velocity * dt;
-    particle->forces = glm::vec3(0);
+    float depth;
+    glm::vec3 normal;
+    if (ComputePenetration(point, depth, normal))
+        return stiffness * depth * normal;
+
+    return glm::vec3(0.0f);
 }
 
-void Obstacle::update(Particle* particle) const
+BoundingBox Obstacle::GetBounds() const
 {
-    float dist = size - distanceFn(position, particle->position);
-    if (dist > 0.0f)
+    BoundingBox bounds;
+    if (!field)
     {
-        glm::vec3 normal = normalFn(position, particle->position);
-        particle->forces += stiffness * dist * normal;
-    }    
+        // Both norms keep the obstacle inside the box of half width its size
+        bounds.min = position - glm::vec3(size);
+        bounds.max = position + glm::vec3(size);
+        return bounds;
+    }
+
+    // Transformed corners of the field enlarged by the offset
+    BoundingBox local = field->GetBounds();
+    local.min -= glm::vec3(std::max(size, 0.0f));
+    local.max += glm::vec3(std::max(size, 0.0f));
+    for (uint32_t i = 0 ; i < 8 ; i++)
+    {
+        glm::vec3 corner(i & 1 ? local.max.x : local.min.x,
+                         i & 2 ? local.max.y : local.min.y,
+                         i & 4 ? local.max.z : local.min.z);
+        bounds.Expand(position + rotation * corner);
+    }
+    return bounds;
 }
 
-void massSpringSolver(SimulationEngine& engine, const double &deltaTime)
+void UpdateCollisionGrids(SimulationEngine& engine)
 {
-    for (const auto& link : engine.links) {
-        link.update(&link);
+    // The cells are twice the mean obstacle half width so that most obstacles overlap a few cells only
+    if (engine.obstacles.empty())
+        engine.obstacleGrid = SpatialHash();
+    else
+    {
+        std::vector<BoundingBox> bounds(engine.obstacles.size());
+        float meanSize = 0.0f;
+        for (uint32_t i = 0 ; i < engine.obstacles.size() ; i++)
+        {
+            bounds[i] = engine.obstacles[i].GetBounds();
+            glm::vec3 extent = bounds[i].max - bounds[i].min;
+            meanSize += 0.5f * std::max(extent.x, std::max(extent.y, extent.z)) / engine.obstacles.size();
+        }
+        engine.obstacleGrid.Build(bounds, std::max(2.0f * meanSize, 1e-3f));
     }
 
-    for (auto& part : engine.particles) {
-        part.update(&part, deltaTime);
+    // With cells twice the thickness, the neighbours of a particle lie in the 8 cells around it
+    if (collisionSettings.selfCollision && collisionSettings.thickness > 0.0f)
+        engine.particleGrid.Build(engine.positions, 2.0f * collisionSettings.thickness);
+    else
+        engine.particleGrid = SpatialHash();
+}
+
+// Obstacle and self-collision forces on a particle, only written by the thread handling it.
+// Linked particles are not excluded, the thickness is expected below the rest length of the links.
+inline glm::vec3 collisionForce(const SimulationEngine& engine, const uint32_t& i)
+{
+    const glm::vec3& position = engine.positions[i];
+    glm::vec3 force(0.0f);
+
+    engine.obstacleGrid.ForEachInCell(position, [&](const uint32_t& obstacle) {
+        force += engine.obstacles[obstacle].ComputeForce(position);
+    });
+
+    const float thickness = collisionSettings.thickness;
+    engine.particleGrid.ForEachInRadius(position, thickness, [&](const uint32_t& other) {
+        glm::vec3 diff = position - engine.positions[other];
+        float distance2 = glm::dot(diff, diff);
+        if (other == i || distance2 >= thickness * thickness || distance2 == 0.0f)
+            return;
+
+        float distance = std::sqrt(distance2);
+        force += collisionSettings.stiffness * (thickness - distance) / distance * diff;
+    });
+
+    return force;
+}
+
+inline void accumulateCollisionForces(SimulationEngine& engine)
+{
+    UpdateCollisionGrids(engine);
+    if (engine.obstacleGrid.IsEmpty() && engine.particleGrid.IsEmpty())
+        return;
+
+    #pragma omp parallel for num_threads(omp_get_max_threads())
+    for (uint32_t i = 0 ; i < engine.GetParticleCount() ; i++) {
+        if (engine.sleep.IsParticleAwake(i))
+            engine.forces[i] += collisionForce(engine, i);
     }
 }
 
-void massSpringGravitySolver(SimulationEngine& engine, const double &deltaTime)
+inline void updateAwakeRegions(SimulationEngine& engine)
 {
-    for (const auto& link : engine.links) {
-        link.update(&link);
+    SleepData& sleep = engine.sleep;
+    const uint32_t regionCount = sleep.awake.size();
+
+    sleep.sleepingCount = 0;
+    sleep.activeParticles = 0;
+    sleep.awakeOffsets.resize(regionCount + 1);
+    sleep.awakeOffsets[0] = 0;
+    for (uint32_t region = 0 ; region < regionCount ; region++)
+    {
+        sleep.awakeOffsets[region + 1] = sleep.awakeOffsets[region] + sleep.awake[region];
+        if (sleep.awake[region])
+            sleep.activeParticles += std::min(sleep.particleCount, (region + 1) * sleep.regionSize) - region * sleep.regionSize;
+        else
+            sleep.sleepingCount++;
     }
+}
 
-    for (auto& part : engine.particles) {
-        part.forces += glm::vec3(0, -gravity, 0);
-        part.update(&part, deltaTime);
+inline void wakeRegion(SleepData& sleep, const uint32_t& region)
+{
+    sleep.awake[region] = 1;
+    sleep.calmSteps[region] = 0;
+}
+
+// Regions, their neighbourhood and the regions reached by each chunk of links, every region awake
+inline void buildSleepRegions(SimulationEngine& engine, const uint32_t& regionSize)
+{
+    SleepData& sleep = engine.sleep;
+    sleep = SleepData();
+    sleep.regionSize = regionSize;
+    sleep.particleCount = engine.GetParticleCount();
+    sleep.linkCount = engine.GetLinkCount();
+
+    const uint32_t regionCount = (sleep.particleCount + regionSize - 1) / regionSize;
+    sleep.awake.assign(regionCount, 1);
+    sleep.calmSteps.assign(regionCount, 0);
+    sleep.energies.assign(regionCount, 0.0f);
+    sleep.disturbed.assign(regionCount, 0);
+    sleep.bounds.resize(regionCount);
+
+    const uint32_t chunkCount = (sleep.linkCount + sleepLinkChunkSize - 1) / sleepLinkChunkSize;
+    sleep.chunkRegions.assign(chunkCount, glm::uvec2(std::numeric_limits<uint32_t>::max(), 0));
+    for (uint32_t i = 0 ; i < sleep.linkCount ; i++)
+    {
+        const glm::uvec2 regions = engine.linkParticles[i] / regionSize;
+        glm::uvec2& chunk = sleep.chunkRegions[i / sleepLinkChunkSize];
+        chunk.x = std::min(chunk.x, std::min(regions.x, regions.y));
+        chunk.y = std::max(chunk.y, std::max(regions.x, regions.y));
+        if (regions.x != regions.y)
+            sleep.neighbors.push_back(glm::uvec2(std::min(regions.x, regions.y), std::max(regions.x, regions.y)));
     }
+
+    std::sort(sleep.neighbors.begin(), sleep.neighbors.end(), [](const glm::uvec2& a, const glm::uvec2& b) {
+        return a.x < b.x || (a.x == b.x && a.y < b.y);
+    });
+    sleep.neighbors.erase(std::unique(sleep.neighbors.begin(), sleep.neighbors.end()), sleep.neighbors.end());
+
+    sleep.gravity = gravity;
+    sleep.wind = wind;
+    sleep.obstacleBounds.clear();
+    for (const auto& obstacle : engine.obstacles)
+        sleep.obstacleBounds.push_back(obstacle.GetBounds());
+
+    updateAwakeRegions(engine);
+}
+
+void WakeAllRegions(SimulationEngine& engine)
+{
+    SleepData& sleep = engine.sleep;
+    if (sleep.sleepingCount == 0)
+        return;
+
+    std::fill(sleep.awake.begin(), sleep.awake.end(), 1);
+    std::fill(sleep.calmSteps.begin(), sleep.calmSteps.end(), 0);
+    updateAwakeRegions(engine);
+}
+
+void UpdateSleeping(SimulationEngine& engine)
+{
+    SleepData& sleep = engine.sleep;
+    const uint32_t particleCount = engine.GetParticleCount();
+    if (!sleepSettings.enabled)
+    {
+        WakeAllRegions(engine);
+        return;
+    }
+
+    const uint32_t regionSize = std::max(1u, sleepSettings.regionSize);
+    if (sleep.regionSize != regionSize || sleep.particleCount != particleCount || sleep.linkCount != engine.GetLinkCount())
+        buildSleepRegions(engine, regionSize);
+    const uint32_t regionCount = sleep.awake.size();
+
+    // The wind and gravity act on every particle
+    if (sleep.gravity != gravity || sleep.wind != wind || sleep.obstacleBounds.size() != engine.obstacles.size())
+    {
+        std::fill(sleep.awake.begin(), sleep.awake.end(), 1);
+        std::fill(sleep.calmSteps.begin(), sleep.calmSteps.end(), 0);
+        sleep.gravity = gravity;
+        sleep.wind = wind;
+        sleep.obstacleBounds.resize(engine.obstacles.size());
+    }
+
+    // Moving obstacles wake the sleeping regions overlapping their previous or new bounds
+    for (uint32_t i = 0 ; i < engine.obstacles.size() ; i++)
+    {
+        const BoundingBox bounds = engine.obstacles[i].GetBounds();
+        BoundingBox& previous = sleep.obstacleBounds[i];
+        if (bounds.min == previous.min && bounds.max == previous.max)
+            continue;
+
+        BoundingBox swept = bounds;
+        swept.Expand(previous);
+        previous = bounds;
+        if (swept.IsEmpty())
+            continue;
+
+        for (uint32_t region = 0 ; region < regionCount ; region++)
+        {
+            const BoundingBox& regionBounds = sleep.bounds[region];
+            if (!sleep.awake[region] &&
+                glm::all(glm::lessThanEqual(regionBounds.min, swept.max)) &&
+                glm::all(glm::lessThanEqual(swept.min, regionBounds.max)))
+                wakeRegion(sleep, region);
+        }
+    }
+
+    #pragma omp parallel for num_threads(omp_get_max_threads())
+    for (uint32_t region = 0 ; region < regionCount ; region++) {
+        const uint32_t end = std::min(particleCount, (region + 1) * regionSize);
+        float energy = 0.0f;
+        uint32_t count = 0;
+        for (uint32_t i = region * regionSize ; sleep.awake[region] && i < end ; i++)
+        {
+            if (engine.inverseMasses[i] == 0.0f)
+                continue;
+            energy += 0.5f * glm::dot(engine.velocities[i], engine.velocities[i]);
+            count++;
+        }
+        sleep.energies[region] = count > 0 ? energy / count : 0.0f;
+        sleep.disturbed[region] = 0;
+    }
+
+    // Energetic regions wake their sleeping neighbours and keep the awake ones from falling asleep
+    for (const auto& pair : sleep.neighbors)
+    {
+        if (sleep.energies[pair.x] > sleepSettings.wakeEnergy)
+            sleep.disturbed[pair.y] = 1;
+        if (sleep.energies[pair.y] > sleepSettings.wakeEnergy)
+            sleep.disturbed[pair.x] = 1;
+    }
+
+    #pragma omp parallel for num_threads(omp_get_max_threads())
+    for (uint32_t region = 0 ; region < regionCount ; region++) {
+        if (!sleep.awake[region])
+        {
+            if (sleep.disturbed[region])
+                wakeRegion(sleep, region);
+            continue;
+        }
+
+        if (sleep.energies[region] >= sleepSettings.sleepEnergy || sleep.disturbed[region])
+        {
+            sleep.calmSteps[region] = 0;
+            continue;
+        }
+
+        if (++sleep.calmSteps[region] < sleepSettings.calmSteps)
+            continue;
+
+        // The particles stop where they are, the bounds are kept for the obstacle wake ups
+        const uint32_t end = std::min(particleCount, (region + 1) * regionSize);
+        sleep.awake[region] = 0;
+        sleep.bounds[region] = BoundingBox();
+        for (uint32_t i = region * regionSize ; i < end ; i++)
+        {
+            engine.velocities[i] = glm::vec3(0.0f);
+            sleep.bounds[region].Expand(engine.positions[i]);
+        }
+    }
+
+    updateAwakeRegions(engine);
+}
+
+void massSpringSolver(SimulationEngine& engine, const double &deltaTime)
+{
+    AccumulateLinkForces(engine, *engine.kernels);
+    integrateAllParticles(engine, glm::vec3(0.0f), deltaTime);
+    UpdateSleeping(engine);
+}
+
+void massSpringGravitySolver(SimulationEngine& engine, const double &deltaTime)
+{
+    AccumulateLinkForces(engine, *engine.kernels);
+    integrateAllParticles(engine, glm::vec3(0, -gravity, 0), deltaTime);
+    UpdateSleeping(engine);
 }
 
 void massSpringGravityWindSolver(SimulationEngine& engine, const double &deltaTime)
 {
+    AccumulateLinkForces(engine, *engine.kernels);
+    accumulateCollisionForces(engine);
+    integrateAllParticles(engine, glm::vec3(0, -gravity, 0) + wind, deltaTime);
+    UpdateSleeping(engine);
+}
+
+// XPBD distance constraint between the two particles of a link, lambda accumulates over the iterations.
+// Sleeping particles are handled as fixed ones.
+inline void solveDistanceConstraint(SimulationEngine& engine, const uint32_t& link, const float& alpha)
+{
+    const glm::uvec2& particles = engine.linkParticles[link];
+    const float w1 = engine.sleep.IsParticleAwake(particles.x) ? engine.inverseMasses[particles.x] : 0.0f;
+    const float w2 = engine.sleep.IsParticleAwake(particles.y) ? engine.inverseMasses[particles.y] : 0.0f;
+    if (w1 + w2 == 0.0f)
+        return;
+
+    glm::vec3 diff = engine.positions[particles.x] - engine.positions[particles.y];
+    float length = glm::length(diff);
+    if (length == 0.0f)
+        return;
+
+    float& lambda = engine.linkLambdas[link];
+    float constraint = length - engine.linkRestLengths[link];
+    float deltaLambda = (-constraint - alpha * lambda) / (w1 + w2 + alpha);
+    lambda += deltaLambda;
+
+    glm::vec3 correction = deltaLambda / length * diff;
+    engine.positions[particles.x] += w1 * correction;
+    engine.positions[particles.y] -= w2 * correction;
+}
+
+inline void solveLinkRange(SimulationEngine& engine, const uint32_t& begin, const uint32_t& end, const float& alpha)
+{
+    #pragma omp parallel for if(end - begin >= kernelBlockSize) num_threads(omp_get_max_threads())
+    for (uint32_t i = begin ; i < end ; i++) {
+        solveDistanceConstraint(engine, i, alpha);
+    }
+}
+
+void xpbdSolver(SimulationEngine& engine, const double &deltaTime)
+{
+    const uint32_t particleCount = engine.GetParticleCount();
+    const float dt = deltaTime;
+    const glm::vec3 externalForce = glm::vec3(0, -gravity, 0) + wind;
+
+    // Self-collision repulsion acts as an external force, the obstacles are projected after the constraints
+    UpdateCollisionGrids(engine);
+    if (!engine.particleGrid.IsEmpty())
+    {
+        #pragma omp parallel for num_threads(omp_get_max_threads())
+        for (uint32_t i = 0 ; i < particleCount ; i++) {
+            if (engine.sleep.IsParticleAwake(i))
+                engine.forces[i] += collisionForce(engine, i);
+        }
+    }
+
+    // Prediction, sleeping particles keep their position and null velocity
+    engine.previousPositions = engine.positions;
     #pragma omp parallel for num_threads(omp_get_max_threads())
-    for (const auto& link : engine.links) {
-        link.update(&link);
+    for (uint32_t i = 0 ; i < particleCount ; i++) {
+        if (!engine.sleep.IsParticleAwake(i))
+        {
+            engine.forces[i] = glm::vec3(0.0f);
+            continue;
+        }
+
+        engine.velocities[i] += (engine.forces[i] + externalForce) * engine.inverseMasses[i] * dt;
+        engine.positions[i] += engine.velocities[i] * dt;
+        engine.forces[i] = glm::vec3(0.0f);
+    }
+
+    // Gauss-Seidel over the colors, Jacobi inside a color whose links never share a particle
+    const float alpha = xpbdSettings.compliance / (dt * dt);
+    const auto& offsets = engine.linkGroupOffsets;
+    const uint32_t colorCount = offsets.empty() ? 0 : (offsets.size() - 1) / LinkKindCount;
+    engine.linkLambdas.assign(engine.GetLinkCount(), 0.0f);
+
+    for (uint32_t iteration = 0 ; iteration < xpbdSettings.iterations ; iteration++)
+    {
+        for (uint32_t color = 0 ; color < colorCount ; color++)
+        {
+            const uint32_t* kindOffsets = &offsets[color * LinkKindCount];
+            solveLinkRange(engine, kindOffsets[(uint32_t)LinkKind::Spring], kindOffsets[(uint32_t)LinkKind::Spring + 1], alpha);
+            solveLinkRange(engine, kindOffsets[(uint32_t)LinkKind::SpringDamper], kindOffsets[(uint32_t)LinkKind::SpringDamper + 1], alpha);
+        }
+
+        for (uint32_t i = offsets.empty() ? 0 : offsets.back() ; i < engine.GetLinkCount() ; i++) {
+            if (GetLinkKind(engine.linkStiffness[i], engine.linkDamping[i]) != LinkKind::Damper)
+                solveDistanceConstraint(engine, i, alpha);
+        }
     }
 
+    // Obstacles push the particles out, then the velocities are derived from the displacement
+    const float damping = 1.0f - xpbdSettings.damping;
     #pragma omp parallel for num_threads(omp_get_max_threads())
-    for (auto& part : engine.particles) {
-        for (const auto& obstacle : engine.obstacles)
-            obstacle.update(&part);
+    for (uint32_t i = 0 ; i < particleCount ; i++) {
+        if (engine.inverseMasses[i] == 0.0f || !engine.sleep.IsParticleAwake(i))
+            continue;
+
+        glm::vec3& position = engine.positions[i];
+        engine.obstacleGrid.ForEachInCell(position, [&](const uint32_t& index) {
+            float depth;
+            glm::vec3 normal;
+            if (engine.obstacles[index].ComputePenetration(position, depth, normal))
+                position += depth * normal;
+        });
 
-        part.forces += glm::vec3(0, -gravity, 0);
-        part.forces += wind;
-        
-        part.update(&part, deltaTime);
+        engine.velocities[i] = (engine.positions[i] - engine.previousPositions[i]) * (damping / dt);
     }
+
+    UpdateSleeping(engine);
+}
+
+void BuildImplicitPattern(SimulationEngine& engine)
+{
+    const uint32_t particleCount = engine.GetParticleCount();
+    auto& matrix = engine.implicit.matrix;
+
+    std::vector<std::vector<uint32_t>> neighbors(particleCount);
+    std::vector<std::vector<uint32_t>> links(particleCount);
+    for (uint32_t i = 0 ; i < particleCount ; i++)
+        neighbors[i].push_back(i);
+    for (uint32_t i = 0 ; i < engine.GetLinkCount() ; i++)
+    {
+        const glm::uvec2& particles = engine.linkParticles[i];
+        neighbors[particles.x].push_back(particles.y);
+        neighbors[particles.y].push_back(particles.x);
+        links[particles.x].push_back(i);
+        links[particles.y].push_back(i);
+    }
+
+    matrix.rowOffsets.assign(particleCount + 1, 0);
+    matrix.columns.clear();
+    for (uint32_t i = 0 ; i < particleCount ; i++)
+    {
+        auto& row = neighbors[i];
+        std::sort(row.begin(), row.end());
+        row.erase(std::unique(row.begin(), row.end()), row.end());
+        matrix.columns.insert(matrix.columns.end(), row.begin(), row.end());
+        matrix.rowOffsets[i + 1] = matrix.columns.size();
+    }
+
+    auto findBlock = [&](const uint32_t& row, const uint32_t& column) {
+        auto begin = matrix.columns.begin() + matrix.rowOffsets[row];
+        auto end = matrix.columns.begin() + matrix.rowOffsets[row + 1];
+        return static_cast<uint32_t>(std::lower_bound(begin, end, column) - matrix.columns.begin());
+    };
+
+    matrix.diagonals.resize(particleCount);
+    for (uint32_t i = 0 ; i < particleCount ; i++)
+        matrix.diagonals[i] = findBlock(i, i);
+
+    matrix.rowLinkOffsets.assign(particleCount + 1, 0);
+    matrix.rowLinks.clear();
+    for (uint32_t i = 0 ; i < particleCount ; i++)
+    {
+        for (const uint32_t& link : links[i])
+        {
+            const glm::uvec2& particles = engine.linkParticles[link];
+            matrix.rowLinks.push_back({link, findBlock(i, particles.x == i ? particles.y : particles.x)});
+        }
+        matrix.rowLinkOffsets[i + 1] = matrix.rowLinks.size();
+    }
+
+    matrix.blocks.assign(matrix.columns.size(), glm::mat3(0.0f));
+}
+
+void BlockSparseMatrix::Multiply(const std::vector<glm::vec3>& x, std::vector<glm::vec3>& y) const
+{
+    const uint32_t rowCount = rowOffsets.size() - 1;
+
+    #pragma omp parallel for num_threads(omp_get_max_threads())
+    for (uint32_t row = 0 ; row < rowCount ; row++) {
+        glm::vec3 sum(0.0f);
+        for (uint32_t block = rowOffsets[row] ; block < rowOffsets[row + 1] ; block++)
+            sum += blocks[block] * x[columns[block]];
+        y[row] = sum;
+    }
+}
+
+// Partial sums over fixed blocks added in order, so that the result does not depend on the thread count
+inline double dotProduct(const std::vector<glm::vec3>& a, const std::vector<glm::vec3>& b)
+{
+    const uint32_t blockCount = (a.size() + kernelBlockSize - 1) / kernelBlockSize;
+    std::vector<double> blockSums(blockCount);
+
+    #pragma omp parallel for num_threads(omp_get_max_threads())
+    for (uint32_t block = 0 ; block < blockCount ; block++) {
+        const uint32_t end = std::min<uint32_t>((block + 1) * kernelBlockSize, a.size());
+        double sum = 0.0;
+        for (uint32_t i = block * kernelBlockSize ; i < end ; i++)
+            sum += glm::dot(a[i], b[i]);
+        blockSums[block] = sum;
+    }
+
+    double sum = 0.0;
+    for (const double& blockSum : blockSums)
+        sum += blockSum;
+    return sum;
+}
+
+// Elastic force of a link on its first particle and its contribution h z I + h^2 dfs/dx to the system
+// matrix M - h D - h^2 K. Compressed springs drop their transverse stiffness to keep the matrix positive definite.
+inline glm::mat3 linkJacobian(const SimulationEngine& engine, const uint32_t& link, const float& h, glm::vec3& force)
+{
+    const glm::uvec2& particles = engine.linkParticles[link];
+    const float& k = engine.linkStiffness[link];
+
+    glm::mat3 block = glm::mat3(h * engine.linkDamping[link]);
+    force = glm::vec3(0.0f);
+
+    glm::vec3 diff = engine.positions[particles.x] - engine.positions[particles.y];
+    float length = glm::length(diff);
+    if (k != 0.0f && length > 0.0f)
+    {
+        glm::vec3 direction = diff / length;
+        glm::mat3 projection = glm::outerProduct(direction, direction);
+        float transverse = std::max(0.0f, 1.0f - engine.linkRestLengths[link] / length);
+        block += h * h * k * (projection + transverse * (glm::mat3(1.0f) - projection));
+        force = -k * (length - engine.linkRestLengths[link]) * direction;
+    }
+
+    return block;
+}
+
+void massSpringImplicitSolver(SimulationEngine& engine, const double &deltaTime)
+{
+    using Clock = std::chrono::high_resolution_clock;
+
+    const uint32_t particleCount = engine.GetParticleCount();
+    auto& data = engine.implicit;
+    auto& matrix = data.matrix;
+    if (matrix.diagonals.size() != particleCount || matrix.rowLinks.size() != 2 * engine.GetLinkCount())
+        BuildImplicitPattern(engine);
+
+    const float h = deltaTime;
+    const glm::vec3 externalForce = glm::vec3(0, -gravity, 0) + wind;
+    UpdateCollisionGrids(engine);
+    WakeAllRegions(engine);
+
+    // Each row is assembled from its own links, computing every link twice but writing
+    // the matrix in a single streaming pass. Fixed particles keep an identity row and no
+    // coupling so that their velocity stays null.
+    #pragma omp parallel for num_threads(omp_get_max_threads())
+    for (uint32_t i = 0 ; i < particleCount ; i++) {
+        for (uint32_t block = matrix.rowOffsets[i] ; block < matrix.rowOffsets[i + 1] ; block++)
+            matrix.blocks[block] = glm::mat3(0.0f);
+
+        const float& inverseMass = engine.inverseMasses[i];
+        if (inverseMass == 0.0f)
+        {
+            matrix.blocks[matrix.diagonals[i]] = glm::mat3(1.0f);
+            continue;
+        }
+
+        glm::mat3 diagonal = glm::mat3(1.0f / inverseMass);
+        glm::vec3 force = externalForce + collisionForce(engine, i);
+
+        for (uint32_t j = matrix.rowLinkOffsets[i] ; j < matrix.rowLinkOffsets[i + 1] ; j++)
+        {
+            const glm::uvec2& rowLink = matrix.rowLinks[j];
+            const glm::uvec2& particles = engine.linkParticles[rowLink.x];
+
+            glm::vec3 linkForce;
+            glm::mat3 block = linkJacobian(engine, rowLink.x, h, linkForce);
+            force += particles.x == i ? linkForce : -linkForce;
+            diagonal += block;
+
+            const uint32_t other = particles.x == i ? particles.y : particles.x;
+            if (engine.inverseMasses[other] != 0.0f)
+                matrix.blocks[rowLink.y] -= block;
+        }
+
+        matrix.blocks[matrix.diagonals[i]] += diagonal;
+        engine.forces[i] += force;
+    }
+
+    // A v = M v0 + h f, solved from the current velocities with a block-Jacobi preconditioner
+    data.rhs.resize(particleCount);
+    data.residual.resize(particleCount);
+    data.preconditioned.resize(particleCount);
+    data.direction.resize(particleCount);
+    data.product.resize(particleCount);
+    data.preconditioner.resize(particleCount);
+    auto& x = engine.velocities;
+
+    #pragma omp parallel for num_threads(omp_get_max_threads())
+    for (uint32_t i = 0 ; i < particleCount ; i++) {
+        const float& inverseMass = engine.inverseMasses[i];
+        if (inverseMass > 0.0f)
+            data.rhs[i] = x[i] / inverseMass + h * engine.forces[i];
+        else
+            data.rhs[i] = x[i] = glm::vec3(0.0f);
+        data.preconditioner[i] = glm::inverse(matrix.blocks[matrix.diagonals[i]]);
+        engine.forces[i] = glm::vec3(0.0f);
+    }
+
+    matrix.Multiply(x, data.product);
+
+    #pragma omp parallel for num_threads(omp_get_max_threads())
+    for (uint32_t i = 0 ; i < particleCount ; i++) {
+        data.residual[i] = data.rhs[i] - data.product[i];
+        data.preconditioned[i] = data.preconditioner[i] * data.residual[i];
+        data.direction[i] = data.preconditioned[i];
+    }
+
+    const double rhsNorm = std::max(dotProduct(data.rhs, data.rhs), 1e-30);
+    const double tolerance = double(implicitSettings.tolerance) * implicitSettings.tolerance * rhsNorm;
+    double residualNorm = dotProduct(data.residual, data.residual);
+    double rz = dotProduct(data.residual, data.preconditioned);
+
+    // At least one iteration runs whatever the budget so that the forces are never ignored
+    const auto start = Clock::now();
+    uint32_t iteration = 0;
+    while (iteration < implicitSettings.maxIterations && residualNorm > tolerance)
+    {
+        if (iteration > 0 && std::chrono::duration<float>(Clock::now() - start).count() > implicitSettings.timeBudget)
+            break;
+
+        matrix.Multiply(data.direction, data.product);
+        double curvature = dotProduct(data.direction, data.product);
+        if (curvature <= 0.0)
+            break;
+
+        const float alpha = rz / curvature;
+        #pragma omp parallel for num_threads(omp_get_max_threads())
+        for (uint32_t i = 0 ; i < particleCount ; i++) {
+            x[i] += alpha * data.direction[i];
+            data.residual[i] -= alpha * data.product[i];
+            data.preconditioned[i] = data.preconditioner[i] * data.residual[i];
+        }
+
+        double rzNext = dotProduct(data.residual, data.preconditioned);
+        const float beta = rzNext / rz;
+        rz = rzNext;
+
+        #pragma omp parallel for num_threads(omp_get_max_threads())
+        for (uint32_t i = 0 ; i < particleCount ; i++) {
+            data.direction[i] = data.preconditioned[i] + beta * data.direction[i];
+        }
+
+        residualNorm = dotProduct(data.residual, data.residual);
+        iteration++;
+    }
+
+    #pragma omp parallel for num_threads(omp_get_max_threads())
+    for (uint32_t i = 0 ; i < particleCount ; i++) {
+        engine.positions[i] += h * x[i];
+    }
+
+    engine.solverIterations = iteration;
+    engine.solverResidual = std::sqrt(residualNorm / rhsNorm);
 }
 
 float& getGravity() 
@@ -152,6 +1022,26 @@ glm::vec3& getWind()
     return wind; 
 }
 
+XPBDSettings& getXPBDSettings()
+{
+    return xpbdSettings;
+}
+
+ImplicitSettings& getImplicitSettings()
+{
+    return implicitSettings;
+}
+
+CollisionSettings& getCollisionSettings()
+{
+    return collisionSettings;
+}
+
+SleepSettings& getSleepSettings()
+{
+    return sleepSettings;
+}
+
 
 void InitClothFromMesh(SimulationEngine& engine,
                        const std::vector<Vertex> vertices,
@@ -161,33 +1051,26 @@ void InitClothFromMesh(SimulationEngine& engine,
     float k = 0.1f;
     float z = 0.03f;
 
-    engine.links.clear();
-    engine.particles.clear();
+    engine.Clear();
 
     uint32_t vtxCountW = divisionsW + 1;
     uint32_t vtxCountH = divisionsH + 1;
     for (int y = 0; y < vtxCountH - 1 ; y++) {
         for (int x=0 ; x < vtxCountW ; ++x) {
-            auto part = Particle{vertices[y * (vtxCountW) + x].position};
-            part.mass = 1.0f;
-            part.update = leapFrog;
-            engine.particles.push_back(part);
+            AddParticle(engine, vertices[y * (vtxCountW) + x].position, 1.0f);
         }
     }
     // Top line is only composed of fixed points
     for (int x=0 ; x < vtxCountW ; ++x) {
-        engine.particles.push_back(FixedPoint(vertices[(vtxCountH - 1) * vtxCountW + x].position));
+        AddFixedPoint(engine, vertices[(vtxCountH - 1) * vtxCountW + x].position);
     }
 
     auto addLink = [&](const uint32_t& i1, const uint32_t& i2) {
-        auto& part1 = engine.particles[i1];
-        auto& part2 = engine.particles[i2];
-        glm::vec3 diff = part1.position - part2.position;
-
-        engine.links.push_back(SpringDamper(
-            &part1, &part2,
-            K(k, fe, 1.0f), glm::length(diff), 
-            Z(z, fe, 1.0f)));
+        glm::vec3 diff = engine.positions[i1] - engine.positions[i2];
+
+        AddSpringDamper(engine, i1, i2,
+                        K(k, fe, 1.0f), glm::length(diff), 
+                        Z(z, fe, 1.0f));
     };
 
     int index = 0;
@@ -245,4 +1128,8 @@ void InitClothFromMesh(SimulationEngine& engine,
             index++;
         }
     }
+
+    ColorLinks(engine);
+    GroupParticles(engine);
+    BuildImplicitPattern(engine);
 }
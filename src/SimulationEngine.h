@@ -2,64 +2,23 @@
 #define SIMULATIONENGINE_H
 
 #include "Base/Mesh.h"
+#include "Base/SignedDistanceField.h"
+#include "Base/SpatialHash.h"
+#include "SimulationKernels.h"
 
 #include <glm/glm.hpp>
 
 #include <functional>
+#include <memory>
 #include <vector>
 
 
-struct Particle;
-struct Link;
 struct Obstacle;
 
-using UpdateParticleFn = std::function<void(Particle*, const float& dt)>;
 using DistanceFn       = std::function<float(const glm::vec3&, const glm::vec3&)>;
 using NormalFn         = std::function<glm::vec3(const glm::vec3&, const glm::vec3&)>;
-using UpdateLinkFn     = std::function<void(const Link*)>;
 
 
-struct Particle
-{
-    glm::vec3 position;
-    glm::vec3 velocity;
-    glm::vec3 forces;
-    float mass = 1.0;
-
-    UpdateParticleFn update;
-};
-
-// Particle creation
-void fixedPointFn(Particle* particle, const float& dt);
-Particle FixedPoint(const glm::vec3& position);
-
-// Particle update
-void leapFrog(Particle* particle, const float& dt);
-
-struct Link
-{
-    Particle *p1, *p2;
-    float k;
-    float restLength;
-    float z;
-
-    UpdateLinkFn update;
-};
-
-// Link creation
-Link Spring(Particle* p1, 
-            Particle* p2,
-            const float& k=1.0f,
-            const float& restLength=0.0f);
-Link Damper(Particle* p1, 
-            Particle* p2,
-            const float& z);
-Link SpringDamper(Particle* p1, 
-                  Particle* p2,
-                  const float& k=1.0f,
-                  const float& restLength=0.0f,
-                  const float& z=1.0f);
-
 struct Obstacle
 {
     glm::vec3 position;
@@ -68,7 +27,16 @@ struct Obstacle
     DistanceFn distanceFn;
     NormalFn normalFn;
 
-    void update(Particle* particle) const;
+    // Mesh obstacles sample a signed distance field expressed in their local frame instead of the
+    // functions above, size is then the distance kept from the surface. The rigid transform
+    // (position and rotation) can be animated without rebuilding the field.
+    std::shared_ptr<const SignedDistanceField> field;
+    glm::mat3 rotation = glm::mat3(1.0f);
+
+    // Depth and direction to push a point out of the obstacle, false when the point is outside
+    bool ComputePenetration(const glm::vec3& point, float& depth, glm::vec3& normal) const;
+    glm::vec3 ComputeForce(const glm::vec3& point) const;
+    BoundingBox GetBounds() const;
 };
 
 
@@ -130,30 +98,234 @@ inline Obstacle CubeObstacle(const glm::vec3& position, const float& width, cons
     return Obstacle{position, width, stiffness, infiniteNorm, cubeNormal};
 }
 
+inline Obstacle MeshObstacle(const std::shared_ptr<const SignedDistanceField>& field,
+                             const glm::vec3& position,
+                             const glm::mat3& rotation,
+                             const float& offset,
+                             const float& stiffness)
+{
+    return Obstacle{position, offset, stiffness, nullptr, nullptr, field, rotation};
+}
+
 
 // Link parameters
 float K(const float& k, const float& fe, const float& m);
 float Z(const float& z, const float& fe, const float& m);
 float ObstacleStiffness(const float& fe);
 
-// Update link
-void springFn(const Link* link);
-void damperFn(const Link* link);
-void springDamperFn(const Link* link);
+struct SimulationEngine;
+
+// Force applied on the first particle of a custom link, its opposite is applied on the second one
+using CustomLinkFn = std::function<glm::vec3(const SimulationEngine& engine, const uint32_t& p1, const uint32_t& p2)>;
+
+struct CustomLink
+{
+    uint32_t p1;
+    uint32_t p2;
+    CustomLinkFn force;
+};
 
+struct ParticleRange
+{
+    uint32_t begin;
+    uint32_t end;
+    ParticleKind kind;
+};
+
+// Block sparse matrix of 3x3 blocks in CSR order, its pattern follows the links between the particles
+struct BlockSparseMatrix
+{
+    std::vector<uint32_t> rowOffsets;
+    std::vector<uint32_t> columns;
+    std::vector<glm::mat3> blocks;
 
+    std::vector<uint32_t> diagonals;      // Block (i, i) of each row
+
+    // Links of each row with their block (i, j), so that a row is assembled on its own
+    std::vector<uint32_t> rowLinkOffsets;
+    std::vector<glm::uvec2> rowLinks;
+
+    void Multiply(const std::vector<glm::vec3>& x, std::vector<glm::vec3>& y) const;
+};
+
+// Linear system and conjugate gradient buffers of the implicit solver, kept between the steps
+struct ImplicitSolverData
+{
+    BlockSparseMatrix matrix;
+    std::vector<glm::mat3> preconditioner;
+    std::vector<glm::vec3> rhs;
+    std::vector<glm::vec3> residual;
+    std::vector<glm::vec3> preconditioned;
+    std::vector<glm::vec3> direction;
+    std::vector<glm::vec3> product;
+};
+
+// Calm regions of consecutive particles are put to sleep : their particles are frozen and the links
+// between sleeping particles are skipped until an energetic neighbour region, a moving obstacle or a
+// change of the wind or gravity wakes them up. Rebuilt when the particles or links change.
+struct SleepData
+{
+    uint32_t regionSize = 0;
+    uint32_t particleCount = 0;
+    uint32_t linkCount = 0;
+
+    std::vector<uint8_t> awake;
+    std::vector<uint32_t> calmSteps;          // Consecutive steps spent under the sleep energy
+    std::vector<float> energies;              // Mean kinetic energy per unit mass of the free particles
+    std::vector<uint8_t> disturbed;           // Next to an energetic region during the last update
+    std::vector<BoundingBox> bounds;          // Particles bounds of the sleeping regions
+    std::vector<glm::uvec2> neighbors;        // Pairs of regions sharing a link
+    std::vector<uint32_t> awakeOffsets;       // Number of awake regions before each region
+    std::vector<glm::uvec2> chunkRegions;     // First and last region reached by each chunk of links
+
+    uint32_t sleepingCount = 0;
+    uint32_t activeParticles = 0;
+
+    // Inputs of the last update, their changes wake the regions they affect
+    float gravity = 0.0f;
+    glm::vec3 wind = glm::vec3(0.0f);
+    std::vector<BoundingBox> obstacleBounds;
+
+    inline bool IsRegionAwake(const uint32_t& region) const
+    {
+        return region >= awake.size() || awake[region];
+    }
+
+    inline bool IsParticleAwake(const uint32_t& particle) const
+    {
+        return sleepingCount == 0 || IsRegionAwake(particle / regionSize);
+    }
+
+    // Chunks of links added after the build are always awake
+    inline bool IsLinkChunkAwake(const uint32_t& chunk) const
+    {
+        if (sleepingCount == 0 || chunk >= chunkRegions.size())
+            return true;
+        return awakeOffsets[chunkRegions[chunk].y + 1] > awakeOffsets[chunkRegions[chunk].x];
+    }
+};
+
+// The particles and links are stored as structures of arrays so that the solvers stream through
+// contiguous memory. Their behaviour is driven by their data only : fixed points have an inverse mass
+// of 0, springs have no damping and dampers no stiffness.
 struct SimulationEngine 
 {
-    std::vector<Particle> particles;
-    std::vector<Link> links;
+    // Particles
+    std::vector<glm::vec3> positions;
+    std::vector<glm::vec3> velocities;
+    std::vector<glm::vec3> forces;
+    std::vector<float> inverseMasses;
+
+    // Links between two particles
+    std::vector<glm::uvec2> linkParticles;
+    std::vector<float> linkStiffness;
+    std::vector<float> linkRestLengths;
+    std::vector<float> linkDamping;
+
+    // Links sorted by color then by kind, links of a same color never share a particle so that their
+    // forces can be accumulated in parallel. Group g = color * LinkKindCount + kind covers
+    // [linkGroupOffsets[g], linkGroupOffsets[g + 1]), links added after the grouping are accumulated serially
+    std::vector<uint32_t> linkGroupOffsets;
+
+    // Ranges of consecutive particles of the same kind, particles added after the grouping are free
+    std::vector<ParticleRange> particleRanges;
+
+    // Opt-in slow path for behaviours the typed links don't cover
+    std::vector<CustomLink> customLinks;
+
+    // Scratch buffers of the XPBD solver
+    std::vector<glm::vec3> previousPositions;
+    std::vector<float> linkLambdas;
+
+    ImplicitSolverData implicit;
+
+    SleepData sleep;
+
+    // Statistics of the last step of the iterative solvers
+    uint32_t solverIterations = 0;
+    float solverResidual = 0.0f;
+
     std::vector<Obstacle> obstacles;
+
+    // Rebuilt at each step by the solvers handling collisions, the particle grid stays empty
+    // while self-collision is disabled
+    SpatialHash obstacleGrid;
+    SpatialHash particleGrid;
+
+    // Force accumulation and integration kernels, the fastest supported by the CPU by default
+    const SimulationKernels* kernels = &GetSimulationKernels();
+    // Run each group through the kernel of its kind, or every link through the generic SpringDamper kernel
+    bool useTypedKernels = true;
+
+    inline uint32_t GetParticleCount() const { return positions.size(); }
+    inline uint32_t GetLinkCount() const { return linkParticles.size(); }
+    inline uint32_t GetActiveParticleCount() const { return sleep.sleepingCount == 0 ? GetParticleCount() : sleep.activeParticles; }
+    void Clear();
 };
 
+// Particle creation
+uint32_t AddParticle(SimulationEngine& engine, const glm::vec3& position, const float& mass=1.0f);
+uint32_t AddFixedPoint(SimulationEngine& engine, const glm::vec3& position);
+
+// Link creation
+uint32_t AddSpring(SimulationEngine& engine,
+                   const uint32_t& p1, 
+                   const uint32_t& p2,
+                   const float& k=1.0f,
+                   const float& restLength=0.0f);
+uint32_t AddDamper(SimulationEngine& engine,
+                   const uint32_t& p1, 
+                   const uint32_t& p2,
+                   const float& z);
+uint32_t AddSpringDamper(SimulationEngine& engine,
+                         const uint32_t& p1, 
+                         const uint32_t& p2,
+                         const float& k=1.0f,
+                         const float& restLength=0.0f,
+                         const float& z=1.0f);
+
+// Custom links are evaluated serially through a std::function after the typed links
+uint32_t AddCustomLink(SimulationEngine& engine,
+                       const uint32_t& p1, 
+                       const uint32_t& p2,
+                       const CustomLinkFn& force);
+
+// Greedy coloring of the links then grouping by kind, reorders them so that each group is contiguous
+// (link indices are invalidated)
+void ColorLinks(SimulationEngine& engine);
+
+// Split the particles into ranges of the same kind, particle indices are preserved
+void GroupParticles(SimulationEngine& engine);
+
+// Sparsity pattern of the implicit solver, to build once the links are colored
+void BuildImplicitPattern(SimulationEngine& engine);
+
+// Accumulate the forces of all the links with the given kernels, colors run in parallel when requested
+void AccumulateLinkForces(SimulationEngine& engine, const SimulationKernels& kernels, const bool& parallel=true);
+
+// Hash the obstacles by their bounds and the particles by their position for the collision queries
+void UpdateCollisionGrids(SimulationEngine& engine);
+
+// Track the kinetic energy of the regions after a step, putting the calm ones to sleep and waking the
+// disturbed ones. Called by the explicit and XPBD solvers, the implicit solver keeps every region awake.
+void UpdateSleeping(SimulationEngine& engine);
+void WakeAllRegions(SimulationEngine& engine);
+
 // Solvers
+using SolverFn = void(*)(SimulationEngine& engine, const double& deltaTime);
+
 void massSpringSolver(SimulationEngine& engine, const double& deltaTime);
 void massSpringGravitySolver(SimulationEngine& engine, const double& deltaTime);
 void massSpringGravityWindSolver(SimulationEngine& engine, const double& deltaTime);
 
+// Links are solved as distance constraints (springs and spring-dampers, dampers are ignored) with
+// gravity, wind and obstacles, stable whatever the stiffness at a single step per frame
+void xpbdSolver(SimulationEngine& engine, const double& deltaTime);
+
+// Backward Euler step solved with a block-Jacobi preconditioned conjugate gradient warm started from
+// the current velocities, stable with stiff links. Stops on the tolerance, the iteration count or the time budget.
+void massSpringImplicitSolver(SimulationEngine& engine, const double& deltaTime);
+
 // Utils
 static float gravity = 9.81f;
 float& getGravity();
@@ -161,6 +333,44 @@ float& getGravity();
 static glm::vec3 wind = {12.0f, 0.0f, 5.0f};
 glm::vec3& getWind();
 
+struct XPBDSettings
+{
+    uint32_t iterations = 10;
+    float compliance = 1e-7f;    // Inverse stiffness of the links, 0 for inextensible links
+    float damping = 0.01f;       // Fraction of the velocity removed at each step
+};
+static XPBDSettings xpbdSettings;
+XPBDSettings& getXPBDSettings();
+
+struct ImplicitSettings
+{
+    uint32_t maxIterations = 200;
+    float tolerance = 1e-4f;      // Relative to the norm of the right hand side
+    float timeBudget = 0.004f;    // Seconds of conjugate gradient per step
+};
+static ImplicitSettings implicitSettings;
+ImplicitSettings& getImplicitSettings();
+
+struct CollisionSettings
+{
+    bool selfCollision = false;
+    float thickness = 0.2f;       // Distance under which two particles of the cloth repel each other
+    float stiffness = 1000.0f;    // Repulsion force per unit of penetration
+};
+static CollisionSettings collisionSettings;
+CollisionSettings& getCollisionSettings();
+
+struct SleepSettings
+{
+    bool enabled = false;
+    uint32_t regionSize = 256;    // Consecutive particles per region
+    float sleepEnergy = 1e-4f;    // Mean kinetic energy per unit mass under which a region is calm
+    float wakeEnergy = 1e-2f;     // Mean kinetic energy per unit mass of a region waking its neighbours
+    uint32_t calmSteps = 50;      // Calm steps before a region falls asleep
+};
+static SleepSettings sleepSettings;
+SleepSettings& getSleepSettings();
+
 
 
 void InitClothFromMesh(SimulationEngine& engine,
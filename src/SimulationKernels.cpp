@@ -0,0 +1,274 @@
+#include "SimulationKernels.h"
+
+#include "SimulationEngine.h"
+
+#include <chrono>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define SIMULATION_KERNELS_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define TARGET_AVX2
+#else
+#define TARGET_AVX2 __attribute__((target("avx2,fma")))
+#endif
+#endif
+
+
+// The kernels see the positions, velocities and forces as flat float arrays
+static_assert(sizeof(glm::vec3) == 3 * sizeof(float), "glm::vec3 must be tightly packed");
+static_assert(sizeof(glm::uvec2) == 2 * sizeof(uint32_t), "glm::uvec2 must be tightly packed");
+
+
+// Scalar kernels
+
+template<LinkKind kind>
+static void linkForcesScalar(SimulationEngine& engine, const uint32_t& begin, const uint32_t& end)
+{
+    for (uint32_t i = begin ; i < end ; i++)
+    {
+        const glm::uvec2& particles = engine.linkParticles[i];
+        glm::vec3 f(0.0f);
+
+        if constexpr (kind != LinkKind::Damper)
+        {
+            glm::vec3 diff = engine.positions[particles.x] - engine.positions[particles.y];
+            float length = glm::length(diff);
+            if (length > 0.0f)
+                f -= engine.linkStiffness[i] * (length - engine.linkRestLengths[i]) / length * diff;
+        }
+
+        if constexpr (kind != LinkKind::Spring)
+            f -= engine.linkDamping[i] * (engine.velocities[particles.x] - engine.velocities[particles.y]);
+
+        engine.forces[particles.x] += f;
+        engine.forces[particles.y] -= f;
+    }
+}
+
+static void integrateScalar(SimulationEngine& engine,
+                            const glm::vec3& externalForce,
+                            const float& dt,
+                            const uint32_t& begin,
+                            const uint32_t& end)
+{
+    for (uint32_t i = begin ; i < end ; i++)
+    {
+        engine.velocities[i] += (engine.forces[i] + externalForce) * engine.inverseMasses[i] * dt;
+        engine.positions[i] += engine.velocities[i] * dt;
+        engine.forces[i] = glm::vec3(0.0f);
+    }
+}
+
+
+// AVX2 kernels, 8 links or 8 particles per iteration
+
+#ifdef SIMULATION_KERNELS_X86
+
+template<LinkKind kind>
+TARGET_AVX2 static void linkForcesAVX2(SimulationEngine& engine, const uint32_t& begin, const uint32_t& end)
+{
+    const float* positions = reinterpret_cast<const float*>(engine.positions.data());
+    const float* velocities = reinterpret_cast<const float*>(engine.velocities.data());
+    float* forces = reinterpret_cast<float*>(engine.forces.data());
+    const int* links = reinterpret_cast<const int*>(engine.linkParticles.data());
+
+    const __m256i deinterleave = _mm256_setr_epi32(0, 2, 4, 6, 1, 3, 5, 7);
+    const __m256 half = _mm256_set1_ps(0.5f);
+    const __m256 threeHalves = _mm256_set1_ps(1.5f);
+    const __m256 zero = _mm256_setzero_ps();
+
+    alignas(32) float fx[8], fy[8], fz[8];
+    alignas(32) int offsets1[8], offsets2[8];
+
+    uint32_t i = begin;
+    for ( ; i + 8 <= end ; i += 8)
+    {
+        // Split the 8 particle pairs into the first and second particles of the links
+        __m256i lo = _mm256_permutevar8x32_epi32(_mm256_loadu_si256((const __m256i*)(links + 2 * i)), deinterleave);
+        __m256i hi = _mm256_permutevar8x32_epi32(_mm256_loadu_si256((const __m256i*)(links + 2 * i + 8)), deinterleave);
+        __m256i p1 = _mm256_permute2x128_si256(lo, hi, 0x20);
+        __m256i p2 = _mm256_permute2x128_si256(lo, hi, 0x31);
+        __m256i o1 = _mm256_add_epi32(p1, _mm256_add_epi32(p1, p1));
+        __m256i o2 = _mm256_add_epi32(p2, _mm256_add_epi32(p2, p2));
+
+        __m256 fx8 = zero, fy8 = zero, fz8 = zero;
+        if constexpr (kind != LinkKind::Damper)
+        {
+            __m256 dx = _mm256_sub_ps(_mm256_i32gather_ps(positions,     o1, 4), _mm256_i32gather_ps(positions,     o2, 4));
+            __m256 dy = _mm256_sub_ps(_mm256_i32gather_ps(positions + 1, o1, 4), _mm256_i32gather_ps(positions + 1, o2, 4));
+            __m256 dz = _mm256_sub_ps(_mm256_i32gather_ps(positions + 2, o1, 4), _mm256_i32gather_ps(positions + 2, o2, 4));
+
+            // One rsqrt refined by a Newton step gives both the length and its inverse
+            __m256 length2 = _mm256_fmadd_ps(dz, dz, _mm256_fmadd_ps(dy, dy, _mm256_mul_ps(dx, dx)));
+            __m256 invLength = _mm256_rsqrt_ps(length2);
+            invLength = _mm256_mul_ps(invLength, _mm256_fnmadd_ps(_mm256_mul_ps(half, length2),
+                                                                  _mm256_mul_ps(invLength, invLength),
+                                                                  threeHalves));
+            __m256 length = _mm256_mul_ps(length2, invLength);
+
+            // Springs of null length get no elastic force
+            __m256 k = _mm256_loadu_ps(engine.linkStiffness.data() + i);
+            __m256 restLength = _mm256_loadu_ps(engine.linkRestLengths.data() + i);
+            __m256 scale = _mm256_mul_ps(_mm256_mul_ps(k, _mm256_sub_ps(restLength, length)), invLength);
+            scale = _mm256_and_ps(scale, _mm256_cmp_ps(length2, zero, _CMP_GT_OQ));
+
+            fx8 = _mm256_mul_ps(scale, dx);
+            fy8 = _mm256_mul_ps(scale, dy);
+            fz8 = _mm256_mul_ps(scale, dz);
+        }
+
+        if constexpr (kind != LinkKind::Spring)
+        {
+            __m256 z = _mm256_loadu_ps(engine.linkDamping.data() + i);
+            __m256 dvx = _mm256_sub_ps(_mm256_i32gather_ps(velocities,     o1, 4), _mm256_i32gather_ps(velocities,     o2, 4));
+            __m256 dvy = _mm256_sub_ps(_mm256_i32gather_ps(velocities + 1, o1, 4), _mm256_i32gather_ps(velocities + 1, o2, 4));
+            __m256 dvz = _mm256_sub_ps(_mm256_i32gather_ps(velocities + 2, o1, 4), _mm256_i32gather_ps(velocities + 2, o2, 4));
+
+            fx8 = _mm256_fnmadd_ps(z, dvx, fx8);
+            fy8 = _mm256_fnmadd_ps(z, dvy, fy8);
+            fz8 = _mm256_fnmadd_ps(z, dvz, fz8);
+        }
+
+        _mm256_store_ps(fx, fx8);
+        _mm256_store_ps(fy, fy8);
+        _mm256_store_ps(fz, fz8);
+        _mm256_store_si256((__m256i*)offsets1, o1);
+        _mm256_store_si256((__m256i*)offsets2, o2);
+
+        // AVX2 has no scatter
+        for (int lane = 0 ; lane < 8 ; lane++)
+        {
+            float* f1 = forces + offsets1[lane];
+            float* f2 = forces + offsets2[lane];
+            f1[0] += fx[lane]; f1[1] += fy[lane]; f1[2] += fz[lane];
+            f2[0] -= fx[lane]; f2[1] -= fy[lane]; f2[2] -= fz[lane];
+        }
+    }
+
+    linkForcesScalar<kind>(engine, i, end);
+}
+
+TARGET_AVX2 static void integrateAVX2(SimulationEngine& engine,
+                                      const glm::vec3& externalForce,
+                                      const float& dt,
+                                      const uint32_t& begin,
+                                      const uint32_t& end)
+{
+    float* positions = reinterpret_cast<float*>(engine.positions.data());
+    float* velocities = reinterpret_cast<float*>(engine.velocities.data());
+    float* forces = reinterpret_cast<float*>(engine.forces.data());
+    const float* inverseMasses = engine.inverseMasses.data();
+
+    // 8 particles are 3 registers of interleaved xyz components
+    const __m256i massLanes[3] = {_mm256_setr_epi32(0, 0, 0, 1, 1, 1, 2, 2),
+                                  _mm256_setr_epi32(2, 3, 3, 3, 4, 4, 4, 5),
+                                  _mm256_setr_epi32(5, 5, 6, 6, 6, 7, 7, 7)};
+    const float& ex = externalForce.x;
+    const float& ey = externalForce.y;
+    const float& ez = externalForce.z;
+    const __m256 external[3] = {_mm256_setr_ps(ex, ey, ez, ex, ey, ez, ex, ey),
+                                _mm256_setr_ps(ez, ex, ey, ez, ex, ey, ez, ex),
+                                _mm256_setr_ps(ey, ez, ex, ey, ez, ex, ey, ez)};
+    const __m256 step = _mm256_set1_ps(dt);
+    const __m256 zero = _mm256_setzero_ps();
+
+    uint32_t i = begin;
+    for ( ; i + 8 <= end ; i += 8)
+    {
+        __m256 massStep = _mm256_mul_ps(_mm256_loadu_ps(inverseMasses + i), step);
+        for (int r = 0 ; r < 3 ; r++)
+        {
+            const uint32_t offset = 3 * i + 8 * r;
+            __m256 f = _mm256_add_ps(_mm256_loadu_ps(forces + offset), external[r]);
+            __m256 v = _mm256_fmadd_ps(f, _mm256_permutevar8x32_ps(massStep, massLanes[r]), _mm256_loadu_ps(velocities + offset));
+            _mm256_storeu_ps(velocities + offset, v);
+            _mm256_storeu_ps(positions + offset, _mm256_fmadd_ps(v, step, _mm256_loadu_ps(positions + offset)));
+            _mm256_storeu_ps(forces + offset, zero);
+        }
+    }
+
+    integrateScalar(engine, externalForce, dt, i, end);
+}
+
+static bool cpuSupportsAVX2()
+{
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7)
+        return false;
+
+    __cpuid(info, 1);
+    const bool fma = info[2] & (1 << 12);
+    const bool osxsave = info[2] & (1 << 27);
+    if (!fma || !osxsave || (_xgetbv(0) & 0x6) != 0x6)
+        return false;
+
+    __cpuidex(info, 7, 0);
+    return info[1] & (1 << 5);
+#else
+    return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#endif
+}
+
+#endif
+
+
+const std::vector<SimulationKernels>& GetAvailableSimulationKernels()
+{
+    static const std::vector<SimulationKernels> kernels = [] {
+        std::vector<SimulationKernels> available = {{"Scalar",
+                                                               {linkForcesScalar<LinkKind::Spring>,
+                                                                linkForcesScalar<LinkKind::Damper>,
+                                                                linkForcesScalar<LinkKind::SpringDamper>},
+                                                               integrateScalar}};
+#ifdef SIMULATION_KERNELS_X86
+        if (cpuSupportsAVX2())
+            available.push_back({"AVX2",
+                                 {linkForcesAVX2<LinkKind::Spring>,
+                                  linkForcesAVX2<LinkKind::Damper>,
+                                  linkForcesAVX2<LinkKind::SpringDamper>},
+                                 integrateAVX2});
+#endif
+        return available;
+    }();
+
+    return kernels;
+}
+
+const SimulationKernels& GetSimulationKernels()
+{
+    return GetAvailableSimulationKernels().back();
+}
+
+
+std::vector<KernelBenchmark> BenchmarkSimulationKernels(const SimulationEngine& engine, const uint32_t& iterations)
+{
+    using Clock = std::chrono::high_resolution_clock;
+
+    std::vector<KernelBenchmark> results;
+    for (const auto& kernels : GetAvailableSimulationKernels())
+    {
+        SimulationEngine copy = engine;
+        const uint32_t linkCount = copy.GetLinkCount();
+        const uint32_t particleCount = copy.GetParticleCount();
+
+        auto start = Clock::now();
+        for (uint32_t i = 0 ; i < iterations ; i++)
+            AccumulateLinkForces(copy, kernels, false);
+        double linksTime = std::chrono::duration<double>(Clock::now() - start).count();
+
+        start = Clock::now();
+        for (uint32_t i = 0 ; i < iterations ; i++)
+            kernels.integrate(copy, glm::vec3(0.0f), 0.0f, 0, particleCount);
+        double particlesTime = std::chrono::duration<double>(Clock::now() - start).count();
+
+        results.push_back({kernels.name,
+                           double(linkCount) * iterations / linksTime,
+                           double(particleCount) * iterations / particlesTime});
+    }
+
+    return results;
+}
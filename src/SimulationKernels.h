@@ -0,0 +1,75 @@
+#ifndef SIMULATIONKERNELS_H
+#define SIMULATIONKERNELS_H
+
+#include <glm/glm.hpp>
+
+#include <string>
+#include <vector>
+
+
+struct SimulationEngine;
+
+// The behaviour of a link is given by its data : springs have no damping and dampers no stiffness
+enum class LinkKind : uint32_t
+{
+    Spring = 0,
+    Damper,
+    SpringDamper
+};
+static const uint32_t LinkKindCount = 3;
+
+inline LinkKind GetLinkKind(const float& stiffness, const float& damping)
+{
+    if (damping == 0.0f)
+        return LinkKind::Spring;
+    if (stiffness == 0.0f)
+        return LinkKind::Damper;
+    return LinkKind::SpringDamper;
+}
+
+// Fixed particles have an inverse mass of 0
+enum class ParticleKind : uint32_t
+{
+    Free = 0,
+    Fixed
+};
+
+// Accumulate the spring and damper forces of the links [begin, end) on their particles
+using LinkForcesKernel = void(*)(SimulationEngine& engine, const uint32_t& begin, const uint32_t& end);
+
+// Leap frog integration of the particles [begin, end) with a constant external force, resets their forces
+using IntegrateKernel  = void(*)(SimulationEngine& engine,
+                                 const glm::vec3& externalForce,
+                                 const float& dt,
+                                 const uint32_t& begin,
+                                 const uint32_t& end);
+
+
+// A set of kernels built for an instruction set, with a link kernel specialized for each kind of link.
+// The SpringDamper kernel handles any link.
+struct SimulationKernels
+{
+    const char* name;
+    LinkForcesKernel linkForces[LinkKindCount];
+    IntegrateKernel integrate;
+};
+
+// Scalar kernels first then the SIMD ones supported by the CPU
+const std::vector<SimulationKernels>& GetAvailableSimulationKernels();
+
+// Fastest kernels supported by the CPU, selected once at startup
+const SimulationKernels& GetSimulationKernels();
+
+
+struct KernelBenchmark
+{
+    std::string name;
+    double linksPerSecond;
+    double particlesPerSecond;
+};
+
+// Run every available kernel on a copy of the engine
+std::vector<KernelBenchmark> BenchmarkSimulationKernels(const SimulationEngine& engine, const uint32_t& iterations=100);
+
+
+#endif
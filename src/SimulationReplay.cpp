@@ -0,0 +1,271 @@
+#include "SimulationReplay.h"
+
+#include "SimulationSnapshot.h"
+
+#include "Base/BinaryFile.h"
+#include "Base/Hash.h"
+#include "Base/Logging.h"
+
+#include <glm/gtc/type_ptr.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <string>
+
+
+const std::vector<SolverFn>& GetReplaySolvers()
+{
+    static const std::vector<SolverFn> solvers = {massSpringSolver,
+                                                  massSpringGravitySolver,
+                                                  massSpringGravityWindSolver,
+                                                  xpbdSolver,
+                                                  massSpringImplicitSolver};
+    return solvers;
+}
+
+uint64_t HashPositions(const SimulationEngine& engine)
+{
+    return HashData(engine.positions.data(), engine.positions.size() * sizeof(glm::vec3));
+}
+
+
+SimulationRecorder::~SimulationRecorder()
+{
+    Abort();
+}
+
+bool SimulationRecorder::Start(const fs::path& filePath, const SimulationEngine& engine, const SolverFn& solver)
+{
+    Abort();
+
+    const auto& solvers = GetReplaySolvers();
+    auto found = std::find(solvers.begin(), solvers.end(), solver);
+    if (found == solvers.end())
+    {
+        LOG_ERROR("The current solver can't be recorded");
+        return false;
+    }
+
+    m_filePath = filePath;
+    m_stepCount = 0;
+    m_transformCount = 0;
+    m_pendingTransforms.clear();
+    m_failed = false;
+    m_file = fopen(GetTemporaryPath(filePath).c_str(), "wb");
+    if (!m_file)
+    {
+        LOG_ERROR("Could not write the simulation replay %s", filePath.c_str());
+        return false;
+    }
+
+    m_header = SimulationReplayHeader{{'S', 'I', 'M', 'R'},
+                                      SIMULATION_REPLAY_VERSION,
+                                      uint32_t(found - solvers.begin()),
+                                      engine.useTypedKernels,
+                                      getXPBDSettings(),
+                                      getImplicitSettings(),
+                                      getCollisionSettings(),
+                                      getSleepSettings(),
+                                      0,
+                                      0,
+                                      0};
+
+    // The header is written again with the step count once stopped
+    if (fwrite(&m_header, sizeof(m_header), 1, m_file) != 1 || !WriteSimulationSnapshot(m_file, engine))
+    {
+        LOG_ERROR("Could not write the simulation replay %s", filePath.c_str());
+        Abort();
+        return false;
+    }
+
+    return true;
+}
+
+void SimulationRecorder::RecordObstacleTransform(const uint32_t& obstacle, const glm::vec3& position, const glm::mat3& rotation)
+{
+    if (!m_file || m_failed)
+        return;
+
+    ReplayTransform transform{obstacle, {}, {}};
+    std::memcpy(transform.position, glm::value_ptr(position), sizeof(transform.position));
+    std::memcpy(transform.rotation, glm::value_ptr(rotation), sizeof(transform.rotation));
+    m_pendingTransforms.push_back(transform);
+}
+
+void SimulationRecorder::Record(const double& deltaTime)
+{
+    if (!m_file || m_failed)
+        return;
+
+    // A failed write is reported once stopped
+    const glm::vec3& wind = getWind();
+    ReplayStep step{deltaTime, getGravity(), {wind.x, wind.y, wind.z}, uint32_t(m_pendingTransforms.size())};
+    m_failed = fwrite(&step, sizeof(step), 1, m_file) != 1 || !WriteArray(m_file, m_pendingTransforms);
+    if (m_failed)
+        return;
+
+    m_stepCount++;
+    m_transformCount += m_pendingTransforms.size();
+    m_pendingTransforms.clear();
+}
+
+bool SimulationRecorder::Stop(const SimulationEngine& engine)
+{
+    if (!m_file)
+        return false;
+
+    m_header.stepCount = m_stepCount;
+    m_header.transformCount = m_transformCount;
+    m_header.finalHash = HashPositions(engine);
+    bool success = !m_failed && fseek(m_file, 0, SEEK_SET) == 0 && fwrite(&m_header, sizeof(m_header), 1, m_file) == 1;
+    success = (fclose(m_file) == 0) && success;
+    m_file = nullptr;
+
+    if (!CommitTemporaryFile(m_filePath, success))
+    {
+        LOG_ERROR("Could not write the simulation replay %s", m_filePath.c_str());
+        return false;
+    }
+
+    LOG_INFO("Recorded %d simulation steps to %s", (int)m_header.stepCount, m_filePath.filename().c_str());
+    return true;
+}
+
+void SimulationRecorder::Abort()
+{
+    if (!m_file)
+        return;
+
+    fclose(m_file);
+    m_file = nullptr;
+    CommitTemporaryFile(m_filePath, false);  // Only removes the partial replay
+}
+
+
+bool RunReplay(const fs::path& filePath, SimulationEngine& engine, const uint64_t& stepCount, ReplayResult& result,
+               const ReplayProgressFn& progress)
+{
+    using Clock = std::chrono::high_resolution_clock;
+
+    std::error_code error;
+    const size_t fileSize = fs::file_size(filePath, error);
+    FILE* file = error ? nullptr : fopen(filePath.c_str(), "rb");
+    if (!file)
+    {
+        LOG_ERROR("Could not open the simulation replay %s", filePath.c_str());
+        return false;
+    }
+
+    // The steps and their transforms are stored after the snapshot, which is given the bytes left before them
+    SimulationReplayHeader header{};
+    bool valid = fileSize >= sizeof(header) &&
+                 fread(&header, sizeof(header), 1, file) == 1 &&
+                 std::string(header.sign, 4) == "SIMR" &&
+                 header.version == SIMULATION_REPLAY_VERSION &&
+                 header.solver < GetReplaySolvers().size() &&
+                 header.stepCount > 0 &&
+                 header.stepCount <= (fileSize - sizeof(header)) / sizeof(ReplayStep) &&
+                 header.transformCount <= (fileSize - sizeof(header) - header.stepCount * sizeof(ReplayStep)) / sizeof(ReplayTransform);
+
+    const size_t stepsSize = valid ? header.stepCount * sizeof(ReplayStep) + header.transformCount * sizeof(ReplayTransform) : 0;
+    valid = valid && ReadSimulationSnapshot(file, fileSize - sizeof(header) - stepsSize, engine) &&
+                     fseek(file, fileSize - stepsSize, SEEK_SET) == 0;
+
+    // The transforms of each step follow it, their total count has to match the header
+    std::vector<ReplayStep> steps;
+    std::vector<ReplayTransform> transforms;
+    if (valid)
+    {
+        steps.resize(header.stepCount);
+        transforms.reserve(header.transformCount);
+        for (auto& step : steps)
+        {
+            valid = fread(&step, sizeof(step), 1, file) == 1 &&
+                    step.transformCount <= header.transformCount - transforms.size();
+            if (!valid)
+                break;
+
+            transforms.resize(transforms.size() + step.transformCount);
+            valid = fread(transforms.data() + transforms.size() - step.transformCount, sizeof(ReplayTransform), step.transformCount, file) == step.transformCount;
+            if (!valid)
+                break;
+        }
+        valid = valid && transforms.size() == header.transformCount;
+    }
+    fclose(file);
+
+    if (!valid)
+    {
+        LOG_ERROR("Invalid simulation replay %s", filePath.c_str());
+        return false;
+    }
+
+    const float gravity = getGravity();
+    const glm::vec3 wind = getWind();
+    const XPBDSettings xpbdSettings = getXPBDSettings();
+    const ImplicitSettings implicitSettings = getImplicitSettings();
+    const CollisionSettings collisionSettings = getCollisionSettings();
+    const SleepSettings sleepSettings = getSleepSettings();
+    getXPBDSettings() = header.xpbdSettings;
+    getImplicitSettings() = header.implicitSettings;
+    getCollisionSettings() = header.collisionSettings;
+    getSleepSettings() = header.sleepSettings;
+
+    const SolverFn solver = GetReplaySolvers()[header.solver];
+    engine.useTypedKernels = header.useTypedKernels != 0;
+    result.stepCount = stepCount > 0 ? stepCount : header.stepCount;
+    result.cancelled = false;
+
+    auto start = Clock::now();
+    size_t transformIndex = 0;
+    for (uint64_t i = 0 ; i < result.stepCount ; i++)
+    {
+        // The settings are still restored when cancelled, the steps run so far are reported
+        if (progress && i % 16 == 0 && !progress(float(i) / result.stepCount))
+        {
+            result.stepCount = i;
+            result.cancelled = true;
+            break;
+        }
+
+        if (i % steps.size() == 0)
+            transformIndex = 0;
+
+        const ReplayStep& step = steps[i % steps.size()];
+        for (uint32_t n = 0 ; n < step.transformCount ; n++)
+        {
+            const ReplayTransform& transform = transforms[transformIndex++];
+            if (transform.obstacle >= engine.obstacles.size())
+                continue;
+            engine.obstacles[transform.obstacle].position = glm::make_vec3(transform.position);
+            engine.obstacles[transform.obstacle].rotation = glm::make_mat3(transform.rotation);
+        }
+
+        getGravity() = step.gravity;
+        getWind() = glm::vec3(step.wind[0], step.wind[1], step.wind[2]);
+        solver(engine, step.deltaTime);
+    }
+    result.duration = std::chrono::duration<double>(Clock::now() - start).count();
+    result.stepsPerSecond = result.duration > 0.0 ? result.stepCount / result.duration : 0.0;
+
+    // The time budget of the implicit solver makes its replays diverge when the machine is loaded
+    result.checked = !result.cancelled && result.stepCount == header.stepCount;
+    result.matchesRecording = result.checked && HashPositions(engine) == header.finalHash;
+
+    getGravity() = gravity;
+    getWind() = wind;
+    getXPBDSettings() = xpbdSettings;
+    getImplicitSettings() = implicitSettings;
+    getCollisionSettings() = collisionSettings;
+    getSleepSettings() = sleepSettings;
+
+    LOG_INFO("Replayed %d steps of %s in %.3fs : %.1f steps/s%s%s",
+             (int)result.stepCount,
+             filePath.filename().c_str(),
+             result.duration,
+             result.stepsPerSecond,
+             result.checked ? (result.matchesRecording ? ", matching the recording" : ", diverging from the recording") : "",
+             result.cancelled ? ", cancelled" : "");
+    return true;
+}
@@ -0,0 +1,117 @@
+#ifndef SIMULATIONREPLAY_H
+#define SIMULATIONREPLAY_H
+
+#include "SimulationEngine.h"
+
+#include <glm/glm.hpp>
+
+#include <atomic>
+#include <cstdio>
+#include <filesystem>
+#include <functional>
+#include <vector>
+
+
+namespace fs = std::filesystem;
+
+
+// A replay holds the solver and its settings, a snapshot of the engine when the recording started and
+// the inputs of every step, so that the same steps can be run again headless. The settings are the
+// ones of the start of the recording, changing them while recording is not captured. The obstacles
+// moved during the recording are stored with the step they were moved before.
+#define SIMULATION_REPLAY_EXTENSION ".replay"
+#define SIMULATION_REPLAY_VERSION 3
+
+struct SimulationReplayHeader
+{
+    char sign[4];
+    uint32_t version;
+    uint32_t solver;       // Index in GetReplaySolvers
+    uint32_t useTypedKernels;
+    XPBDSettings xpbdSettings;
+    ImplicitSettings implicitSettings;
+    CollisionSettings collisionSettings;
+    SleepSettings sleepSettings;
+    uint64_t stepCount;
+    uint64_t transformCount;
+    uint64_t finalHash;    // Hash of the positions after the last step, to check the replays
+};
+
+struct ReplayStep
+{
+    double deltaTime;
+    float gravity;
+    float wind[3];
+    uint32_t transformCount;  // ReplayTransforms following the step, applied before it
+};
+
+struct ReplayTransform
+{
+    uint32_t obstacle;     // Index in the obstacles of the engine
+    float position[3];
+    float rotation[9];
+};
+
+
+// Solvers that can be recorded, in the order of the solver combo of the UI
+const std::vector<SolverFn>& GetReplaySolvers();
+
+uint64_t HashPositions(const SimulationEngine& engine);
+
+
+// Streams the inputs of the steps to a temporary file, renamed to the replay once stopped. The steps
+// are recorded by the simulation thread while the step count can be read from the render thread.
+class SimulationRecorder
+{
+public:
+    SimulationRecorder() = default;
+    ~SimulationRecorder();
+
+    SimulationRecorder(const SimulationRecorder&) = delete;
+    SimulationRecorder& operator=(const SimulationRecorder&) = delete;
+
+    bool Start(const fs::path& filePath, const SimulationEngine& engine, const SolverFn& solver);
+    // Obstacle moved before the next recorded step
+    void RecordObstacleTransform(const uint32_t& obstacle, const glm::vec3& position, const glm::mat3& rotation);
+    // Inputs of the step about to run, the gravity and wind are the current global ones
+    void Record(const double& deltaTime);
+    bool Stop(const SimulationEngine& engine);
+
+    inline bool IsRecording() const { return m_file != nullptr; }
+    inline uint64_t GetStepCount() const { return m_stepCount.load(); }
+
+private:
+    void Abort();
+
+    FILE* m_file = nullptr;
+    fs::path m_filePath;
+    SimulationReplayHeader m_header{};
+    std::atomic<uint64_t> m_stepCount = 0;
+    uint64_t m_transformCount = 0;
+    std::vector<ReplayTransform> m_pendingTransforms;
+    bool m_failed = false;
+};
+
+
+struct ReplayResult
+{
+    uint64_t stepCount = 0;
+    double duration = 0.0;
+    double stepsPerSecond = 0.0;
+    // Only checked when exactly the recorded steps were run
+    bool checked = false;
+    bool matchesRecording = false;
+    bool cancelled = false;
+};
+
+// Called with the progress between the steps, the replay stops when it returns false
+using ReplayProgressFn = std::function<bool(const float&)>;
+
+// Restore the snapshot of a replay into the engine and run its steps as fast as possible, cycling
+// through the recorded inputs when more steps than recorded are requested (0 runs the recorded count).
+// The engine runs the recorded kernels, the global gravity, wind and settings are restored afterwards.
+bool RunReplay(const fs::path& filePath, SimulationEngine& engine, const uint64_t& stepCount, ReplayResult& result,
+               const ReplayProgressFn& progress=nullptr);
+
+
+#endif  // SIMULATIONREPLAY_H
@@ -0,0 +1,212 @@
+#include "SimulationSnapshot.h"
+
+#include "Base/BinaryFile.h"
+#include "Base/Logging.h"
+
+#include <glm/gtc/type_ptr.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+
+
+using NormFn = float(*)(const glm::vec3&, const glm::vec3&);
+
+// Obstacles are recognized from their functions, false for the ones using custom functions
+inline bool GetObstacleKind(const Obstacle& obstacle, ObstacleKind& kind)
+{
+    if (obstacle.field)
+    {
+        kind = ObstacleKind::Mesh;
+        return true;
+    }
+
+    const NormFn* norm = obstacle.distanceFn.target<NormFn>();
+    if (norm && *norm == &euclidianNorm)
+        kind = ObstacleKind::Sphere;
+    else if (norm && *norm == &infiniteNorm)
+        kind = ObstacleKind::Cube;
+    else
+        return false;
+
+    return true;
+}
+
+
+bool WriteSimulationSnapshot(FILE* file, const SimulationEngine& engine)
+{
+    if (!engine.customLinks.empty())
+        LOG_WARNING("The %d custom links are not stored in the simulation snapshot", (int)engine.customLinks.size());
+
+    // Each field shared by several obstacles is written once
+    std::vector<ObstacleRecord> obstacles;
+    std::vector<const SignedDistanceField*> fields;
+    for (const auto& obstacle : engine.obstacles)
+    {
+        ObstacleRecord record;
+        if (!GetObstacleKind(obstacle, record.kind))
+        {
+            LOG_WARNING("An obstacle with custom functions is not stored in the simulation snapshot");
+            continue;
+        }
+
+        std::memcpy(record.position, glm::value_ptr(obstacle.position), sizeof(record.position));
+        std::memcpy(record.rotation, glm::value_ptr(obstacle.rotation), sizeof(record.rotation));
+        record.size = obstacle.size;
+        record.stiffness = obstacle.stiffness;
+        record.field = 0;
+        if (record.kind == ObstacleKind::Mesh)
+        {
+            auto found = std::find(fields.begin(), fields.end(), obstacle.field.get());
+            record.field = found - fields.begin();
+            if (found == fields.end())
+                fields.push_back(obstacle.field.get());
+        }
+        obstacles.push_back(record);
+    }
+
+    SimulationSnapshotHeader header{{'S', 'I', 'M', 'S'},
+                                    SIMULATION_SNAPSHOT_VERSION,
+                                    engine.positions.size(),
+                                    engine.linkParticles.size(),
+                                    engine.linkGroupOffsets.size(),
+                                    engine.particleRanges.size(),
+                                    obstacles.size(),
+                                    fields.size()};
+    bool success = fwrite(&header, sizeof(header), 1, file) == 1 &&
+                   WriteArray(file, engine.positions) &&
+                   WriteArray(file, engine.velocities) &&
+                   WriteArray(file, engine.inverseMasses) &&
+                   WriteArray(file, engine.linkParticles) &&
+                   WriteArray(file, engine.linkStiffness) &&
+                   WriteArray(file, engine.linkRestLengths) &&
+                   WriteArray(file, engine.linkDamping) &&
+                   WriteArray(file, engine.linkGroupOffsets) &&
+                   WriteArray(file, engine.particleRanges) &&
+                   WriteArray(file, obstacles);
+    for (uint32_t i = 0 ; success && i < fields.size() ; i++)
+        success = WriteSignedDistanceField(file, *fields[i]);
+
+    return success;
+}
+
+
+bool ReadSimulationSnapshot(FILE* file, const size_t& remainingSize, SimulationEngine& engine)
+{
+    engine.Clear();
+    engine.obstacles.clear();
+
+    SimulationSnapshotHeader header{};
+    bool valid = remainingSize >= sizeof(header) &&
+                 fread(&header, sizeof(header), 1, file) == 1 &&
+                 std::string(header.sign, 4) == "SIMS" &&
+                 header.version == SIMULATION_SNAPSHOT_VERSION &&
+                 std::max({header.particleCount, header.linkCount, header.linkGroupCount,
+                           header.particleRangeCount, header.obstacleCount, header.fieldCount}) <= remainingSize;
+
+    // Guard against truncated files before allocating anything, the fields check their own size
+    const uint64_t arraysSize = header.particleCount * (2 * sizeof(glm::vec3) + sizeof(float)) +
+                                header.linkCount * (sizeof(glm::uvec2) + 3 * sizeof(float)) +
+                                header.linkGroupCount * sizeof(uint32_t) +
+                                header.particleRangeCount * sizeof(ParticleRange) +
+                                header.obstacleCount * sizeof(ObstacleRecord);
+    valid = valid && arraysSize <= remainingSize - sizeof(header);
+
+    std::vector<ObstacleRecord> obstacles;
+    valid = valid && ReadArray(file, engine.positions, header.particleCount)
+                  && ReadArray(file, engine.velocities, header.particleCount)
+                  && ReadArray(file, engine.inverseMasses, header.particleCount)
+                  && ReadArray(file, engine.linkParticles, header.linkCount)
+                  && ReadArray(file, engine.linkStiffness, header.linkCount)
+                  && ReadArray(file, engine.linkRestLengths, header.linkCount)
+                  && ReadArray(file, engine.linkDamping, header.linkCount)
+                  && ReadArray(file, engine.linkGroupOffsets, header.linkGroupCount)
+                  && ReadArray(file, engine.particleRanges, header.particleRangeCount)
+                  && ReadArray(file, obstacles, header.obstacleCount);
+
+    std::vector<std::shared_ptr<const SignedDistanceField>> fields;
+    size_t fieldsSize = valid ? remainingSize - sizeof(header) - arraysSize : 0;
+    for (uint64_t i = 0 ; valid && i < header.fieldCount ; i++)
+    {
+        auto field = std::make_shared<SignedDistanceField>();
+        long start = ftell(file);
+        valid = ReadSignedDistanceField(file, fieldsSize, *field);
+        fieldsSize -= ftell(file) - start;
+        fields.push_back(field);
+    }
+
+    // Links and ranges must only reference stored particles
+    for (uint64_t i = 0 ; valid && i < header.linkCount ; i++)
+        valid = engine.linkParticles[i].x < header.particleCount && engine.linkParticles[i].y < header.particleCount;
+    for (uint64_t i = 0 ; valid && i < header.linkGroupCount ; i++)
+        valid = engine.linkGroupOffsets[i] <= header.linkCount;
+    for (uint64_t i = 0 ; valid && i < header.particleRangeCount ; i++)
+        valid = engine.particleRanges[i].begin <= engine.particleRanges[i].end && engine.particleRanges[i].end <= header.particleCount;
+
+    for (uint64_t i = 0 ; valid && i < header.obstacleCount ; i++)
+    {
+        const ObstacleRecord& record = obstacles[i];
+        const glm::vec3 position = glm::make_vec3(record.position);
+        switch (record.kind)
+        {
+            case ObstacleKind::Sphere:
+                engine.obstacles.push_back(SphereObstacle(position, record.size, record.stiffness));
+                break;
+            case ObstacleKind::Cube:
+                engine.obstacles.push_back(CubeObstacle(position, record.size, record.stiffness));
+                break;
+            case ObstacleKind::Mesh:
+                valid = record.field < fields.size();
+                if (valid)
+                    engine.obstacles.push_back(MeshObstacle(fields[record.field],
+                                                            position,
+                                                            glm::make_mat3(record.rotation),
+                                                            record.size,
+                                                            record.stiffness));
+                break;
+            default:
+                valid = false;
+        }
+    }
+
+    if (!valid)
+    {
+        engine.Clear();
+        engine.obstacles.clear();
+        return false;
+    }
+
+    engine.forces.assign(header.particleCount, glm::vec3(0.0f));
+    BuildImplicitPattern(engine);
+    return true;
+}
+
+
+bool SaveSimulationSnapshot(const fs::path& filePath, const SimulationEngine& engine)
+{
+    bool success = WriteFileAtomically(filePath, [&](FILE* file) { return WriteSimulationSnapshot(file, engine); });
+
+    if (!success)
+        LOG_WARNING("Could not write the simulation snapshot %s", filePath.c_str());
+    return success;
+}
+
+
+bool LoadSimulationSnapshot(const fs::path& filePath, SimulationEngine& engine)
+{
+    std::error_code error;
+    const size_t fileSize = fs::file_size(filePath, error);
+    FILE* file = error ? nullptr : fopen(filePath.c_str(), "rb");
+    if (!file)
+    {
+        LOG_ERROR("Could not open the simulation snapshot %s", filePath.c_str());
+        return false;
+    }
+
+    bool success = ReadSimulationSnapshot(file, fileSize, engine);
+    fclose(file);
+
+    if (!success)
+        LOG_ERROR("Invalid simulation snapshot %s", filePath.c_str());
+    return success;
+}
@@ -0,0 +1,58 @@
+#ifndef SIMULATIONSNAPSHOT_H
+#define SIMULATIONSNAPSHOT_H
+
+#include "SimulationEngine.h"
+
+#include <glm/glm.hpp>
+
+#include <cstdio>
+#include <filesystem>
+
+
+namespace fs = std::filesystem;
+
+
+// Particles, links and obstacles of an engine, each array written as is so that restoring a state is
+// a plain read. Links keep their color grouping, the scratch buffers of the solvers are not stored.
+#define SIMULATION_SNAPSHOT_VERSION 1
+
+struct SimulationSnapshotHeader
+{
+    char sign[4];
+    uint32_t version;
+    uint64_t particleCount,
+             linkCount,
+             linkGroupCount,
+             particleRangeCount,
+             obstacleCount,
+             fieldCount;
+};
+
+enum class ObstacleKind : uint32_t
+{
+    Sphere = 0,
+    Cube,
+    Mesh
+};
+
+struct ObstacleRecord
+{
+    float position[3];
+    float size;
+    float stiffness;
+    ObstacleKind kind;
+    float rotation[9];
+    uint32_t field;     // Index of the field among the ones of the snapshot, for mesh obstacles
+};
+
+
+// Custom links and obstacles with custom functions can't be stored, they are skipped with a warning
+bool WriteSimulationSnapshot(FILE* file, const SimulationEngine& engine);
+// The engine is left cleared if the snapshot is invalid or doesn't fit in the remaining bytes
+bool ReadSimulationSnapshot(FILE* file, const size_t& remainingSize, SimulationEngine& engine);
+
+bool SaveSimulationSnapshot(const fs::path& filePath, const SimulationEngine& engine);
+bool LoadSimulationSnapshot(const fs::path& filePath, SimulationEngine& engine);
+
+
+#endif  // SIMULATIONSNAPSHOT_H
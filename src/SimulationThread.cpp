@@ -0,0 +1,186 @@
+#include "SimulationThread.h"
+
+#include <chrono>
+
+
+SimulationThread::SimulationThread(SimulationEngine& engine, 
+                                   const SolverFn& solver, 
+                                   const double& stepDuration, 
+                                   const uint32_t& maxSubsteps) : 
+    m_engine(engine),
+    m_solver(solver),
+    m_clock(stepDuration, maxSubsteps)
+{
+    m_previousPositions = m_engine.positions;
+    Publish(0);
+    Fetch();
+    m_thread = std::thread(&SimulationThread::Run, this);
+}
+
+SimulationThread::~SimulationThread()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_condition.notify_one();
+    m_thread.join();
+}
+
+void SimulationThread::Submit(const double& frameDuration)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_pendingTime += frameDuration;
+    }
+    m_condition.notify_all();
+}
+
+bool SimulationThread::Fetch()
+{
+    if (!(m_readyState.load() & FreshState))
+        return false;
+
+    m_readState = m_readyState.exchange(m_readState) & ~FreshState;
+    return true;
+}
+
+void SimulationThread::Pause()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_pauseCount++;
+    m_condition.wait(lock, [this]() { return !m_busy; });
+}
+
+void SimulationThread::Resume()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_pauseCount--;
+    }
+    m_condition.notify_all();
+}
+
+void SimulationThread::Reset()
+{
+    PauseGuard pause(*this);
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_pendingTime = 0.0;
+    }
+
+    m_clock.Reset();
+    m_previousPositions = m_engine.positions;
+    Publish(0);
+}
+
+void SimulationThread::SetSolver(const SolverFn& solver)
+{
+    PauseGuard pause(*this);
+    m_solver = solver;
+}
+
+void SimulationThread::SetMaxSubsteps(const uint32_t& count)
+{
+    PauseGuard pause(*this);
+    m_clock.SetMaxSubsteps(count);
+}
+
+void SimulationThread::SetStepDuration(const double& duration)
+{
+    PauseGuard pause(*this);
+    m_clock.SetStepDuration(duration);
+}
+
+void SimulationThread::SetObstacleTransform(const uint32_t& obstacle, const glm::vec3& position, const glm::mat3& rotation)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_pendingTransforms.push_back({obstacle, position, rotation});
+}
+
+bool SimulationThread::StartRecording(const fs::path& filePath)
+{
+    PauseGuard pause(*this);
+
+    // The snapshot doesn't hold the sleeping regions, the recorded steps start from the fully awake
+    // state a restored engine has so that the replay takes the same steps
+    m_engine.sleep = SleepData();
+    return m_recorder.Start(filePath, m_engine, m_solver);
+}
+
+bool SimulationThread::StopRecording()
+{
+    PauseGuard pause(*this);
+    return m_recorder.Stop(m_engine);
+}
+
+void SimulationThread::Publish(const uint32_t& substeps)
+{
+    SimulationState& state = m_states[m_writeState];
+    state.previousPositions = m_previousPositions;
+    state.positions = m_engine.positions;
+    state.interpolation = m_clock.GetInterpolation();
+    state.substeps = substeps;
+    state.activeParticles = m_engine.GetActiveParticleCount();
+    state.stepTime = m_stepTime;
+    state.droppedTime = m_clock.GetDroppedTime();
+    state.solverIterations = m_engine.solverIterations;
+    state.solverResidual = m_engine.solverResidual;
+
+    m_writeState = m_readyState.exchange(m_writeState | FreshState) & ~FreshState;
+}
+
+void SimulationThread::Run()
+{
+    using Clock = std::chrono::high_resolution_clock;
+
+    std::vector<ObstacleTransform> transforms;
+    while (true)
+    {
+        double frameDuration;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_condition.wait(lock, [this]() { return m_stop || (m_pauseCount == 0 && m_pendingTime > 0.0); });
+            if (m_stop)
+                return;
+
+            // Frames submitted while the previous steps were running are simulated together
+            frameDuration = m_pendingTime;
+            m_pendingTime = 0.0;
+            transforms.swap(m_pendingTransforms);
+            m_busy = true;
+        }
+
+        // The obstacles may have been replaced while the worker was paused
+        for (const auto& transform : transforms)
+        {
+            if (transform.obstacle >= m_engine.obstacles.size())
+                continue;
+            m_engine.obstacles[transform.obstacle].position = transform.position;
+            m_engine.obstacles[transform.obstacle].rotation = transform.rotation;
+            m_recorder.RecordObstacleTransform(transform.obstacle, transform.position, transform.rotation);
+        }
+        transforms.clear();
+
+        uint32_t substeps = m_clock.Advance(frameDuration);
+        auto start = Clock::now();
+        for (uint32_t step = 0 ; step < substeps ; step++)
+        {
+            if (step + 1 == substeps)
+                m_previousPositions = m_engine.positions;
+            m_recorder.Record(m_clock.GetStepDuration());
+            m_solver(m_engine, m_clock.GetStepDuration());
+        }
+        if (substeps > 0)
+            m_stepTime = std::chrono::duration<double>(Clock::now() - start).count() / substeps;
+
+        // The rendered interpolation moves forward even without a new step
+        Publish(substeps);
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_busy = false;
+        }
+        m_condition.notify_all();
+    }
+}
@@ -0,0 +1,127 @@
+#ifndef SIMULATIONTHREAD_H
+#define SIMULATIONTHREAD_H
+
+
+#include "SimulationEngine.h"
+#include "SimulationClock.h"
+#include "SimulationReplay.h"
+
+#include <glm/glm.hpp>
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+// Cloth state published by the simulation thread once its steps of a frame are completed
+struct SimulationState
+{
+    std::vector<glm::vec3> previousPositions;  // Before the last step
+    std::vector<glm::vec3> positions;
+    float interpolation = 0.0f;
+
+    uint32_t substeps = 0;
+    uint32_t activeParticles = 0;  // Particles of the awake regions
+    double stepTime = 0.0;  // Average duration of the last steps
+    double droppedTime = 0.0;
+
+    // Iterations and residual of the last step of an iterative solver
+    uint32_t solverIterations = 0;
+    float solverResidual = 0.0f;
+};
+
+
+// Runs the steps of the simulation clock on a worker thread while the render thread draws the
+// previous state. Completed states go through a triple buffer so that neither side ever waits.
+class SimulationThread
+{
+public:
+    SimulationThread(SimulationEngine& engine, const SolverFn& solver, const double& stepDuration, const uint32_t& maxSubsteps);
+    ~SimulationThread();
+
+    SimulationThread(const SimulationThread&) = delete;
+    SimulationThread& operator=(const SimulationThread&) = delete;
+
+    // Add the duration of a frame to simulate, runs in the background
+    void Submit(const double& frameDuration);
+
+    // Swap the latest completed state in, returns false if none was completed since the last call
+    bool Fetch();
+    inline const SimulationState& GetState() const { return m_states[m_readState]; }
+
+    // Stop the worker before its next steps and block until it is idle. The engine, the simulation
+    // settings and the globals they read can be modified until the matching Resume, pauses can be nested.
+    void Pause();
+    void Resume();
+
+    class PauseGuard
+    {
+    public:
+        explicit PauseGuard(SimulationThread& thread) : m_thread(thread) { m_thread.Pause(); }
+        ~PauseGuard() { m_thread.Resume(); }
+
+        PauseGuard(const PauseGuard&) = delete;
+        PauseGuard& operator=(const PauseGuard&) = delete;
+
+    private:
+        SimulationThread& m_thread;
+    };
+
+    // Restart the clock and publish the current engine state, to call after the engine was reset
+    void Reset();
+
+    void SetSolver(const SolverFn& solver);
+    void SetMaxSubsteps(const uint32_t& count);
+    void SetStepDuration(const double& duration);
+
+    // Move an obstacle of the engine before the next steps, without waiting for the worker so that
+    // an obstacle can be animated every frame
+    void SetObstacleTransform(const uint32_t& obstacle, const glm::vec3& position, const glm::mat3& rotation);
+
+    // Record the inputs of the next steps to a replay, starting from the current engine state
+    bool StartRecording(const fs::path& filePath);
+    bool StopRecording();
+    inline bool IsRecording() const { return m_recorder.IsRecording(); }
+    inline uint64_t GetRecordedStepCount() const { return m_recorder.GetStepCount(); }
+
+private:
+    void Run();
+    void Publish(const uint32_t& substeps);
+
+    SimulationEngine& m_engine;
+    SolverFn m_solver;
+    SimulationClock m_clock;
+    SimulationRecorder m_recorder;
+
+    // Owned by the worker while it is busy
+    std::vector<glm::vec3> m_previousPositions;
+    double m_stepTime = 0.0;
+
+    std::thread m_thread;
+    std::mutex m_mutex;
+    std::condition_variable m_condition;
+    bool m_stop = false;
+    bool m_busy = false;
+    uint32_t m_pauseCount = 0;
+    double m_pendingTime = 0.0;  // Frames submitted while paused are simulated once resumed
+
+    struct ObstacleTransform
+    {
+        uint32_t obstacle;
+        glm::vec3 position;
+        glm::mat3 rotation;
+    };
+    std::vector<ObstacleTransform> m_pendingTransforms;
+
+    // Triple buffer, the ready index carries a flag telling it holds a state not fetched yet
+    static const uint32_t FreshState = 4;
+    SimulationState m_states[3];
+    uint32_t m_writeState = 0;
+    uint32_t m_readState = 1;
+    std::atomic<uint32_t> m_readyState = 2;
+};
+
+
+#endif  // SIMULATIONTHREAD_H
@@ -1,11 +1,20 @@
 #include "WrapDeformer.h"
 
+#include "Base/BinaryFile.h"
+#include "Base/BVH.h"
+#include "Base/Hash.h"
+#include "Base/Logging.h"
 #include "Base/Math.h"
 
 #include <glm/gtx/string_cast.hpp>
 
 #include <omp.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <iostream>
+#include <string>
 
 
 WrapDeformer::WrapDeformer()
@@ -20,18 +29,64 @@ WrapDeformer::~WrapDeformer()
 
 void WrapDeformer::Initialize(const std::vector<glm::vec3>& points, 
                               const std::vector<Vertex>& driverVertices, 
-                              const std::vector<uint32_t>& driverIndices)
+                              const std::vector<uint32_t>& driverIndices,
+                              const ProgressFn& progress)
 {
-    m_bindings.clear();
-    m_bindings.reserve(points.size());
-    m_coordinates.clear();
-    m_coordinates.reserve(points.size());
+    auto start = std::chrono::high_resolution_clock::now();
+
+    m_bindings.resize(points.size());
+    m_deformedPoints.clear();
+    m_coordinates.resize(points.size());
+    m_sourceHash = 0;
+
+    // The closest triangles are queried through the BVH in chunks of points, each chunk being
+    // parallelized and the progress reported between them. The brute force search is parallelized
+    // over all the points and reports the progress from the first thread only
+    std::vector<Mesh::BVH::ClosestHit> hits;
+    if (m_useBVH)
+    {
+        Mesh::BVH bvh;
+        bvh.Build(driverVertices, driverIndices);
+        hits.resize(points.size());
+
+        constexpr uint32_t chunkSize = 1 << 16;
+        for (uint32_t chunkStart = 0 ; chunkStart < points.size() ; chunkStart += chunkSize)
+        {
+            if (progress)
+                progress(float(chunkStart) / points.size());
+
+            const uint32_t chunkEnd = std::min<uint32_t>(chunkStart + chunkSize, points.size());
+            #pragma omp parallel for schedule(dynamic, 256) num_threads(omp_get_max_threads())
+            for (uint32_t i = chunkStart ; i < chunkEnd ; i++)
+            {
+                Mesh::BVH::ClosestHit& hit = hits[i];
+                hit.found = bvh.ClosestPoint(points[i], hit.point, hit.triangle, hit.distance);
+            }
+        }
+    }
+    else
+    {
+        hits.resize(points.size());
+        std::atomic<uint32_t> boundCount = 0;
+
+        #pragma omp parallel for schedule(dynamic, 256) num_threads(omp_get_max_threads())
+        for (uint32_t i = 0 ; i < points.size() ; i++)
+        {
+            if (progress && i % 256 == 0 && omp_get_thread_num() == 0)
+                progress(float(boundCount) / points.size());
 
-    for (const auto& point : points)
+            Mesh::BVH::ClosestHit& hit = hits[i];
+            hit.point = Mesh::ClosestPointOnMesh(points[i], driverVertices, driverIndices, hit.triangle, hit.distance);
+            hit.found = true;
+            boundCount++;
+        }
+    }
+
+    #pragma omp parallel for num_threads(omp_get_max_threads())
+    for (uint32_t i = 0 ; i < points.size() ; i++)
     {
-        uint32_t triangleIndex;
-        float distance;
-        Mesh::ClosestPointOnMesh(point, driverVertices, driverIndices, triangleIndex, distance);
+        const glm::vec3& point = points[i];
+        const uint32_t triangleIndex = hits[i].found ? hits[i].triangle : 0;
 
         glm::vec3 p1 = driverVertices[driverIndices[triangleIndex * 3]].position;
         glm::vec3 p2 = driverVertices[driverIndices[triangleIndex * 3 + 1]].position;
@@ -44,24 +99,64 @@ void WrapDeformer::Initialize(const std::vector<glm::vec3>& points,
         if (glm::dot(normal, point - projectedPoint) < 0.0)
             normalOffset *= -1;
 
-        m_bindings.push_back(triangleIndex);
-        m_coordinates.push_back({barycentric.x, barycentric.y, barycentric.z, normalOffset});
+        m_bindings[i] = triangleIndex;
+        m_coordinates[i] = {barycentric.x, barycentric.y, barycentric.z, normalOffset};
     }
 
     m_restPoints = points;
+
+    const double duration = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+    LOG_INFO("Bound %d points to %d triangles in %.3fs%s", (int)points.size(), (int)driverIndices.size() / 3, duration,
+             m_useBVH ? "" : " without BVH");
+
+    if (progress)
+        progress(1.0f);
+}
+
+void WrapDeformer::InitializeCached(const fs::path& cachePath,
+                                    const uint64_t& fibersHash,
+                                    const std::vector<glm::vec3>& points, 
+                                    const std::vector<Vertex>& driverVertices, 
+                                    const std::vector<uint32_t>& driverIndices,
+                                    const ProgressFn& progress)
+{
+    auto start = std::chrono::high_resolution_clock::now();
+
+    const uint64_t sourceHash = HashWrapSource(fibersHash, driverVertices, driverIndices);
+    if (LoadWrapCache(cachePath, sourceHash, driverIndices.size() / 3, *this) && m_bindings.size() == points.size())
+    {
+        const double duration = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+        LOG_INFO("Loaded the bindings of %d points from %s in %.2fms", (int)points.size(), cachePath.filename().c_str(), duration);
+        if (progress)
+            progress(1.0f);
+        return;
+    }
+
+    Initialize(points, driverVertices, driverIndices, progress);
+    m_sourceHash = sourceHash;
+    SaveWrapCache(cachePath, *this);
 }
 
 void WrapDeformer::Deform(std::vector<glm::vec3>& points, 
                           const std::vector<Vertex>& driverVertices, 
-                          const std::vector<uint32_t>& driverIndices) const
+                          const std::vector<uint32_t>& driverIndices,
+                          const std::vector<uint8_t>* movedVertices)
 {
     if (m_bindings.empty())
         return;
 
+    const bool partial = movedVertices && HasDeformed();
+    m_deformedPoints.resize(m_bindings.size());
+
     #pragma omp parallel for num_threads(omp_get_max_threads())
     for (uint32_t i = 0 ; i < points.size() ; i++)
     {
         const uint32_t& triangleIndex = m_bindings[i];
+        if (partial && !(*movedVertices)[driverIndices[triangleIndex * 3]] &&
+                       !(*movedVertices)[driverIndices[triangleIndex * 3 + 1]] &&
+                       !(*movedVertices)[driverIndices[triangleIndex * 3 + 2]])
+            continue;
+
         const glm::vec3 barycentric = m_coordinates[i];
         const float normalOffset = m_coordinates[i].w;
 
@@ -71,51 +166,169 @@ void WrapDeformer::Deform(std::vector<glm::vec3>& points,
 
         const glm::vec3 normal = glm::normalize(glm::cross(v1 - v2, v2 - v3));
 
-        points[i] = BarycentricToCartesian(barycentric, v1, v2, v3) + normal * normalOffset;
+        m_deformedPoints[i] = BarycentricToCartesian(barycentric, v1, v2, v3) + normal * normalOffset;
+    }
+
+    if (m_iterations > 0)
+        ApplySmooth(points);
+    else
+        points = m_deformedPoints;
+}
+
+
+void WrapDeformer::ApplySmooth(std::vector<glm::vec3>& points)
+{
+    const uint32_t pointCount = m_deformedPoints.size();
+    points.resize(pointCount);
+    m_offsets.resize(pointCount);
+    m_smoothedOffsets.resize(pointCount);
+
+    if (m_curves.empty())
+    {
+        SmoothCurve({0, pointCount, 0}, points);
+        return;
     }
 
-    ApplySmooth(points);
+    // The curves are independent, each one runs all its iterations while it is in the cache
+    #pragma omp parallel for schedule(dynamic, 64) num_threads(omp_get_max_threads())
+    for (uint32_t i = 0 ; i < m_curves.size() ; i++)
+    {
+        const FiberCurve& curve = m_curves[i];
+        if (size_t(curve.offset) + curve.pointCount <= pointCount)
+            SmoothCurve(curve, points);
+    }
 }
 
 
-void WrapDeformer::ApplySmooth(std::vector<glm::vec3>& points) const
+// Laplacian smoothing of the offsets along the curve, the ends of open curves only average with their
+// single neighbour while closed curves wrap around
+void WrapDeformer::SmoothCurve(const FiberCurve& curve, std::vector<glm::vec3>& points)
 {
-    if (m_iterations <= 0)
+    const uint32_t first = curve.offset;
+    const uint32_t count = curve.pointCount;
+    if (count == 0)
         return;
 
-    std::vector<glm::vec3> deltas = points;
-    std::vector<glm::vec3> deltas2(points.size());
-    for (size_t i = 0 ; i < points.size() ; i++)
-        deltas[i] -= m_restPoints[i];
-        
-    auto* sources = &deltas;
-    auto* smoothed = &deltas2;
-    for (size_t n = 0 ; n < m_iterations ; n++)
+    glm::vec3* sources = m_offsets.data() + first;
+    glm::vec3* smoothed = m_smoothedOffsets.data() + first;
+    for (uint32_t i = 0 ; i < count ; i++)
+        sources[i] = m_deformedPoints[first + i] - m_restPoints[first + i];
+
+    if (count >= 3)
     {
-        for (size_t i = 0 ; i < points.size() ; i++)
+        const bool isClosed = curve.isClosed;
+        const float third = 1.0f / 3.0f;
+        for (uint32_t n = 0 ; n < m_iterations ; n++)
         {
-            glm::vec3 delta = (*sources)[i];
-            float weight = 1.0f;
+            // The inner points are processed as flat floats, neighbours being 3 floats apart
+            const float* src = &sources[0].x;
+            float* dst = &smoothed[0].x;
+            #pragma omp simd
+            for (uint32_t j = 3 ; j < 3 * (count - 1) ; j++)
+                dst[j] = (src[j - 3] + src[j] + src[j + 3]) * third;
 
-            if (i > 0)
+            if (isClosed)
             {
-                delta += deltas[i - 1];
-                weight += 1.0f;
+                smoothed[0] = (sources[count - 1] + sources[0] + sources[1]) * third;
+                smoothed[count - 1] = (sources[count - 2] + sources[count - 1] + sources[0]) * third;
             }
-
-            if (i < points.size())
+            else
             {
-                delta += deltas[i + 1];
-                weight += 1.0f;
+                smoothed[0] = (sources[0] + sources[1]) * 0.5f;
+                smoothed[count - 1] = (sources[count - 2] + sources[count - 1]) * 0.5f;
             }
 
-            (*smoothed)[i] = delta / weight;
+            std::swap(sources, smoothed);
         }
+    }
+    else if (count == 2)
+    {
+        // Both points end up on their average whatever the iteration count
+        const glm::vec3 average = (sources[0] + sources[1]) * 0.5f;
+        sources[0] = sources[1] = average;
+    }
+
+    for (uint32_t i = 0 ; i < count ; i++)
+        points[first + i] = m_restPoints[first + i] + sources[i];
+}
+
+
+fs::path GetWrapCachePath(const fs::path& bccPath)
+{
+    return fs::path(bccPath).replace_extension(WRAP_CACHE_EXTENSION);
+}
+
 
-        std::swap(smoothed, sources);
+uint64_t HashWrapSource(const uint64_t& fibersHash, const std::vector<Vertex>& driverVertices, const std::vector<uint32_t>& driverIndices)
+{
+    std::vector<glm::vec3> positions(driverVertices.size());
+    for (size_t i = 0 ; i < driverVertices.size() ; i++)
+        positions[i] = driverVertices[i].position;
+
+    uint64_t hash = HashData(&fibersHash, sizeof(fibersHash));
+    hash = HashData(positions.data(), positions.size() * sizeof(glm::vec3), hash);
+    return HashData(driverIndices.data(), driverIndices.size() * sizeof(uint32_t), hash);
+}
+
+
+bool LoadWrapCache(const fs::path& cachePath, const uint64_t& sourceHash, const uint32_t& triangleCount, WrapDeformer& wrap)
+{
+    FILE* file = fopen(cachePath.c_str(), "rb");
+    if (!file)
+        return false;
+
+    WrapCacheHeader header;
+    bool valid = fread(&header, sizeof(header), 1, file) == 1 &&
+                 std::string(header.sign, 4) == "WRPX" &&
+                 header.version == WRAP_CACHE_VERSION &&
+                 header.sourceHash == sourceHash;
+
+    // Guard against truncated files before allocating anything, the point count being bounded by the
+    // file size first so that a corrupted header can't overflow the expected size
+    constexpr uint64_t recordSize = sizeof(uint32_t) + sizeof(glm::vec4) + sizeof(glm::vec3);
+    std::error_code error;
+    const uint64_t fileSize = fs::file_size(cachePath, error);
+    valid = valid && !error && fileSize >= sizeof(header) &&
+                     header.pointCount <= (fileSize - sizeof(header)) / recordSize &&
+                     fileSize == sizeof(header) + header.pointCount * recordSize;
+
+    valid = valid && ReadArray(file, wrap.m_bindings, header.pointCount)
+                  && ReadArray(file, wrap.m_coordinates, header.pointCount)
+                  && ReadArray(file, wrap.m_restPoints, header.pointCount);
+    fclose(file);
+
+    valid = valid && std::all_of(wrap.m_bindings.begin(), wrap.m_bindings.end(),
+                                 [&](const uint32_t& triangle) { return triangle < triangleCount; });
+
+    wrap.m_deformedPoints.clear();
+    if (!valid)
+    {
+        wrap.m_bindings.clear();
+        wrap.m_coordinates.clear();
+        wrap.m_restPoints.clear();
+        wrap.m_sourceHash = 0;
+        return false;
     }
 
-    for (size_t i = 0 ; i < points.size() ; i++)
-        points[i] = m_restPoints[i] + (*sources)[i];
-        
-}
\ No newline at end of file
+    wrap.m_sourceHash = sourceHash;
+    return true;
+}
+
+
+bool SaveWrapCache(const fs::path& cachePath, const WrapDeformer& wrap)
+{
+    WrapCacheHeader header{{'W', 'R', 'P', 'X'},
+                           WRAP_CACHE_VERSION,
+                           wrap.m_sourceHash,
+                           wrap.m_bindings.size()};
+    bool success = WriteFileAtomically(cachePath, [&](FILE* file) {
+        return fwrite(&header, sizeof(header), 1, file) == 1 &&
+               WriteArray(file, wrap.m_bindings) &&
+               WriteArray(file, wrap.m_coordinates) &&
+               WriteArray(file, wrap.m_restPoints);
+    });
+
+    if (!success)
+        LOG_WARNING("Could not write the bindings cache %s", cachePath.c_str());
+    return success;
+}
@@ -2,10 +2,20 @@
 #define WRAPDEFORMER_H
 
 
+#include "Base/FiberCurve.h"
 #include "Base/Mesh.h"
 
 #include <glm/glm.hpp>
 
+#include <cstdio>
+#include <filesystem>
+#include <functional>
+
+
+namespace fs = std::filesystem;
+
+using ProgressFn = std::function<void(const float&)>;
+
 
 class WrapDeformer
 {
@@ -13,21 +23,86 @@ public:
     WrapDeformer();
     ~WrapDeformer();
 
+    WrapDeformer(WrapDeformer&&) = default;
+    WrapDeformer& operator=(WrapDeformer&&) = default;
+
     inline bool IsInitialized() const { return (!m_bindings.empty() || !m_coordinates.empty() || !m_restPoints.empty()); }
-    void Initialize(const std::vector<glm::vec3>& points, const std::vector<Vertex>& srcVertices, const std::vector<uint32_t>& srcIndices);
-    void Deform(std::vector<glm::vec3>& points, const std::vector<Vertex>& srcVertices, const std::vector<uint32_t>& srcIndices) const;
+    void Initialize(const std::vector<glm::vec3>& points, const std::vector<Vertex>& srcVertices, const std::vector<uint32_t>& srcIndices,
+                    const ProgressFn& progress=nullptr);
+    // Same as Initialize, loading the bindings from the cache when it matches the fibers hash and the driver mesh,
+    // saving them to it otherwise
+    void InitializeCached(const fs::path& cachePath, const uint64_t& fibersHash,
+                          const std::vector<glm::vec3>& points, const std::vector<Vertex>& srcVertices, const std::vector<uint32_t>& srcIndices,
+                          const ProgressFn& progress=nullptr);
+    // Only the points bound to a triangle with a moved vertex are deformed again when the moved vertices are given,
+    // the other ones keep their previous deformation
+    void Deform(std::vector<glm::vec3>& points, const std::vector<Vertex>& srcVertices, const std::vector<uint32_t>& srcIndices,
+                const std::vector<uint8_t>* movedVertices=nullptr);
+    // False until the points bound by the last Initialize were deformed once
+    inline bool HasDeformed() const { return !m_bindings.empty() && m_deformedPoints.size() == m_bindings.size(); }
+
+    // The smoothing only mixes the points of a same curve, all the points are taken as a single open curve
+    // until the curves of the bound points are given
+    inline void SetCurves(const std::vector<FiberCurve>& curves) { m_curves = curves; }
+    inline const std::vector<FiberCurve>& GetCurves() const { return m_curves; }
+
+    // Binding of each point, to evaluate the deformation elsewhere (GpuWrapDeformer)
+    inline const std::vector<uint32_t>& GetBindings() const { return m_bindings; }
+    inline const std::vector<glm::vec4>& GetCoordinates() const { return m_coordinates; }
+    inline const std::vector<glm::vec3>& GetRestPoints() const { return m_restPoints; }
 
     inline uint32_t GetSmoothIterations() const { return m_iterations; }
     inline void SetSmoothIterations(const uint32_t& count) { m_iterations = count; }
 
+    // The brute force search over all the triangles is kept to compare the binding times
+    inline bool GetUseBVH() const { return m_useBVH; }
+    inline void SetUseBVH(const bool& useBVH) { m_useBVH = useBVH; }
+
 private:
-    void ApplySmooth(std::vector<glm::vec3>& points) const;
+    friend bool LoadWrapCache(const fs::path&, const uint64_t&, const uint32_t&, WrapDeformer&);
+    friend bool SaveWrapCache(const fs::path&, const WrapDeformer&);
+
+    // Smooth the offsets of the deformed points from their rest positions into the given points
+    void ApplySmooth(std::vector<glm::vec3>& points);
+    void SmoothCurve(const FiberCurve& curve, std::vector<glm::vec3>& points);
 
     std::vector<uint32_t> m_bindings;
     std::vector<glm::vec4> m_coordinates;
 
     std::vector<glm::vec3> m_restPoints;
+    std::vector<glm::vec3> m_deformedPoints;  // Before the smoothing
+    std::vector<FiberCurve> m_curves;
     uint32_t m_iterations = 3;
+
+    // Offsets ping-ponged by the smoothing iterations, kept between the frames
+    std::vector<glm::vec3> m_offsets;
+    std::vector<glm::vec3> m_smoothedOffsets;
+    bool m_useBVH = true;
+
+    uint64_t m_sourceHash = 0;  // Hash of the fibers and of the driver mesh the points were bound to
 };
 
+
+// Bindings stored next to their BCC file, checked against the hash of the fibers and of the driver mesh
+#define WRAP_CACHE_EXTENSION ".wrapx"
+#define WRAP_CACHE_VERSION 1
+
+struct WrapCacheHeader
+{
+    char sign[4];
+    uint32_t version;
+    uint64_t sourceHash;
+    uint64_t pointCount;
+};
+
+
+fs::path GetWrapCachePath(const fs::path& bccPath);
+// Only the positions of the driver vertices are hashed, the normals and texture coordinates don't change the bindings
+uint64_t HashWrapSource(const uint64_t& fibersHash, const std::vector<Vertex>& driverVertices, const std::vector<uint32_t>& driverIndices);
+
+// Returns false if the cache is missing, from another version, out of date with the source hash or
+// binding to a triangle past the given count
+bool LoadWrapCache(const fs::path& cachePath, const uint64_t& sourceHash, const uint32_t& triangleCount, WrapDeformer& wrap);
+bool SaveWrapCache(const fs::path& cachePath, const WrapDeformer& wrap);
+
 #endif  // WRAPDEFORMER_H
\ No newline at end of file
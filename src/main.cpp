@@ -1,4 +1,10 @@
 #include "SimulationEngine.h"
+#include "SimulationThread.h"
+#include "SimulationSnapshot.h"
+#include "SimulationReplay.h"
+#include "FibersLoader.h"
+#include "ReplayRunner.h"
+#include "GpuWrapDeformer.h"
 #include "WrapDeformer.h"
 #include "SelfShadows.h"
 #include "ShadowMap.h"
@@ -12,6 +18,7 @@
 #include "Base/Camera.h"
 #include "Base/Profiler.h"
 #include "Base/bccReader.h"
+#include "Base/objReader.h"
 #include "Base/Mesh.h"
 #include "Base/Math.h"
 
@@ -22,6 +29,8 @@
 #include <imgui.h>
 
 #include <iostream>
+#include <limits>
+#include <memory>
 
 
 #define SHADOW_MAP_TEXTURE_UNIT 0
@@ -53,6 +62,8 @@ float fiberRotation = 1.0f;
 glm::vec3 fiberColor = glm::vec3(0.8f);
 // Rendering parameters
 bool showFibers = true;
+int positionStorage = (int)PositionStorage::Float32;
+bool useGpuWrap = false;
 bool showClothMesh = false;
 
 bool useAmbientOcclusion = true;
@@ -73,6 +84,26 @@ glm::vec3 backgroundColor = {0.2f, 0.3f, 0.3f};
 bool enableSimulation = false;
 float fe = 100.0;
 float h = 1.0 / fe;
+int maxSubsteps = 8;
+float stepsPerSecond = fe;
+int solver = 2;
+int replaySteps = 0;  // 0 replays the recorded steps
+const SolverFn solvers[] = {massSpringSolver, massSpringGravitySolver, massSpringGravityWindSolver, xpbdSolver, massSpringImplicitSolver};
+
+// Obstacle parameters, the obstacle is one of the OBJ files of the resources
+int obstacle = 0;  // 0 for no obstacle
+glm::vec3 obstaclePosition = {0.0f, -3.0f, 3.5f};
+glm::vec3 obstacleRotation = glm::vec3(0.0f);  // Euler angles in degrees
+bool animateObstacleRotation = false;
+const float obstacleSpacing = 0.1f;  // Cell size of the signed distance field
+const float obstacleOffset = 0.1f;   // Distance kept from the surface
+
+glm::mat4 ObstacleRotationMatrix()
+{
+    return glm::rotate(glm::mat4(1.0f), glm::radians(obstacleRotation.y), {0.0f, 1.0f, 0.0f}) *
+           glm::rotate(glm::mat4(1.0f), glm::radians(obstacleRotation.x), {1.0f, 0.0f, 0.0f}) *
+           glm::rotate(glm::mat4(1.0f), glm::radians(obstacleRotation.z), {0.0f, 0.0f, 1.0f});
+}
 
 
 int main(int argc, char *argv[])
@@ -110,10 +141,10 @@ int main(int argc, char *argv[])
     fs::path filePath = resolver.Resolve(filename);
     std::vector<fs::path> availableFiles = ListBCCFiles(resolver.Resolve("resources"));
 
-    std::vector<glm::vec3> fibersVertices;
-    std::vector<uint32_t> fibersIndices;
-    LoadBCCFile(filePath, fibersVertices, fibersIndices);
-    VertexArrayPtr fibersVertexArray = LoadBCCToOpenGL(fibersVertices, fibersIndices);
+    FibersData fibers;
+    LoadBCCFile(filePath, fibers);
+    QuantizedPositions fibersPositions;
+    VertexArrayPtr fibersVertexArray = LoadBCCToOpenGL(fibers.controlPoints, fibers.indices, fibersPositions);
     VertexBufferPtr fibersVertexBuffer = fibersVertexArray->GetVertexBuffers()[0];
     IndexBufferPtr fibersIndexBuffer = fibersVertexArray->GetIndexBuffer();
 
@@ -129,6 +160,9 @@ int main(int argc, char *argv[])
     std::vector<Vertex> clothVertices;
     std::vector<uint32_t> clothIndices;
     Mesh::BuildPlane(22.0f, 15.0f, 60, 40, clothVertices, clothIndices);
+    // The fibers are bound to the cloth in its rest pose whatever its simulated state, so that the
+    // bindings and their cache only depend on the fibers file
+    const std::vector<Vertex> clothRestVertices = clothVertices;
     auto clothVertexBuffer = VertexBuffer::Create(clothVertices.data(), 
                                                   clothVertices.size() * sizeof(Vertex));
     clothVertexBuffer->SetLayout({{"Position",  3, GL_FLOAT, false},
@@ -141,12 +175,42 @@ int main(int argc, char *argv[])
     clothVertexArray->SetIndexBuffer(clothIndexBuffer);
     clothVertexArray->Unbind();
 
+    // Only the normals and fibers around the cloth vertices that moved since the last frame are updated,
+    // so that the sleeping regions of the simulation cost nothing downstream
+    std::vector<uint32_t> clothVertexTriangleOffsets, clothVertexTriangles;
+    Mesh::BuildVertexTriangles(clothVertices.size(), clothIndices, clothVertexTriangleOffsets, clothVertexTriangles);
+    std::vector<glm::vec3> renderedPositions(clothVertices.size(), glm::vec3(std::numeric_limits<float>::max()));
+    std::vector<uint8_t> movedVertices(clothVertices.size(), 1);
+    // Vertices moved since the last fibers deformation, which is skipped while the fibers are hidden
+    std::vector<uint8_t> fibersMovedVertices(clothVertices.size(), 1);
+    bool fibersClothMoved = true;
+
     // Initialize the simulation engine
     SimulationEngine engine;
     InitClothFromMesh(engine, clothVertices, 60, 40, fe);
 
+    // The simulation runs at fe steps per simulated second whatever the frame rate on its own thread,
+    // the rendered cloth is interpolated between the two last simulated states
+    SimulationThread simulationThread(engine, solvers[solver], h, maxSubsteps);
+
+    // Obstacles only need their signed distance field to collide, the mesh is kept to draw them
+    std::vector<fs::path> obstacleFiles = ListOBJFiles(resolver.Resolve("resources"));
+    VertexArrayPtr obstacleVertexArray;
+    bool obstacleMoved = false;
+
     // Initialize the deformer that will wrap the fibers vertices to the simulated mesh
     WrapDeformer wrap;
+    // Same deformation evaluated on the GPU, its bindings are uploaded again whenever the deformer
+    // or the fibers buffers are replaced
+    GpuWrapDeformer gpuWrap;
+    bool gpuWrapOutdated = true;
+
+    // Files selected in the UI are loaded in the background and swapped in once ready
+    FibersLoader fibersLoader;
+
+    // Headless replays run in the background, the simulation staying paused until they complete
+    std::unique_ptr<SimulationThread::PauseGuard> replayPause;
+    ReplayRunner replayRunner;
 
     // Shadow mapping
     DirectionalLight directional(initLightDirection, {0.8f, 0.8f, 0.8f});
@@ -170,35 +234,114 @@ int main(int argc, char *argv[])
         prevTime = currentTime;
         
         camera.Update();
+
+        if (fibersLoader.Fetch(filePath, fibers, wrap))
+        {
+            // Swap the newly loaded fibers in before anything uses them this frame
+            fibersVertexBuffer->Bind();
+            UploadPositions(fibersVertexBuffer, fibers.controlPoints, fibersPositions);
+            fibersVertexBuffer->Unbind();
+            fibersIndexBuffer->Bind();
+            fibersIndexBuffer->SetData(fibers.indices.data(), fibers.indices.size());
+            fibersIndexBuffer->Unbind();
+            gpuWrapOutdated = true;
+        }
  
+        if (replayPause && !replayRunner.IsRunning())
+        {
+            // Time spent replaying is not caught up
+            replayPause.reset();
+            simulationThread.Reset();
+        }
+
+        if (obstacleVertexArray && enableSimulation && animateObstacleRotation)
+        {
+            obstacleRotation.y += deltaTime * 25.0f - (obstacleRotation.y > 180.0f) * 360.0f;
+            obstacleMoved = true;
+        }
+
+        // The worker moves the obstacle before its next steps, the simulation is never paused for it
+        if (obstacleMoved && obstacleVertexArray)
+        {
+            simulationThread.SetObstacleTransform(0, obstaclePosition, glm::mat3(ObstacleRotationMatrix()));
+        }
+        obstacleMoved = false;
+
         if (enableSimulation && (showFibers || showClothMesh))
         {
             // Mesh animation
             const ProfilingScope scope("Mesh animation");  
             
-            massSpringGravityWindSolver(engine, h);
-            for (int i = 0 ; i < engine.particles.size() ; ++i)
+            // Draw the latest completed state while the steps of this frame run in the background
+            simulationThread.Fetch();
+            simulationThread.Submit(deltaTime);
+
+            const SimulationState& state = simulationThread.GetState();
+            bool clothMoved = false;
+            for (int i = 0 ; i < state.positions.size() ; ++i)
             {
-                clothVertices[i].position = engine.particles[i].position;
+                const glm::vec3 position = glm::mix(state.previousPositions[i], state.positions[i], state.interpolation);
+                movedVertices[i] = position != renderedPositions[i];
+                fibersMovedVertices[i] |= movedVertices[i];
+                clothMoved |= movedVertices[i];
+                renderedPositions[i] = position;
+                clothVertices[i].position = position;
             }
-            Mesh::GenerateNormals(clothVertices, clothIndices);
+            fibersClothMoved |= clothMoved;
 
-            clothVertexBuffer->Bind();
-            clothVertexBuffer->SetData(clothVertices.data(), 
-                                        clothVertices.size() * sizeof(Vertex));
-            clothVertexBuffer->Unbind();
+            if (clothMoved)
+            {
+                Mesh::UpdateNormals(clothVertices, clothIndices, clothVertexTriangleOffsets, clothVertexTriangles, movedVertices);
+
+                clothVertexBuffer->Bind();
+                clothVertexBuffer->SetData(clothVertices.data(), 
+                                            clothVertices.size() * sizeof(Vertex));
+                clothVertexBuffer->Unbind();
+            }
         }
 
             
-        if (wrap.IsInitialized() && showFibers)
+        bool fibersDeformed = false;
+        if (useGpuWrap && wrap.IsInitialized() && showFibers)
+        {
+            // Fibers deformation on the GPU, only the cloth positions are uploaded. The moved vertices are kept
+            // for the CPU deformer in case it is used again.
+            const ProfilingScope scope("Fibers GPU deformation");
+
+            if (gpuWrapOutdated)
+            {
+                gpuWrapOutdated = false;
+                if (!gpuWrap.Upload(wrap, clothIndices, fibersIndexBuffer))
+                {
+                    LOG_ERROR("Could not set up the GPU deformation, falling back to the CPU");
+                    useGpuWrap = false;
+                }
+            }
+
+            if (useGpuWrap && (fibersClothMoved || !gpuWrap.HasDeformed()))
+            {
+                gpuWrap.Deform(clothVertices, wrap.GetSmoothIterations());
+                fibersClothMoved = false;
+            }
+        }
+        else if (wrap.IsInitialized() && showFibers && (fibersClothMoved || !wrap.HasDeformed()))
         {
             // Fibers deformation
             const ProfilingScope scope("Fibers deformation");  
 
-            wrap.Deform(fibersVertices, clothVertices, clothIndices);
+            wrap.Deform(fibers.controlPoints, clothVertices, clothIndices, &fibersMovedVertices);
+            std::fill(fibersMovedVertices.begin(), fibersMovedVertices.end(), 0);
+            fibersClothMoved = false;
+            fibersDeformed = true;
+        }
+
+        if (fibersDeformed)
+        {
+            // Fibers upload, quantizing the positions when requested
+            const ProfilingScope scope("Fibers upload");  
+
             fibersVertexBuffer->Bind();
-            fibersVertexBuffer->SetData(fibersVertices.data(), 
-                                        fibersVertices.size() * sizeof(glm::vec3));
+            UploadPositions(fibersVertexBuffer, fibers.controlPoints, fibersPositions);
             fibersVertexBuffer->Unbind();
         }
 
@@ -220,18 +363,26 @@ int main(int argc, char *argv[])
                 lightRotation += deltaTime * 25.0f - (lightRotation > 180.0f) * 360.0f;
             directional.SetDirection(glm::vec3(glm::rotate(glm::mat4(1.0f), glm::radians(lightRotation), {0.0f, 1.0f, 0.0f}) * glm::vec4(initLightDirection, 1.0f)));
 
+            // The fibers deformed on the GPU are stored as floats, without any decoding
+            const bool drawGpuFibers = useGpuWrap && wrap.IsInitialized() && !gpuWrapOutdated && gpuWrap.IsUploaded();
+            const VertexArrayPtr& drawnFibersVertexArray = drawGpuFibers ? gpuWrap.GetVertexArray() : fibersVertexArray;
+            const glm::vec3 fibersPositionOffset = drawGpuFibers ? glm::vec3(0.0f) : fibersPositions.offset;
+            const glm::vec3 fibersPositionScale = drawGpuFibers ? glm::vec3(1.0f) : fibersPositions.scale;
+
             // Render the shadow map
             if (useShadowMapping)
             {    
                 shadowMap.Begin(directional.GetViewMatrix(), directional.GetProjectionMatrix(), shadowMapThickness);
+                shadowMap.GetShader().setVec3("uPositionOffset", fibersPositionOffset);
+                shadowMap.GetShader().setVec3("uPositionScale", fibersPositionScale);
                 {
                     // Render all the objects that cast shadows here
-                    fibersVertexArray->Bind();
+                    drawnFibersVertexArray->Bind();
                     glEnable(GL_CULL_FACE);
                     glCullFace(GL_BACK);
                     glDrawElements(GL_PATCHES, fibersIndexBuffer->GetCount(), GL_UNSIGNED_INT, nullptr);
                     glDisable(GL_CULL_FACE);
-                    fibersVertexArray->Unbind();
+                    drawnFibersVertexArray->Unbind();
                 }
                 shadowMap.End();
             }
@@ -246,8 +397,10 @@ int main(int argc, char *argv[])
                 fiberShader.setMat4("uProjMatrix", projMatrix);
                 fiberShader.setMat4("uViewMatrix", viewMatrix);
                 fiberShader.setMat4("uModelMatrix", modelMatrix);
+                fiberShader.setVec3("uPositionOffset", fibersPositionOffset);
+                fiberShader.setVec3("uPositionScale", fibersPositionScale);
             
-                fibersVertexArray->Bind();
+                drawnFibersVertexArray->Bind();
 
                 fiberShader.setInt("uPlyCount", plyCount);
                 fiberShader.setInt("uTessLineCount", fibersCount);
@@ -297,7 +450,7 @@ int main(int argc, char *argv[])
                 }
 
                 glDrawElements(GL_PATCHES, fibersIndexBuffer->GetCount(), GL_UNSIGNED_INT, nullptr);
-                fibersVertexArray->Unbind();
+                drawnFibersVertexArray->Unbind();
             }
 
             if (showClothMesh)
@@ -314,6 +467,20 @@ int main(int argc, char *argv[])
                 clothVertexArray->Unbind();
                 glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
             }
+
+            if (obstacleVertexArray)
+            {
+                const glm::mat4 obstacleMatrix = glm::translate(glm::mat4(1.0f), obstaclePosition) * ObstacleRotationMatrix();
+                lambertShader.use();
+                lambertShader.setMat4("uModelMatrix", obstacleMatrix);
+                lambertShader.setMat4("uViewMatrix", viewMatrix);
+                lambertShader.setMat4("uProjMatrix", projMatrix);
+                lambertShader.setInt("uReceiveShadows", false);
+
+                obstacleVertexArray->Bind();
+                glDrawElements(GL_TRIANGLES, obstacleVertexArray->GetIndexBuffer()->GetCount(), GL_UNSIGNED_INT, nullptr);
+                obstacleVertexArray->Unbind();
+            }
         }
 
         {
@@ -334,6 +501,32 @@ int main(int argc, char *argv[])
                     indentedLabel("FPS :");
                     ImGui::SameLine();
                     ImGui::Text("%.1f (%.3fms)", io.Framerate, 1000.0f / io.Framerate);
+
+                    if (enableSimulation)
+                    {
+                        indentedLabel("Simulation substeps :");
+                        ImGui::SameLine();
+                        const SimulationState& state = simulationThread.GetState();
+                        ImGui::Text("%d (%.3fms per step, %s)", state.substeps, state.stepTime * 1000.0,
+                                    engine.useTypedKernels ? "typed" : "generic");
+                        if (state.droppedTime > 0.0)
+                        {
+                            ImGui::SameLine();
+                            ImGui::Text("- %.1fms dropped", state.droppedTime * 1000.0);
+                        }
+
+                        indentedLabel("Active particles :");
+                        ImGui::SameLine();
+                        ImGui::Text("%.1f%% (%d / %d)", 100.0f * state.activeParticles / std::max<size_t>(1, state.positions.size()),
+                                    state.activeParticles, (int)state.positions.size());
+
+                        if (solvers[solver] == massSpringImplicitSolver)
+                        {
+                            indentedLabel("CG iterations :");
+                            ImGui::SameLine();
+                            ImGui::Text("%d (residual %.1e)", state.solverIterations, state.solverResidual);
+                        }
+                    }
                 
                     for (const auto& scope : profilingScopes)
                     {
@@ -353,31 +546,27 @@ int main(int argc, char *argv[])
                     indentedLabel("File name :");
                     ImGui::SameLine();
                     ImGui::SetNextItemWidth((ImGui::GetWindowContentRegionWidth() - ImGui::GetCursorPosX()) * 0.75f);
-                    if (ImGui::BeginCombo("##FileChoiceCombo", filePath.filename().c_str()))
+                    fs::path selectedPath = fibersLoader.IsLoading() ? fibersLoader.GetLoadingPath() : filePath;
+                    if (ImGui::BeginCombo("##FileChoiceCombo", selectedPath.filename().c_str()))
                     {
                         for (const auto& path : availableFiles)
                         {
-                            if (ImGui::Selectable(path.filename().c_str(), filePath.filename() == path.filename()))
+                            if (ImGui::Selectable(path.filename().c_str(), selectedPath.filename() == path.filename()))
                             {
-                                filePath = path;
-                                LoadBCCFile(filePath, fibersVertices, fibersIndices);
-                                fibersVertexBuffer->Bind();
-                                fibersVertexBuffer->SetData(fibersVertices.data(), 
-                                                            fibersVertices.size() * sizeof(glm::vec3));
-                                fibersVertexBuffer->Unbind();
-                                fibersIndexBuffer->Bind();
-                                fibersIndexBuffer->SetData(fibersIndices.data(), fibersIndices.size());
-                                fibersIndexBuffer->Unbind();
-                                if (wrap.IsInitialized())
-                                {
-                                    wrap.Initialize(fibersVertices, clothVertices, clothIndices);
-                                }
+                                fibersLoader.Load(path, clothRestVertices, clothIndices, wrap.IsInitialized());
                             }
                         }
 
                         ImGui::EndCombo();
                     }
 
+                    if (fibersLoader.IsLoading())
+                    {
+                        indentedLabel("Loading :");
+                        ImGui::SameLine();
+                        ImGui::ProgressBar(fibersLoader.GetProgress(), ImVec2((ImGui::GetWindowContentRegionWidth() - ImGui::GetCursorPosX()) * 0.75f, 0.0f));
+                    }
+
                     indentedLabel("Ply count :");
                     ImGui::SameLine();
                     if (ImGui::DragInt("##PlyCountDrag", &plyCount, 0.1f, 0, 10, 
@@ -423,6 +612,23 @@ int main(int argc, char *argv[])
                     ImGui::SameLine();
                     ImGui::Checkbox("##ShowFibersCB", &showFibers);
 
+                    indentedLabel("Positions storage :");
+                    ImGui::SameLine();
+                    if (ImGui::Combo("##PositionStorageCombo", &positionStorage, "Float 32 bits\0Half float 16 bits\0Fixed point 16 bits\0"))
+                    {
+                        // The attribute format changes, so the fibers get a whole new vertex array
+                        fibersPositions.storage = (PositionStorage)positionStorage;
+                        fibersVertexArray = LoadBCCToOpenGL(fibers.controlPoints, fibers.indices, fibersPositions);
+                        fibersVertexBuffer = fibersVertexArray->GetVertexBuffers()[0];
+                        fibersIndexBuffer = fibersVertexArray->GetIndexBuffer();
+                        gpuWrapOutdated = true;
+
+                        QuantizationError error = MeasureQuantizationError(fibers.controlPoints, fibersPositions);
+                        LOG_INFO("Fibers positions stored on %lu bytes, max error %g, mean error %g",
+                                 fibersVertexBuffer->GetLayout().GetStride() * fibers.controlPoints.size(),
+                                 error.maxError, error.meanError);
+                    }
+
                     indentedLabel("Ambient occlusion :");
                     ImGui::SameLine();
                     ImGui::Checkbox("##UseAmbientOcclusion", &useAmbientOcclusion);
@@ -475,20 +681,315 @@ int main(int argc, char *argv[])
 
                 if (ImGui::CollapsingHeader("Simulation", ImGuiTreeNodeFlags_DefaultOpen))
                 {
+                    // The fibers being loaded are bound to the cloth only if the simulation was already enabled
                     indentedLabel("Enable simulation :");
                     ImGui::SameLine();
+                    ImGui::BeginDisabled(fibersLoader.IsLoading());
                     if (ImGui::Checkbox("##EnableSimulationCB", &enableSimulation))
                     {
+                        // Time spent with the simulation disabled is not caught up
+                        simulationThread.Reset();
                         if (!wrap.IsInitialized())
-                            wrap.Initialize(fibersVertices, clothVertices, clothIndices);
+                        {
+                            wrap.InitializeCached(GetWrapCachePath(filePath), fibers.sourceHash, fibers.controlPoints, clothRestVertices, clothIndices);
+                            wrap.SetCurves(fibers.curves);
+                            gpuWrapOutdated = true;
+                        }
                     }
+                    ImGui::EndDisabled();
 
                     ImGui::SameLine();
                     if (ImGui::Button("Reset##Simulation"))
                     {
+                        SimulationThread::PauseGuard pause(simulationThread);
+                        if (simulationThread.IsRecording())
+                            simulationThread.StopRecording();
                         Mesh::BuildPlane(22.0f, 15.0f, 60, 40, clothVertices, clothIndices);
                         InitClothFromMesh(engine, clothVertices, 60, 40, fe);
+                        simulationThread.Reset();
+                    }
+
+                    // Snapshots and replays are written next to the resources, to reproduce a given cloth state
+                    const fs::path snapshotPath = resolver.Resolve("resources/simulation.snapshot");
+                    const fs::path replayPath = resolver.Resolve("resources/simulation" SIMULATION_REPLAY_EXTENSION);
+
+                    indentedLabel("Snapshot :");
+                    ImGui::SameLine();
+                    if (ImGui::Button("Save##SimulationSnapshot"))
+                    {
+                        SimulationThread::PauseGuard pause(simulationThread);
+                        SaveSimulationSnapshot(snapshotPath, engine);
                     }
+                    ImGui::SameLine();
+                    ImGui::BeginDisabled(simulationThread.IsRecording() || !fs::exists(snapshotPath));
+                    if (ImGui::Button("Restore##SimulationSnapshot"))
+                    {
+                        SimulationThread::PauseGuard pause(simulationThread);
+                        // The snapshot is restored aside, the rendered cloth is indexed by particle so that a
+                        // snapshot of another cloth can't be shown
+                        SimulationEngine restored;
+                        if (!LoadSimulationSnapshot(snapshotPath, restored) || restored.GetParticleCount() != clothVertices.size())
+                        {
+                            LOG_ERROR("The snapshot doesn't match the cloth, keeping the current simulation");
+                        }
+                        else
+                        {
+                            // Only the cloth is restored, the obstacles and kernels stay the ones shown in the UI
+                            restored.obstacles = std::move(engine.obstacles);
+                            restored.kernels = engine.kernels;
+                            restored.useTypedKernels = engine.useTypedKernels;
+                            engine = std::move(restored);
+                        }
+                        simulationThread.Reset();
+                    }
+                    ImGui::EndDisabled();
+
+                    indentedLabel("Replay :");
+                    ImGui::SameLine();
+                    if (!simulationThread.IsRecording())
+                    {
+                        // The recording reads the global settings, which the running replay overrides
+                        ImGui::BeginDisabled(replayRunner.IsRunning());
+                        if (ImGui::Button("Record##SimulationReplay"))
+                            simulationThread.StartRecording(replayPath);
+                        ImGui::EndDisabled();
+                    }
+                    else
+                    {
+                        if (ImGui::Button("Stop##SimulationReplay"))
+                            simulationThread.StopRecording();
+                        ImGui::SameLine();
+                        ImGui::Text("%d steps", (int)simulationThread.GetRecordedStepCount());
+                    }
+                    ImGui::SameLine();
+                    if (!replayRunner.IsRunning())
+                    {
+                        ImGui::BeginDisabled(simulationThread.IsRecording() || !fs::exists(replayPath));
+                        if (ImGui::Button("Run headless##SimulationReplay"))
+                        {
+                            // Replayed on its own engine so that the interactive cloth is left untouched
+                            replayPause = std::make_unique<SimulationThread::PauseGuard>(simulationThread);
+                            replayRunner.Start(replayPath, replaySteps);
+                        }
+                        ImGui::EndDisabled();
+                        ImGui::SameLine();
+                        ImGui::DragInt("##ReplayStepsDrag", &replaySteps, 10.0f, 0, 1000000, replaySteps > 0 ? "%d steps" : "Recorded steps");
+                    }
+                    else
+                    {
+                        if (ImGui::Button("Cancel##SimulationReplay"))
+                            replayRunner.Cancel();
+                        ImGui::SameLine();
+                        ImGui::ProgressBar(replayRunner.GetProgress(), ImVec2((ImGui::GetWindowContentRegionWidth() - ImGui::GetCursorPosX()) * 0.75f, 0.0f));
+                    }
+
+                    ReplayResult replayResult;
+                    if (!replayRunner.IsRunning() && replayRunner.GetResult(replayResult))
+                    {
+                        indentedLabel("Last replay :");
+                        ImGui::SameLine();
+                        ImGui::Text("%d steps, %.1f steps/s, %s", (int)replayResult.stepCount, replayResult.stepsPerSecond,
+                                    replayResult.cancelled ? "cancelled" :
+                                    !replayResult.checked ? "not checked" :
+                                    replayResult.matchesRecording ? "matching the recording" : "diverging from the recording");
+                    }
+
+                    indentedLabel("Obstacle :");
+                    ImGui::SameLine();
+                    const std::string obstacleName = obstacle > 0 ? obstacleFiles[obstacle - 1].filename().string() : "None";
+                    if (ImGui::BeginCombo("##ObstacleCombo", obstacleName.c_str()))
+                    {
+                        for (int i = 0 ; i <= (int)obstacleFiles.size() ; i++)
+                        {
+                            const std::string name = i > 0 ? obstacleFiles[i - 1].filename().string() : "None";
+                            if (!ImGui::Selectable(name.c_str(), i == obstacle) || i == obstacle)
+                                continue;
+
+                            SimulationThread::PauseGuard pause(simulationThread);
+                            engine.obstacles.clear();
+                            obstacleVertexArray = nullptr;
+                            obstacle = 0;
+
+                            // The field is expressed in the frame of the mesh, the transform is sent right after
+                            auto field = std::make_shared<SignedDistanceField>();
+                            std::vector<glm::vec3> positions;
+                            std::vector<uint32_t> indices;
+                            if (i > 0 &&
+                                LoadOBJSignedDistanceField(obstacleFiles[i - 1], obstacleSpacing, *field) &&
+                                LoadOBJFile(obstacleFiles[i - 1], positions, indices))
+                            {
+                                engine.obstacles.push_back(MeshObstacle(field, obstaclePosition, glm::mat3(1.0f), obstacleOffset, ObstacleStiffness(fe)));
+
+                                std::vector<Vertex> vertices(positions.size());
+                                for (size_t v = 0 ; v < positions.size() ; v++)
+                                    vertices[v].position = positions[v];
+                                Mesh::GenerateNormals(vertices, indices);
+
+                                auto vertexBuffer = VertexBuffer::Create(vertices.data(), vertices.size() * sizeof(Vertex));
+                                vertexBuffer->SetLayout({{"Position",  3, GL_FLOAT, false},
+                                                         {"Normal",    3, GL_FLOAT, false},
+                                                         {"TexCoord",  2, GL_FLOAT, false}});
+                                obstacleVertexArray = VertexArray::Create();
+                                obstacleVertexArray->Bind();
+                                obstacleVertexArray->AddVertexBuffer(vertexBuffer);
+                                obstacleVertexArray->SetIndexBuffer(IndexBuffer::Create(indices.data(), indices.size()));
+                                obstacleVertexArray->Unbind();
+
+                                obstacle = i;
+                                obstacleMoved = true;
+                            }
+                        }
+
+                        ImGui::EndCombo();
+                    }
+
+                    if (obstacleVertexArray)
+                    {
+                        indentedLabel("Obstacle position :");
+                        ImGui::SameLine();
+                        obstacleMoved |= ImGui::DragFloat3("##ObstaclePositionDrag", &obstaclePosition.x, 0.05f, -50.0f, 50.0f, "%.2f");
+
+                        indentedLabel("Obstacle rotation :");
+                        ImGui::SameLine();
+                        obstacleMoved |= ImGui::DragFloat3("##ObstacleRotationDrag", &obstacleRotation.x, 0.5f, -180.0f, 180.0f, "%.1f");
+
+                        indentedLabel("Animated obstacle :");
+                        ImGui::SameLine();
+                        ImGui::Checkbox("##AnimatedObstacleCB", &animateObstacleRotation);
+                    }
+
+                    indentedLabel("Max substeps :");
+                    ImGui::SameLine();
+                    if (ImGui::DragInt("##MaxSubstepsDrag", &maxSubsteps, 0.1f, 1, 64, "%d steps"))
+                        simulationThread.SetMaxSubsteps(maxSubsteps);
+
+                    indentedLabel("Solver :");
+                    ImGui::SameLine();
+                    if (ImGui::Combo("##SolverCombo", &solver, "Mass-spring\0Mass-spring gravity\0Mass-spring gravity wind\0XPBD\0Implicit mass-spring\0"))
+                        simulationThread.SetSolver(solvers[solver]);
+
+                    // The explicit solvers need small steps, XPBD stays stable at one step per frame
+                    indentedLabel("Steps per second :");
+                    ImGui::SameLine();
+                    if (ImGui::DragFloat("##StepsPerSecondDrag", &stepsPerSecond, 1.0f, 10.0f, 1000.0f, "%.0f"))
+                        simulationThread.SetStepDuration(1.0 / stepsPerSecond);
+
+                    // The running replay overrides the global settings until it completes
+                    ImGui::BeginDisabled(replayRunner.IsRunning());
+                    if (solvers[solver] == xpbdSolver)
+                    {
+                        XPBDSettings settings = getXPBDSettings();
+                        bool changed = false;
+
+                        indentedLabel("Iterations :");
+                        ImGui::SameLine();
+                        changed |= ImGui::DragInt("##XPBDIterationsDrag", (int*)&settings.iterations, 0.1f, 1, 100);
+
+                        indentedLabel("Compliance :");
+                        ImGui::SameLine();
+                        changed |= ImGui::DragFloat("##XPBDComplianceDrag", &settings.compliance, 1e-8f, 0.0f, 1e-2f, "%.1e", ImGuiSliderFlags_Logarithmic);
+
+                        indentedLabel("Damping :");
+                        ImGui::SameLine();
+                        changed |= ImGui::DragFloat("##XPBDDampingDrag", &settings.damping, 0.001f, 0.0f, 1.0f, "%.3f");
+
+                        if (changed)
+                        {
+                            SimulationThread::PauseGuard pause(simulationThread);
+                            getXPBDSettings() = settings;
+                        }
+                    }
+
+                    if (solvers[solver] == massSpringImplicitSolver)
+                    {
+                        ImplicitSettings settings = getImplicitSettings();
+                        float timeBudget = settings.timeBudget * 1000.0f;
+                        bool changed = false;
+
+                        indentedLabel("Max CG iterations :");
+                        ImGui::SameLine();
+                        changed |= ImGui::DragInt("##CGIterationsDrag", (int*)&settings.maxIterations, 0.5f, 1, 1000);
+
+                        indentedLabel("CG tolerance :");
+                        ImGui::SameLine();
+                        changed |= ImGui::DragFloat("##CGToleranceDrag", &settings.tolerance, 1e-6f, 1e-8f, 1e-1f, "%.1e", ImGuiSliderFlags_Logarithmic);
+
+                        indentedLabel("CG time budget :");
+                        ImGui::SameLine();
+                        changed |= ImGui::DragFloat("##CGBudgetDrag", &timeBudget, 0.1f, 0.1f, 100.0f, "%.1fms");
+
+                        if (changed)
+                        {
+                            settings.timeBudget = timeBudget / 1000.0f;
+                            SimulationThread::PauseGuard pause(simulationThread);
+                            getImplicitSettings() = settings;
+                        }
+                    }
+
+                    // Collisions are handled by the solvers with wind
+                    if (solvers[solver] != massSpringSolver && solvers[solver] != massSpringGravitySolver)
+                    {
+                        CollisionSettings settings = getCollisionSettings();
+                        bool changed = false;
+
+                        indentedLabel("Self-collision :");
+                        ImGui::SameLine();
+                        changed |= ImGui::Checkbox("##SelfCollisionCB", &settings.selfCollision);
+
+                        if (settings.selfCollision)
+                        {
+                            indentedLabel("Thickness :");
+                            ImGui::SameLine();
+                            changed |= ImGui::DragFloat("##ThicknessDrag", &settings.thickness, 0.001f, 0.01f, 1.0f, "%.3f");
+
+                            indentedLabel("Repulsion :");
+                            ImGui::SameLine();
+                            changed |= ImGui::DragFloat("##RepulsionDrag", &settings.stiffness, 10.0f, 0.0f, 100000.0f, "%.0f");
+                        }
+
+                        if (changed)
+                        {
+                            SimulationThread::PauseGuard pause(simulationThread);
+                            getCollisionSettings() = settings;
+                        }
+                    }
+
+                    // The implicit solver keeps every region awake
+                    if (solvers[solver] != massSpringImplicitSolver)
+                    {
+                        SleepSettings settings = getSleepSettings();
+                        bool changed = false;
+
+                        indentedLabel("Sleeping regions :");
+                        ImGui::SameLine();
+                        changed |= ImGui::Checkbox("##SleepingCB", &settings.enabled);
+
+                        if (settings.enabled)
+                        {
+                            indentedLabel("Region size :");
+                            ImGui::SameLine();
+                            changed |= ImGui::DragInt("##SleepRegionSizeDrag", (int*)&settings.regionSize, 1.0f, 16, 4096, "%d particles");
+
+                            indentedLabel("Sleep energy :");
+                            ImGui::SameLine();
+                            changed |= ImGui::DragFloat("##SleepEnergyDrag", &settings.sleepEnergy, 1e-6f, 1e-8f, 1.0f, "%.1e", ImGuiSliderFlags_Logarithmic);
+
+                            indentedLabel("Wake energy :");
+                            ImGui::SameLine();
+                            changed |= ImGui::DragFloat("##WakeEnergyDrag", &settings.wakeEnergy, 1e-4f, 1e-8f, 10.0f, "%.1e", ImGuiSliderFlags_Logarithmic);
+
+                            indentedLabel("Calm steps :");
+                            ImGui::SameLine();
+                            changed |= ImGui::DragInt("##CalmStepsDrag", (int*)&settings.calmSteps, 0.5f, 1, 1000);
+                        }
+
+                        if (changed)
+                        {
+                            SimulationThread::PauseGuard pause(simulationThread);
+                            getSleepSettings() = settings;
+                        }
+                    }
+                    ImGui::EndDisabled();
 
                     indentedLabel("Show simulation mesh :");
                     ImGui::SameLine();
@@ -498,7 +999,50 @@ int main(int argc, char *argv[])
                     ImGui::SameLine();
                     int iterations = wrap.GetSmoothIterations();
                     if (ImGui::DragInt("##SmoothIterationDrag", &iterations, 0.1f, 0, 10, "%d steps"))
+                    {
                         wrap.SetSmoothIterations(iterations);
+                        fibersClothMoved = true;
+                    }
+
+                    indentedLabel("GPU deformation :");
+                    ImGui::SameLine();
+                    if (ImGui::Checkbox("##GpuDeformationCB", &useGpuWrap) && !useGpuWrap)
+                    {
+                        // The CPU deformer catches up with the vertices moved while the GPU was deforming
+                        fibersClothMoved = true;
+                    }
+                    ImGui::SameLine();
+                    ImGui::BeginDisabled(!useGpuWrap || !gpuWrap.IsUploaded() || gpuWrapOutdated);
+                    if (ImGui::Button("Compare with CPU##GpuDeformation"))
+                    {
+                        WrapComparison comparison = CompareWrapDeformers(gpuWrap, wrap, fibers.controlPoints, clothVertices, clothIndices);
+                        LOG_INFO("Fibers deformation : CPU %.3fms, GPU %.3fms, max distance %g, mean distance %g",
+                                 comparison.cpuTime * 1e3, comparison.gpuTime * 1e3, comparison.maxError, comparison.meanError);
+                    }
+                    ImGui::EndDisabled();
+
+                    indentedLabel("Simulation kernels :");
+                    ImGui::SameLine();
+                    ImGui::Text("%s", engine.kernels->name);
+                    ImGui::SameLine();
+                    bool useTypedKernels = engine.useTypedKernels;
+                    if (ImGui::Checkbox("Typed##TypedKernelsCB", &useTypedKernels))
+                    {
+                        SimulationThread::PauseGuard pause(simulationThread);
+                        engine.useTypedKernels = useTypedKernels;
+                    }
+                    ImGui::SameLine();
+                    ImGui::BeginDisabled(replayRunner.IsRunning());
+                    if (ImGui::Button("Benchmark##SimulationKernels"))
+                    {
+                        SimulationThread::PauseGuard pause(simulationThread);
+                        for (const auto& result : BenchmarkSimulationKernels(engine))
+                            LOG_INFO("%s kernels : %.1f M links/s, %.1f M particles/s",
+                                     result.name.c_str(),
+                                     result.linksPerSecond * 1e-6,
+                                     result.particlesPerSecond * 1e-6);
+                    }
+                    ImGui::EndDisabled();
 
                     ImGui::Spacing();
                 }
@@ -4,7 +4,11 @@
 // vertex position
 layout (location = 0) in vec3 aPos;
 
+// Decoding of the quantized positions (see Base/Quantization.h), identity for float positions
+uniform vec3 uPositionOffset = vec3(0.0);
+uniform vec3 uPositionScale = vec3(1.0);
+
 void main()
 {
-    gl_Position = vec4(aPos, 1.0);
+    gl_Position = vec4(aPos * uPositionScale + uPositionOffset, 1.0);
 }
\ No newline at end of file
@@ -0,0 +1,35 @@
+// vertex shader, transform feedback pass over the fibers control points (see GpuWrapDeformer.h)
+#version 410 core
+
+// Binding of each point : triangle of the cloth, barycentric coordinates and offset along the triangle normal
+uniform usamplerBuffer uBindings;
+uniform samplerBuffer uCoordinates;
+uniform samplerBuffer uRestPoints;
+
+uniform usamplerBuffer uClothIndices;
+uniform samplerBuffer uClothPositions;
+
+// Offsets from the rest points when they are smoothed afterwards, positions otherwise
+uniform bool uOutputOffsets = false;
+
+out vec3 vPosition;
+
+vec3 ClothPosition(uint index)
+{
+    return texelFetch(uClothPositions, int(texelFetch(uClothIndices, int(index)).r)).xyz;
+}
+
+void main()
+{
+    // Same evaluation as WrapDeformer::Deform
+    uint triangle = texelFetch(uBindings, gl_VertexID).r;
+    vec4 coordinates = texelFetch(uCoordinates, gl_VertexID);
+
+    vec3 v1 = ClothPosition(3u * triangle);
+    vec3 v2 = ClothPosition(3u * triangle + 1u);
+    vec3 v3 = ClothPosition(3u * triangle + 2u);
+    vec3 normal = normalize(cross(v1 - v2, v2 - v3));
+
+    vec3 position = coordinates.x * v1 + coordinates.y * v2 + coordinates.z * v3 + normal * coordinates.w;
+    vPosition = uOutputOffsets ? position - texelFetch(uRestPoints, gl_VertexID).xyz : position;
+}
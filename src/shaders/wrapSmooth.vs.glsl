@@ -0,0 +1,35 @@
+// vertex shader, transform feedback pass over the fibers control points (see GpuWrapDeformer.h)
+#version 410 core
+
+// Offsets from the rest points given by the previous pass
+uniform samplerBuffer uOffsets;
+// Previous and next point along the curve, -1 at the ends of the open curves
+uniform isamplerBuffer uNeighbours;
+uniform samplerBuffer uRestPoints;
+
+// Positions on the last iteration, offsets for the next one otherwise
+uniform bool uOutputPositions = false;
+
+out vec3 vPosition;
+
+void main()
+{
+    // One iteration of WrapDeformer::SmoothCurve
+    ivec2 neighbours = texelFetch(uNeighbours, gl_VertexID).xy;
+    vec3 offset = texelFetch(uOffsets, gl_VertexID).xyz;
+    float weight = 1.0;
+
+    if (neighbours.x >= 0)
+    {
+        offset = texelFetch(uOffsets, neighbours.x).xyz + offset;
+        weight += 1.0;
+    }
+    if (neighbours.y >= 0)
+    {
+        offset += texelFetch(uOffsets, neighbours.y).xyz;
+        weight += 1.0;
+    }
+    offset *= 1.0 / weight;
+
+    vPosition = uOutputPositions ? texelFetch(uRestPoints, gl_VertexID).xyz + offset : offset;
+}